@@ -48,7 +48,9 @@
 	"alaska.rep", \
 	"nlydf.rep", \
 	"qyqyc.rep", \
-	"rulsr.rep"
+	"rulsr.rep", \
+	"realloc-big.rep", \
+	"shrink.rep"
 
 
 
@@ -91,9 +93,17 @@
 #define ALIGNMENT 8
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes, by default; mdriver -H sets it at run time,
+ * up to MAX_HEAP_LIMIT, which is as far as mm.c's 32-bit heap offsets in
+ * units of 8 bytes reach
  */
 #define MAX_HEAP (100*(1<<20))  /* 100 MB */
+#define MAX_HEAP_LIMIT ((size_t)0xffffffff << 3)  /* 32 GB */
+
+/*
+ * Maximum bytes mapped outside the heap with mem_mmap
+ */
+#define MAX_MMAP (100*(1<<20))  /* 100 MB */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
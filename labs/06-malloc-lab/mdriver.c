@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <limits.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -18,13 +19,24 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 #include "mm.h"
+#include "mm-variants.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "perfctr.h"
 #include "config.h"
 #include "driverlib.h"
+#include "tracebin.h"
+
+/* Only thread-safe mm packages define this, and -T requires it */
+#pragma weak mm_thread_safe
 
 /**********************
  * Constants and macros
@@ -62,19 +74,28 @@ typedef struct {
 	enum { ALLOC, FREE, REALLOC } type; /* type of request */
 	int index;                        /* index for free() to use later */
 	size_t size;                      /* byte size of alloc/realloc request */
+	size_t align;                     /* alignment of an aligned alloc, else 0 */
+	int zeroed;                       /* the alloc is a calloc */
 } traceop_t;
 
+/* A trace read in chunks (-C) */
+typedef struct stream stream_t;
+
 /* Holds the information for one trace file*/
 typedef struct {
 	char filename[MAXLINE];
 	int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
-	int num_ids;         /* number of alloc/realloc ids */
-	int num_ops;         /* number of distinct requests */
+	long num_ids;        /* number of alloc/realloc ids */
+	long total_ops;      /* number of distinct requests */
 	int weight;          /* weight for this trace (unused) */
-	traceop_t *ops;      /* array of requests */
+	traceop_t *ops;      /* array of requests, or the chunk of a stream... */
+	int num_ops;         /* ... and how many it holds */
+	long op_base;        /* number of the chunk's first request */
 	char **blocks;       /* array of ptrs returned by malloc/realloc... */
 	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 	int *block_rand_base;/* index into random_data, if debug is on */
+	int num_blocks;      /* entries in those three */
+	stream_t *stream;    /* reads the chunks, or NULL */
 } trace_t;
 
 /*
@@ -100,6 +121,17 @@ typedef struct {
 
 	/* defined only for the student malloc package */
 	double util;     /* space utilization for this trace (always 0 for libc) */
+	size_t realloc_copied;  /* payload bytes mm_realloc copied ... */
+	size_t realloc_avoided; /* ... and kept in place, if it reports them */
+	size_t calloc_cleared;  /* bytes mm_calloc cleared ... */
+	size_t calloc_skipped;  /* ... and knew read as zeros, in the util run */
+	size_t heap_hwm;        /* largest heap and mappings during the util run ... */
+	size_t heap_end;        /* ... their size at its end ... */
+	size_t resident;        /* ... and how much of it was in memory */
+	size_t huge;            /* ... of that, heap in huge pages */
+
+	/* hardware events in one more timed run, with -p */
+	perfctr_t ctr;
 
 	/* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -132,6 +164,34 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* print the heap footprint table */
+static int footprint_flag = 0;
+static int perfctr_flag = 0;   /* -p: count hardware events too */
+
+/* sample mm_stats every stats_interval ops of the util run into STATS_FILE */
+#define STATS_FILE "stats.csv"
+static int stats_interval = 0;
+static FILE *stats_file = NULL;
+
+/* -T: replay on this many threads, handing replay_remote percent of the
+   frees to thread replay_consumer, or to the next thread if it is -1 */
+#define MAX_REPLAY_THREADS 64
+static int replay_threads = 0;
+static int replay_remote = 0;
+static int replay_consumer = -1;
+
+/* -z: free with mm_free_sized, and runs of up to FREE_BATCH_MAX frees in
+   a row with mm_free_batch */
+#define FREE_BATCH_MAX 64
+static int sized_free = 0;
+
+/* -C: read each trace stream_chunk requests at a time while it runs */
+static long stream_chunk = 0;
+
+/* The allocator under test, mm.c unless -m picks a variant; -M runs all */
+static const mm_variant_t *mm = mm_variants;
+static int all_variants = 0;
+
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -164,6 +224,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 		const char *filename);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
+static int more_ops(trace_t *trace, int *i);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace);
@@ -175,8 +236,24 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
 
+/* Multithreaded replay of traces for thread-safe packages (-T) */
+static void run_replay(int num_tracefiles, const char *tracedir,
+		char **tracefiles);
+
+/* Evaluation of every allocator variant (-M) */
+static void run_variants(int num_tracefiles, const char *tracedir,
+		char **tracefiles, range_t *ranges, speed_t *speed_params);
+
 /* Various helper routines */
+static double perf_index(int n, stats_t *stats, double *avg_util,
+		double *avg_throughput, double *p1, double *p2);
 static void printresults(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printrealloc(int n, stats_t *stats);
+static void printcalloc(int n, stats_t *stats);
+static void printfootprint(int n, stats_t *stats);
+static void open_stats(void);
+static void sample_stats(const trace_t *trace, long opnum);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
 	__attribute__((format(printf, 3,4)));
@@ -209,13 +286,16 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 		trace_t *trace;
 		trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
 		strcpy(mm_stats[i].filename, trace->filename);
-		mm_stats[i].ops = trace->num_ops;
+		mm_stats[i].ops = trace->total_ops;
 		if(timed_out) {
 			mm_stats[i].valid = 0;
 		} else {
 			if (verbose > 1)
 				printf("Checking mm_malloc for correctness, ");
 			mm_stats[i].valid = eval_mm_valid(trace, &ranges);
+			if (mm->realloc_stats != NULL)
+				mm->realloc_stats(&mm_stats[i].realloc_copied,
+						&mm_stats[i].realloc_avoided);
 
 			if (onetime_flag) {
 				free_trace(trace);
@@ -226,16 +306,69 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 			if (verbose > 1)
 				printf("efficiency, ");
 			mm_stats[i].util = eval_mm_util(trace, i);
+			if (mm->calloc_stats != NULL)
+				mm->calloc_stats(&mm_stats[i].calloc_cleared,
+						&mm_stats[i].calloc_skipped);
+			mm_stats[i].heap_hwm = mem_heap_hwm();
+			mm_stats[i].heap_end = mem_heapsize() + mem_mapped();
+			mm_stats[i].resident = mem_resident();
+			mm_stats[i].huge = mem_huge();
 			speed_params->trace = trace;
 			speed_params->ranges = ranges;
 			if (verbose > 1)
 				printf("and performance.\n");
 			mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+			if (perfctr_flag)
+				perfctr(eval_mm_speed, speed_params, &mm_stats[i].ctr);
 		}
 		free_trace(trace);
 	}
 }
 
+/*
+ * run_variants - run the tests on every allocator variant in turn and
+ *     print one line for each
+ */
+static void run_variants(int num_tracefiles, const char *tracedir,
+		char **tracefiles, range_t *ranges, speed_t *speed_params)
+{
+	int v, nerrors[mm_num_variants];
+	double util[mm_num_variants], thru[mm_num_variants], perf[mm_num_variants];
+	double p1, p2;
+	stats_t *stats;
+
+	if ((stats = calloc(num_tracefiles, sizeof(stats_t))) == NULL)
+		unix_error("stats calloc in run_variants failed");
+	for (v = 0; v < mm_num_variants; v++) {
+		mm = &mm_variants[v];
+		memset(stats, 0, num_tracefiles * sizeof(stats_t));
+		errors = 0;
+		if (verbose > 1)
+			printf("\nTesting %s (%s)\n", mm->name, mm->policy);
+		run_tests(num_tracefiles, tracedir, tracefiles, stats,
+				ranges, speed_params);
+		if (verbose > 1) {
+			printresults(num_tracefiles, stats);
+			printf("\n");
+		}
+		nerrors[v] = errors;
+		perf[v] = errors == 0 ? perf_index(num_tracefiles, stats, &util[v],
+				&thru[v], &p1, &p2) : 0;
+	}
+	free(stats);
+
+	printf("\nResults for the allocator variants:\n");
+	printf("  %-16s %5s %8s %5s  %s\n", "variant", "util", "Kops", "perf", "policy");
+	for (v = 0; v < mm_num_variants; v++) {
+		if (nerrors[v] == 0)
+			printf("  %-16s %4.0f%% %8.0f %5.0f  %s\n", mm_variants[v].name,
+					util[v]*100.0, thru[v]/1e3, perf[v], mm_variants[v].policy);
+		else
+			printf("  %-16s %5s %8s %5s  %s (%d errors)\n", mm_variants[v].name,
+					"-", "-", "-", mm_variants[v].policy, nerrors[v]);
+	}
+}
+
 /**************
  * Main routine
  **************/
@@ -253,10 +386,10 @@ int main(int argc, char **argv)
 
 	int run_libc = 0;     /* If set, run libc malloc (set by -l) */
 	int autograder = 0;   /* if set then called by autograder (-A) */
+	long heap_mb;         /* heap size in MB (set by -H) */
 
 	/* temporaries used to compute the performance index */
-	double secs, ops, util, avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
-	double weight = 0;
+	double avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
 	int numcorrect;
 
 
@@ -266,7 +399,7 @@ int main(int argc, char **argv)
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+	while ((c = getopt(argc, argv, "d:f:c:s:t:v:S:T:P:m:H:B:C:hMVAlDFpz")) != EOF) {
 		switch (c) {
 
 			case 'A': /* Hidden Autolab driver argument */
@@ -324,6 +457,87 @@ int main(int argc, char **argv)
 				set_timeout = atoi(optarg);
 				break;
 
+			case 'F':
+				footprint_flag = 1;
+				break;
+
+			case 'z':
+				sized_free = 1;
+				break;
+
+			case 'p':
+				perfctr_flag = 1;
+				break;
+
+			case 'S':
+				stats_interval = atoi(optarg);
+				if (stats_interval <= 0) {
+					usage();
+					exit(1);
+				}
+				break;
+
+			case 'T':
+				replay_threads = atoi(optarg);
+				if (replay_threads < 1 || replay_threads > MAX_REPLAY_THREADS) {
+					usage();
+					exit(1);
+				}
+				break;
+
+			case 'C': /* Stream traces in chunks of this many requests */
+				stream_chunk = atol(optarg);
+				if (stream_chunk <= 0 || stream_chunk > INT_MAX) {
+					usage();
+					exit(1);
+				}
+				break;
+
+			case 'P': /* <percent>[:<consumer thread>] */
+				replay_remote = atoi(optarg);
+				if (strchr(optarg, ':') != NULL)
+					replay_consumer = atoi(strchr(optarg, ':') + 1);
+				if (replay_remote < 0 || replay_remote > 100) {
+					usage();
+					exit(1);
+				}
+				break;
+
+			case 'm': /* Test one allocator variant instead of mm.c */
+				for (i = 0; i < mm_num_variants; i++)
+					if (strcmp(optarg, mm_variants[i].name) == 0)
+						break;
+				if (i == mm_num_variants) {
+					printf("No allocator variant %s; there are:\n", optarg);
+					for (i = 0; i < mm_num_variants; i++)
+						printf("  %-16s %s\n", mm_variants[i].name, mm_variants[i].policy);
+					exit(1);
+				}
+				mm = &mm_variants[i];
+				break;
+
+			case 'M': /* Test every allocator variant */
+				all_variants = 1;
+				break;
+
+			case 'H': /* Heap size in MB */
+				heap_mb = atol(optarg);
+				if (heap_mb <= 0 || ((size_t)heap_mb << 20) > MAX_HEAP_LIMIT)
+					app_error("-H: the heap must be 1 to %zu MB\n", MAX_HEAP_LIMIT >> 20);
+				mem_set_max_heap((size_t)heap_mb << 20);
+				break;
+
+			case 'B': /* What backs the heap */
+				if (strcmp(optarg, "base") == 0)
+					mem_set_backing(MEM_BACKING_BASE);
+				else if (strcmp(optarg, "thp") == 0)
+					mem_set_backing(MEM_BACKING_THP);
+				else if (strcmp(optarg, "hugetlb") == 0)
+					mem_set_backing(MEM_BACKING_HUGETLB);
+				else
+					app_error("-B: the heap is backed by base, thp or hugetlb pages\n");
+				break;
+
 			case 'h': /* Print this message */
 				usage();
 				exit(0);
@@ -346,6 +560,10 @@ int main(int argc, char **argv)
 
 	/* Initialize the timing package */
 	init_fsecs();
+	if (perfctr_flag && init_perfctr() == 0) {
+		printf("No hardware counters (see perf_event_paranoid), timing with the cycle counter only.\n");
+		perfctr_flag = 0;
+	}
 
 	/* Initialize the timeout */
 	if (set_timeout) {
@@ -353,6 +571,22 @@ int main(int argc, char **argv)
 		signal(SIGALRM, timeout_handler);
 	}
 
+	/* -M compares the variants instead of evaluating just one */
+	if (all_variants) {
+		mem_init();
+		run_variants(num_tracefiles, tracedir, tracefiles, ranges, &speed_params);
+		mem_deinit();
+		exit(0);
+	}
+
+	/* -T replaces the usual evaluation with one multithreaded replay */
+	if (replay_threads > 0) {
+		mem_init();
+		run_replay(num_tracefiles, tracedir, tracefiles);
+		mem_deinit();
+		exit(0);
+	}
+
 	/*
 	 * Optionally run and evaluate the libc malloc package
 	 */
@@ -377,6 +611,8 @@ int main(int argc, char **argv)
 				if (verbose > 1)
 					printf("and performance.\n");
 				libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+				if (perfctr_flag)
+					perfctr(eval_libc_speed, &speed_params, &libc_stats[i].ctr);
 			}
 			free_trace(trace);
 		}
@@ -402,8 +638,12 @@ int main(int argc, char **argv)
 	/* Initialize the simulated memory system in memlib.c */
 	mem_init();
 
+	if (stats_interval > 0)
+		open_stats();
 	run_tests(num_tracefiles, tracedir, tracefiles, mm_stats,
 			ranges, &speed_params);
+	if (stats_file != NULL)
+		fclose(stats_file);
 
 
 	/* Display the mm results in a compact table */
@@ -419,56 +659,25 @@ int main(int argc, char **argv)
 			printf("\nResults for mm malloc:\n");
 			printresults(num_tracefiles, mm_stats);
 			printf("\n");
+			if (mm->realloc_stats != NULL)
+				printrealloc(num_tracefiles, mm_stats);
+			if (mm->calloc_stats != NULL)
+				printcalloc(num_tracefiles, mm_stats);
+			if (footprint_flag)
+				printfootprint(num_tracefiles, mm_stats);
 		}
 	}
 
 	/*
-	 * Accumulate the aggregate statistics for the student's mm package
+	 * Compute and print the performance index
 	 */
-	secs = 0;
-	ops = 0;
-	util = 0;
 	numcorrect = 0;
-	for (i=0; i < num_tracefiles; i++) {
-		secs += mm_stats[i].secs * mm_stats[i].weight;
-		ops += mm_stats[i].ops * mm_stats[i].weight;
-		util += mm_stats[i].util * mm_stats[i].weight;
-		weight += mm_stats[i].weight;
+	for (i=0; i < num_tracefiles; i++)
 		if (mm_stats[i].valid)
 			numcorrect++;
-	}
-	if(weight == 0)
-		avg_mm_util = 0;
-	else
-		avg_mm_util = util/weight;
-
-	/*
-	 * Compute and print the performance index
-	 */
 	if (errors == 0) {
-		if(weight == 0) {
-			avg_mm_throughput = 0;
-		}
-		else {
-			avg_mm_throughput = (secs == 0) ? 0 : ops/secs;
-		}
-		if (avg_mm_util < MIN_SPACE) {
-			p1 = 0.0;
-		} else if (avg_mm_util > MAX_SPACE) {
-			p1 = UTIL_WEIGHT;
-		} else {
-			p1 = (avg_mm_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE) * UTIL_WEIGHT;
-		}
-
-		if (avg_mm_throughput < MIN_SPEED) {
-			p2 = 0.0;
-		} else if (avg_mm_throughput > MAX_SPEED) {
-			p2 = 1.0 - UTIL_WEIGHT;
-		} else {
-			p2 = (avg_mm_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) * (1.0 - UTIL_WEIGHT);
-		}
-
-		perfindex = (p1 + p2)*100.0;
+		perfindex = perf_index(num_tracefiles, mm_stats, &avg_mm_util,
+				&avg_mm_throughput, &p1, &p2);
 		printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
 				p1*100,
 				p2*100,
@@ -476,6 +685,7 @@ int main(int argc, char **argv)
 
 	}
 	else { /* There were errors */
+		avg_mm_util = 0;
 		perfindex = 0.0;
 		printf("Terminated with %d errors\n", errors);
 	}
@@ -522,11 +732,13 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must lie within the extent of the heap */
-	if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-			(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+	/* The payload must lie within the extent of the heap, or in memory
+	   mapped with mem_mmap */
+	if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+			(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+			!mem_is_mapped(lo, hi)) {
 		malloc_error(trace, opnum,
-				"Payload (%p:%p) lies outside heap (%p:%p)",
+				"Payload (%p:%p) lies outside heap (%p:%p) and mapped memory",
 				lo, hi, mem_heap_lo(), mem_heap_hi());
 		return 0;
 	}
@@ -664,103 +876,470 @@ static void check_index(const trace_t *trace, int opnum, int index) {
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * Requests come from an opreader, which decodes a binary trace (see
+ * tracebin.h) straight from a mapping of the file and parses anything
+ * else as a text .rep file.
  */
-static trace_t *read_trace(stats_t *stats, const char *tracedir,
-		const char *filename)
+typedef struct {
+	const char *filename;
+	FILE *file;
+	void *map;                  /* the binary trace, or NULL */
+	size_t map_size;
+	tracebin_reader_t bin;
+	tracebin_header_t header;
+	long pos;                   /* requests read so far */
+	size_t size;                /* the last size read, which a text line
+	                               without one repeats */
+} opreader_t;
+
+/* opreader_start - read the header, and from there the requests again */
+static void opreader_start(opreader_t *r)
+{
+	tracebin_header_t *h = &r->header;
+
+	if (r->map != NULL) {
+		if (tracebin_read_header(&r->bin, r->map, r->map_size, h) < 0)
+			app_error("%s: bad binary trace header\n", r->filename);
+	} else {
+		rewind(r->file);
+		if (fscanf(r->file, "%d %ld %ld %d", &h->weight, &h->num_ids,
+					&h->num_ops, &h->ignore_ranges) != 4 ||
+				h->num_ids < 0 || h->num_ops < 0)
+			app_error("%s: bad trace header\n", r->filename);
+	}
+	if (h->weight != 0 && h->weight != 1)
+		app_error("%s: weight can only be zero or one", r->filename);
+	if (h->ignore_ranges != 0 && h->ignore_ranges != 1)
+		app_error("%s: ignore-ranges can only be zero or one", r->filename);
+	r->pos = 0;
+	r->size = 0;
+}
+
+static void opreader_open(opreader_t *r, const char *filename)
+{
+	struct stat st;
+
+	r->filename = filename;
+	if ((r->file = fopen(filename, "r")) == NULL)
+		unix_error("Could not open %s in read_trace", filename);
+	r->map = NULL;
+	if (fstat(fileno(r->file), &st) == 0 && st.st_size >= TRACEBIN_MAGIC_LEN) {
+		r->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(r->file), 0);
+		r->map_size = st.st_size;
+		if (r->map == MAP_FAILED || !tracebin_is_binary(r->map, st.st_size)) {
+			if (r->map != MAP_FAILED)
+				munmap(r->map, st.st_size);
+			r->map = NULL;
+		}
+	}
+	opreader_start(r);
+}
+
+/*
+ * opreader_next - read the next request into op, all but its index, and
+ *     return the block id it names
+ */
+static long opreader_next(opreader_t *r, traceop_t *op)
 {
-	FILE *tracefile;
-	trace_t *trace;
 	char type[MAXLINE];
-	int index, size;
-	int max_index = 0;
-	int op_index;
+	long index;
+	size_t align = 0;
+
+	if (r->pos == r->header.num_ops)
+		app_error("%s: reading past the last request\n", r->filename);
+	if (r->map != NULL) {
+		if (tracebin_read_op(&r->bin, type, &index, &r->size, &align) < 0)
+			app_error("%s: truncated binary trace\n", r->filename);
+	} else {
+		if (fscanf(r->file, "%s", type) != 1)
+			app_error("%s: ends after %ld of %ld requests\n", r->filename,
+					r->pos, r->header.num_ops);
+		switch (type[0]) {
+			case 'a':
+			case 'c':
+			case 'r':
+				fscanf(r->file, "%ld %zu", &index, &r->size);
+				break;
+			case 'm':
+				fscanf(r->file, "%ld %zu %zu", &index, &r->size, &align);
+				if (align == 0 || (align & (align - 1)) != 0)
+					app_error("%s: alignment %zu is not a power of two",
+							r->filename, align);
+				break;
+			case 'f':
+				fscanf(r->file, "%ld", &index);
+				break;
+			default:
+				app_error("Bogus type character (%c) in tracefile %s\n",
+						type[0], r->filename);
+		}
+	}
+	op->type = type[0] == 'r' ? REALLOC : type[0] == 'f' ? FREE : ALLOC;
+	op->size = type[0] == 'f' ? 0 : r->size;
+	op->align = align;
+	op->zeroed = type[0] == 'c';
+	r->pos++;
+	return index;
+}
 
-	if (verbose > 1)
-		printf("Reading tracefile: %s\n", filename);
+static void opreader_close(opreader_t *r)
+{
+	if (r->map != NULL)
+		munmap(r->map, r->map_size);
+	fclose(r->file);
+}
 
-	/* Allocate the trace record */
-	if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-		unix_error("malloc 1 failed in read_trace");
+/*
+ * A streamed trace (-C) is read a chunk of requests at a time by a reader
+ * thread, into one buffer while the driver replays the other. The reader
+ * gives every live block a slot, taking the slot of a freed block when it
+ * can, so that the block tables grow with the most blocks live at once
+ * rather than with the number of ids.
+ */
+struct stream {
+	opreader_t reader;
+	int chunk;                  /* requests per buffer */
+	traceop_t *buf[2];
+	int len[2];                 /* requests in each buffer ... */
+	int slots[2];               /* ... and the slots used up to its end */
+	int full[2];                /* buffer is the driver's to replay */
+	int cur;                    /* the buffer the driver replays */
+	int stop;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* owned by the reader thread: live ids to slots, by open addressing
+	   with -1 marking an empty entry, and the freed slots */
+	long *ids;
+	int *slot;
+	size_t mask;
+	size_t count;
+	int *free_slots;
+	int num_free;
+	int num_slots;
+};
 
-	/* Read the trace file header */
-	strcpy(trace->filename, tracedir);
-	strcat(trace->filename, filename);
-	if ((tracefile = fopen(trace->filename, "r")) == NULL) {
-		unix_error("Could not open %s in read_trace", trace->filename);
+static size_t hash_id(long id)
+{
+	return (uint64_t)id * 0x9e3779b97f4a7c15ULL >> 20;
+}
+
+static void idmap_init(stream_t *s, size_t entries)
+{
+	if ((s->ids = malloc(entries * sizeof(long))) == NULL ||
+			(s->slot = malloc(entries * sizeof(int))) == NULL)
+		unix_error("malloc failed in idmap_init");
+	memset(s->ids, -1, entries * sizeof(long));
+	s->mask = entries - 1;
+	s->count = 0;
+}
+
+static size_t idmap_find(const stream_t *s, long id)
+{
+	size_t i = hash_id(id) & s->mask;
+
+	while (s->ids[i] != -1 && s->ids[i] != id)
+		i = (i + 1) & s->mask;
+	return i;
+}
+
+static void idmap_put(stream_t *s, long id, int slot)
+{
+	size_t i;
+
+	if (s->count * 2 >= s->mask) {
+		long *ids = s->ids;
+		int *slots = s->slot;
+		size_t n = s->mask + 1;
+
+		idmap_init(s, n * 2);
+		for (i = 0; i < n; i++)
+			if (ids[i] != -1)
+				idmap_put(s, ids[i], slots[i]);
+		free(ids);
+		free(slots);
+	}
+	i = idmap_find(s, id);
+	s->ids[i] = id;
+	s->slot[i] = slot;
+	s->count++;
+}
+
+/* idmap_remove - empty entry i, shifting back the entries that probed past it */
+static void idmap_remove(stream_t *s, size_t i)
+{
+	size_t j, home;
+
+	s->count--;
+	for (j = (i + 1) & s->mask; s->ids[j] != -1; j = (j + 1) & s->mask) {
+		home = hash_id(s->ids[j]) & s->mask;
+		/* the entry at j may move to i unless its home is in (i, j] */
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			s->ids[i] = s->ids[j];
+			s->slot[i] = s->slot[j];
+			i = j;
+		}
 	}
-	fscanf(tracefile, "%d", &trace->weight);
-	fscanf(tracefile, "%d", &trace->num_ids);
-	fscanf(tracefile, "%d", &trace->num_ops);
-	fscanf(tracefile, "%d", &trace->ignore_ranges);
+	s->ids[i] = -1;
+}
 
-	if(trace->weight != 0 && trace->weight != 1) {
-		app_error("%s: weight can only be zero or one", trace->filename);
+/*
+ * stream_slot - the slot of the block a request names. An id the reader
+ *     has not seen is a new block, which a free leaves as free(NULL) and a
+ *     realloc, as realloc(NULL, size), gets in a slot never used before.
+ */
+static int stream_slot(stream_t *s, const traceop_t *op, long id)
+{
+	size_t i;
+	int slot;
+
+	if (id < 0)
+		return -1;
+	i = idmap_find(s, id);
+	if (s->ids[i] == id) {
+		slot = s->slot[i];
+		if (op->type == FREE) {
+			idmap_remove(s, i);
+			s->free_slots[s->num_free++] = slot;
+		}
+		return slot;
 	}
-	if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
-		app_error("%s: ignore-ranges can only be zero or one", trace->filename);
+	if (op->type == FREE)
+		return -1;
+	if (op->type == ALLOC && s->num_free > 0) {
+		slot = s->free_slots[--s->num_free];
+	} else {
+		if (s->num_slots == INT_MAX)
+			app_error("%s: more than INT_MAX blocks live\n", s->reader.filename);
+		slot = s->num_slots++;
+		/* one entry for each slot that may be freed */
+		if ((slot & (slot - 1)) == 0 && (s->free_slots =
+					realloc(s->free_slots, (slot ? slot * 2 : 1) * sizeof(int))) == NULL)
+			unix_error("realloc failed in stream_slot");
 	}
+	idmap_put(s, id, slot);
+	return slot;
+}
 
-	/* We'll store each request line in the trace in this array */
-	if ((trace->ops =
-				(traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-		unix_error("malloc 2 failed in read_trace");
+/*
+ * stream_fill - read the next chunk into buffer b, and let the kernel drop
+ *     the pages of a binary trace it is done with
+ */
+static void stream_fill(stream_t *s, int b)
+{
+	opreader_t *r = &s->reader;
+	traceop_t *op;
+	int n = 0;
+	uintptr_t done;
+
+	while (n < s->chunk && r->pos < r->header.num_ops) {
+		op = &s->buf[b][n++];
+		op->index = stream_slot(s, op, opreader_next(r, op));
+	}
+	s->len[b] = n;
+	s->slots[b] = s->num_slots;
+	if (r->map != NULL) {
+		done = ((uintptr_t)r->bin.p - (uintptr_t)r->map) & ~(uintptr_t)(getpagesize() - 1);
+		if (done > 0)
+			madvise(r->map, done, MADV_DONTNEED);
+	}
+}
 
-	/* We'll keep an array of pointers to the allocated blocks here... */
-	if ((trace->blocks =
-				(char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
-		unix_error("malloc 3 failed in read_trace");
+static void *stream_thread(void *vargp)
+{
+	stream_t *s = vargp;
+	int b = 0, stop;
+
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		while (s->full[b] && !s->stop)
+			pthread_cond_wait(&s->cond, &s->lock);
+		stop = s->stop;
+		pthread_mutex_unlock(&s->lock);
+		if (stop)
+			break;
+		stream_fill(s, b);
+		pthread_mutex_lock(&s->lock);
+		s->full[b] = 1;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+		if (s->reader.pos == s->reader.header.num_ops)
+			break;
+		b ^= 1;
+	}
+	return NULL;
+}
 
-	/* ... along with the corresponding byte sizes of each block */
-	if ((trace->block_sizes =
-				(size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
-		unix_error("malloc 4 failed in read_trace");
+/* grow_blocks - make room in the block tables for n blocks */
+static void grow_blocks(trace_t *trace, int n)
+{
+	int old = trace->num_blocks;
+
+	if (n <= old)
+		return;
+	if (n < 2 * old)
+		n = 2 * old;
+	if ((trace->blocks = realloc(trace->blocks, n * sizeof(char *))) == NULL ||
+			(trace->block_sizes = realloc(trace->block_sizes, n * sizeof(size_t))) == NULL ||
+			(trace->block_rand_base = realloc(trace->block_rand_base,
+					n * sizeof(*trace->block_rand_base))) == NULL)
+		unix_error("realloc failed in grow_blocks");
+	memset(trace->blocks + old, 0, (n - old) * sizeof(char *));
+	memset(trace->block_sizes + old, 0, (n - old) * sizeof(size_t));
+	trace->num_blocks = n;
+}
 
-	/* and, if we're debugging, the offset into the random data */
-	if ((trace->block_rand_base =
-				calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
-		unix_error("malloc 5 failed in read_trace");
+/* stream_take - wait for the buffer the driver replays next */
+static void stream_take(trace_t *trace)
+{
+	stream_t *s = trace->stream;
+
+	pthread_mutex_lock(&s->lock);
+	while (!s->full[s->cur])
+		pthread_cond_wait(&s->cond, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+	trace->ops = s->buf[s->cur];
+	trace->num_ops = s->len[s->cur];
+	grow_blocks(trace, s->slots[s->cur]);
+}
 
+/* stream_start - start reading the trace from its first request */
+static void stream_start(trace_t *trace)
+{
+	stream_t *s = trace->stream;
+
+	opreader_start(&s->reader);
+	memset(s->ids, -1, (s->mask + 1) * sizeof(long));
+	s->count = 0;
+	s->num_free = 0;
+	s->num_slots = 0;
+	s->full[0] = s->full[1] = 0;
+	s->cur = 0;
+	s->stop = 0;
+	if (pthread_create(&s->tid, NULL, stream_thread, s) != 0)
+		unix_error("pthread_create failed in stream_start");
+	trace->op_base = 0;
+	stream_take(trace);
+}
 
-	/* read every request line in the trace file */
-	index = 0;
-	op_index = 0;
-	while (fscanf(tracefile, "%s", type) != EOF) {
-		switch(type[0]) {
-			case 'a':
-				fscanf(tracefile, "%u %u", &index, &size);
-				trace->ops[op_index].type = ALLOC;
-				trace->ops[op_index].index = index;
-				trace->ops[op_index].size = size;
-				max_index = (index > max_index) ? index : max_index;
-				break;
-			case 'r':
-				fscanf(tracefile, "%u %u", &index, &size);
-				trace->ops[op_index].type = REALLOC;
-				trace->ops[op_index].index = index;
-				trace->ops[op_index].size = size;
-				max_index = (index > max_index) ? index : max_index;
-				break;
-			case 'f':
-				fscanf(tracefile, "%ud", &index);
-				trace->ops[op_index].type = FREE;
-				trace->ops[op_index].index = index;
-				break;
-			default:
-				app_error("Bogus type character (%c) in tracefile %s\n",
-						type[0], trace->filename);
+static void stream_stop(stream_t *s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->tid, NULL);
+}
+
+/*
+ * next_chunk - hand the buffer the driver is done with back to the reader
+ *     and move on to the other one; returns 0 at the end of the trace
+ */
+static int next_chunk(trace_t *trace)
+{
+	stream_t *s = trace->stream;
+
+	if (trace->op_base + trace->num_ops == trace->total_ops)
+		return 0;
+	pthread_mutex_lock(&s->lock);
+	s->full[s->cur] = 0;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	s->cur ^= 1;
+	trace->op_base += trace->num_ops;
+	stream_take(trace);
+	return 1;
+}
+
+/*
+ * more_ops - is there a request i in the trace? When a streamed trace is
+ *     done with its chunk, it moves on to the next one and i to 0.
+ */
+static int more_ops(trace_t *trace, int *i)
+{
+	if (*i < trace->num_ops)
+		return 1;
+	if (trace->stream == NULL || !next_chunk(trace))
+		return 0;
+	*i = 0;
+	return 1;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory, or with -C start
+ *     streaming it
+ */
+static trace_t *read_trace(stats_t *stats, const char *tracedir,
+		const char *filename)
+{
+	trace_t *trace;
+	opreader_t reader;
+	stream_t *s;
+	long index, max_index = 0;
+	int op_index;
+
+	if (verbose > 1)
+		printf("Reading tracefile: %s\n", filename);
+
+	/* Allocate the trace record */
+	if ((trace = (trace_t *) calloc(1, sizeof(trace_t))) == NULL)
+		unix_error("malloc 1 failed in read_trace");
+
+	/* Read the trace file header */
+	strcpy(trace->filename, tracedir);
+	strcat(trace->filename, filename);
+	opreader_open(&reader, trace->filename);
+	trace->weight = reader.header.weight;
+	trace->num_ids = reader.header.num_ids;
+	trace->total_ops = reader.header.num_ops;
+	trace->ignore_ranges = reader.header.ignore_ranges;
+
+	if (stream_chunk > 0) {
+		if ((s = calloc(1, sizeof(stream_t))) == NULL)
+			unix_error("malloc 2 failed in read_trace");
+		s->reader = reader;
+		s->chunk = stream_chunk < trace->total_ops ? stream_chunk : trace->total_ops;
+		if ((s->buf[0] = malloc((s->chunk + 1) * sizeof(traceop_t))) == NULL ||
+				(s->buf[1] = malloc((s->chunk + 1) * sizeof(traceop_t))) == NULL)
+			unix_error("malloc 3 failed in read_trace");
+		idmap_init(s, 1024);
+		pthread_mutex_init(&s->lock, NULL);
+		pthread_cond_init(&s->cond, NULL);
+		trace->stream = s;
+		stream_start(trace);
+	} else {
+		if (trace->total_ops > INT_MAX || trace->num_ids > INT_MAX)
+			app_error("%s: %ld requests on %ld ids are too many to load; "
+					"stream the trace with -C\n", trace->filename,
+					trace->total_ops, trace->num_ids);
+		trace->num_ops = trace->total_ops;
+
+		/* We'll store each request line in the trace in this array */
+		if ((trace->ops =
+					(traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+			unix_error("malloc 2 failed in read_trace");
+
+		/* We'll keep an array of pointers to the allocated blocks, along
+		   with their byte sizes and, if we're debugging, the offset into
+		   the random data */
+		grow_blocks(trace, trace->num_ids);
+
+		/* read every request in the trace file */
+		for (op_index = 0; op_index < trace->num_ops; op_index++) {
+			index = opreader_next(&reader, &trace->ops[op_index]);
+			if (index > max_index && trace->ops[op_index].type != FREE)
+				max_index = index;
+			trace->ops[op_index].index = index;
 		}
-		op_index++;
-		if(op_index == trace->num_ops) break;
+		opreader_close(&reader);
+		assert(max_index == trace->num_ids - 1);
 	}
-	fclose(tracefile);
-	assert(max_index == trace->num_ids - 1);
-	assert(trace->num_ops == op_index);
 
 	/* fill in the stats */
 	strcpy(stats->filename, trace->filename);
 	stats->weight = trace->weight;
-	stats->ops = trace->num_ops;
+	stats->ops = trace->total_ops;
 
 	return trace;
 }
@@ -770,18 +1349,38 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
  */
 static void reinit_trace(trace_t *trace)
 {
-	memset(trace->blocks, 0, trace->num_ids * sizeof(*trace->blocks));
-	memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
+	/* a streamed trace still at its first chunk need not be read again */
+	if (trace->stream != NULL && trace->op_base > 0) {
+		stream_stop(trace->stream);
+		stream_start(trace);
+	}
+	memset(trace->blocks, 0, trace->num_blocks * sizeof(*trace->blocks));
+	memset(trace->block_sizes, 0, trace->num_blocks * sizeof(*trace->block_sizes));
 	/* block_rand_base is unused if size is zero */
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
- *              to, all of which were allocated in read_trace().
+ * free_trace - Free the trace record and the arrays it points to, all of
+ *              which were allocated in read_trace(), and stop its stream
  */
 static void free_trace(trace_t *trace)
 {
-	free(trace->ops);         /* free the three arrays... */
+	stream_t *s = trace->stream;
+
+	if (s != NULL) {
+		stream_stop(s);
+		opreader_close(&s->reader);
+		free(s->buf[0]);
+		free(s->buf[1]);
+		free(s->ids);
+		free(s->slot);
+		free(s->free_slots);
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+		free(s);
+	} else {
+		free(trace->ops);
+	}
 	free(trace->blocks);
 	free(trace->block_sizes);
 	free(trace->block_rand_base);
@@ -793,12 +1392,79 @@ static void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * mm_alloc, libc_alloc - make the allocation of an ALLOC request, with
+ *     memalign if it asks for an alignment and calloc if it is zeroed
+ */
+static void *mm_alloc(const traceop_t *op)
+{
+	if (op->zeroed)
+		return mm->calloc(1, op->size);
+	if (op->align == 0)
+		return mm->malloc(op->size);
+	return mm->memalign(op->align, op->size);
+}
+
+static void *libc_alloc(const traceop_t *op)
+{
+	void *p;
+
+	if (op->zeroed)
+		return calloc(1, op->size);
+	if (op->align == 0)
+		return malloc(op->size);
+	if (posix_memalign(&p, op->align < sizeof(void *) ? sizeof(void *) : op->align,
+				op->size) != 0)
+		return NULL;
+	return p;
+}
+
+/*
+ * free_run - the number of FREE requests from op i on that are done at
+ *     once: with -z the run of frees in a row, otherwise one
+ */
+static int free_run(const trace_t *trace, int i)
+{
+	int n = 1;
+
+	if (sized_free)
+		while (n < FREE_BATCH_MAX && i + n < trace->num_ops &&
+				trace->ops[i + n].type == FREE)
+			n++;
+	return n;
+}
+
+/*
+ * mm_free_ops - do the n FREE requests from op i: with -z, a lone one
+ *     with mm_free_sized and a run with mm_free_batch, or with mm_free if
+ *     the package lacks them
+ */
+static void mm_free_ops(const trace_t *trace, int i, int n)
+{
+	void *batch[FREE_BATCH_MAX];
+	int j, index;
+
+	for (j = 0; j < n; j++) {
+		index = trace->ops[i + j].index;
+		batch[j] = index < 0 ? NULL : trace->blocks[index];
+	}
+	if (n == 1 && sized_free && mm->free_sized != NULL) {
+		index = trace->ops[i].index;
+		mm->free_sized(batch[0], index < 0 ? 0 : trace->block_sizes[index]);
+	} else if (n > 1 && mm->free_batch != NULL) {
+		mm->free_batch(batch, n);
+	} else {
+		for (j = 0; j < n; j++)
+			mm->free(batch[j]);
+	}
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
-	int i;
+	int i, j, n;
 	int index;
 	size_t size;
 	char *newp;
@@ -811,13 +1477,13 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 	reinit_trace(trace);
 
 	/* Call the mm package's init function */
-	if (mm_init() < 0) {
+	if (mm->init() < 0) {
 		malloc_error(trace, 0, "mm_init failed.");
 		return 0;
 	}
 
 	/* Interpret each operation in the trace in order */
-	for (i = 0;  i < trace->num_ops;  i++) {
+	for (i = 0;  more_ops(trace, &i);  i++) {
 		index = trace->ops[i].index;
 		size = trace->ops[i].size;
 
@@ -825,7 +1491,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 			range_t *r;
 			
 			/* Let the students check their own heap */
-			mm_checkheap(verbose);
+			mm->checkheap(verbose);
 
 			/* Now check that all our allocated blocks have the right data */
 			r = *ranges;
@@ -839,11 +1505,31 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 
 			case ALLOC: /* mm_malloc */
 
-				/* Call the student's malloc */
-				if ((p = mm_malloc(size)) == NULL) {
+				/* Call the student's malloc, or memalign if the request
+				   asks for an alignment */
+				if (trace->ops[i].align != 0 && mm->memalign == NULL) {
+					malloc_error(trace, i, "%s has no mm_memalign.", mm->name);
+					return 0;
+				}
+				if ((p = mm_alloc(&trace->ops[i])) == NULL) {
 					malloc_error(trace, i, "mm_malloc failed.");
 					return 0;
 				}
+				if (trace->ops[i].align != 0 &&
+						(uintptr_t)p % trace->ops[i].align != 0) {
+					malloc_error(trace, i, "Payload address (%p) not aligned to %zu bytes",
+							p, trace->ops[i].align);
+					return 0;
+				}
+				if (trace->ops[i].zeroed) {
+					for (newp = p; newp < p + size && *newp == 0; newp++)
+						;
+					if (newp < p + size) {
+						malloc_error(trace, i, "mm_calloc left byte %td of the block (%p) nonzero",
+								newp - p, p);
+						return 0;
+					}
+				}
 
 				/*
 				 * Test the range of the new block for correctness and add it
@@ -866,7 +1552,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 
 				/* Call the student's realloc */
 				oldp = trace->blocks[index];
-				newp = mm_realloc(oldp, size);
+				newp = mm->realloc(oldp, size);
 				if( (newp == NULL) && (size != 0) ) {
 					malloc_error(trace, i, "mm_realloc failed.");
 					return 0;
@@ -902,16 +1588,17 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 				break;
 
 			case FREE: /* mm_free */
-				check_index(trace, i, index);
-
-				/* Remove region from list and call student's free function */
-				if(index == -1) {
-					p = 0;
-				} else {
-					p = trace->blocks[index];
-					remove_range(ranges, p);
+				/* Remove the regions from the list and call student's free
+				   function, on a run of frees at once with -z */
+				n = free_run(trace, i);
+				for (j = i; j < i + n; j++) {
+					index = trace->ops[j].index;
+					check_index(trace, j, index);
+					if (index != -1)
+						remove_range(ranges, trace->blocks[index]);
 				}
-				mm_free(p);
+				mm_free_ops(trace, i, n);
+				i += n - 1;
 				break;
 
 			default:
@@ -929,16 +1616,16 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   high water mark of the heap in bytes while running the student's
+ *   malloc package on the trace, plus the most memory it had mapped
+ *   with mem_mmap at once. mem_sbrk() can decrement the brk pointer,
+ *   so this is not necessarily the heap size at the end.
  *
  *   A higher number is better: 1 is optimal.
  */
 static double eval_mm_util(trace_t *trace, int tracenum)
 {
-	int i;
+	int i, j, n;
 	int index;
 	int size, newsize, oldsize;
 	int max_total_size = 0;
@@ -948,19 +1635,21 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
 	reinit_trace(trace);
 
-	/* initialize the heap and the mm malloc package */
+	/* initialize the heap and the mm malloc package, and start the
+	   resident page count for the footprint report from zero */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	mem_discard();
+	if (mm->init() < 0)
 		app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
 
-	for (i = 0;  i < trace->num_ops;  i++) {
+	for (i = 0;  more_ops(trace, &i);  i++) {
 		switch (trace->ops[i].type) {
 
 			case ALLOC: /* mm_alloc */
 				index = trace->ops[i].index;
 				size = trace->ops[i].size;
 
-				if ((p = mm_malloc(size)) == NULL) {
+				if ((p = mm_alloc(&trace->ops[i])) == NULL) {
 					app_error("trace %d: mm_malloc failed in eval_mm_util",
 							tracenum);
 				}
@@ -978,7 +1667,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 				oldsize = trace->block_sizes[index];
 
 				oldp = trace->blocks[index];
-				if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
+				if ((newp = mm->realloc(oldp,newsize)) == NULL && newsize != 0) {
 					app_error("trace %d: mm_realloc failed in eval_mm_util",
 							tracenum);
 				}
@@ -991,18 +1680,14 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 				break;
 
 			case FREE: /* mm_free */
-				index = trace->ops[i].index;
-				if(index < 0) {
-					size = 0;
-					p = 0;
-				} else {
-					size = trace->block_sizes[index];
-					p = trace->blocks[index];
+				n = free_run(trace, i);
+				mm_free_ops(trace, i, n);
+				for (j = i; j < i + n; j++) {
+					index = trace->ops[j].index;
+					if (index >= 0)
+						total_size -= trace->block_sizes[index];
 				}
-
-				mm_free(p);
-
-				total_size -= size;
+				i += n - 1;
 				break;
 
 			default:
@@ -1013,11 +1698,16 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 		/* update the high-water mark */
 		max_total_size = (total_size > max_total_size) ?
 			total_size : max_total_size;
+
+		if (stats_file != NULL &&
+				((trace->op_base + i + 1) % stats_interval == 0 ||
+				 trace->op_base + i + 1 == trace->total_ops))
+			sample_stats(trace, trace->op_base + i + 1);
 	}
 
 	printf(".");
 
-	return ((double)max_total_size / (double)mem_heapsize());
+	return ((double)max_total_size / (double)mem_heap_hwm());
 }
 
 
@@ -1027,45 +1717,43 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
-	char *p, *newp, *oldp, *block;
+	int i, n, index, size, newsize;
+	char *p, *newp, *oldp;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 	reinit_trace(trace);
 
 	/* Reset the heap and initialize the mm package */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	if (mm->init() < 0)
 		app_error("mm_init failed in eval_mm_speed");
 
 	/* Interpret each trace request */
-	for (i = 0;  i < trace->num_ops;  i++)
+	for (i = 0;  more_ops(trace, &i);  i++)
 		switch (trace->ops[i].type) {
 
 			case ALLOC: /* mm_malloc */
 				index = trace->ops[i].index;
 				size = trace->ops[i].size;
-				if ((p = mm_malloc(size)) == NULL)
+				if ((p = mm_alloc(&trace->ops[i])) == NULL)
 					app_error("mm_malloc error in eval_mm_speed");
 				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
 				break;
 
 			case REALLOC: /* mm_realloc */
 				index = trace->ops[i].index;
 				newsize = trace->ops[i].size;
 				oldp = trace->blocks[index];
-				if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+				if ((newp = mm->realloc(oldp,newsize)) == NULL && newsize != 0)
 					app_error("mm_realloc error in eval_mm_speed");
 				trace->blocks[index] = newp;
+				trace->block_sizes[index] = newsize;
 				break;
 
 			case FREE: /* mm_free */
-				index = trace->ops[i].index;
-				if(index < 0) {
-					block = 0;
-				} else {
-					block = trace->blocks[index];
-				}
-				mm_free(block);
+				n = free_run(trace, i);
+				mm_free_ops(trace, i, n);
+				i += n - 1;
 				break;
 
 			default:
@@ -1073,6 +1761,281 @@ static void eval_mm_speed(void *ptr)
 		}
 }
 
+/*
+ * Multithreaded replay (-T). Each thread replays its own list of requests
+ * against the shared mm package: a slice of one trace, made of the blocks
+ * whose id is the thread's number modulo the number of threads, or whole
+ * traces when there are several. These are handed out round robin, and a
+ * thread with more than one replays them in turn, freeing the blocks each
+ * leaves live before the next; when there are fewer traces than threads,
+ * some are replayed by more than one thread. A free chosen for hand-off is not done by
+ * the thread that replays it; the block goes to the consumer thread's
+ * mailbox instead, which it empties every few requests and at the end.
+ */
+typedef struct handoff {
+	struct handoff *next;
+	void *p;
+} handoff_t;
+
+typedef struct {
+	char *trace;                /* names of the traces it replays */
+	traceop_t *ops;             /* its requests ... */
+	unsigned char *remote;      /* ... and which frees it hands off */
+	int num_ops;
+	int consumer;               /* thread that takes its hand-offs */
+	char **blocks;              /* payloads by block id */
+	handoff_t *nodes;           /* one per hand-off it makes */
+	_Atomic(handoff_t *) mailbox;   /* blocks handed to this thread */
+	uint32_t *lat;              /* ns per mm call */
+	long nlat;
+	long calls;                 /* mm calls, including frees handed to it */
+} replay_t;
+
+static replay_t replay[MAX_REPLAY_THREADS];
+static pthread_barrier_t replay_start, replay_done;
+
+static uint64_t replay_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* deterministic choice of the frees that are handed off */
+static int replay_is_remote(int thread, int opnum)
+{
+	uint64_t h = (thread + 1) * 0x9e3779b97f4a7c15ULL ^ (opnum + 1) * 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 31;
+	return (int)((h * 0x94d049bb133111ebULL) >> 32) % 100 < replay_remote;
+}
+
+static void replay_drain(replay_t *rt)
+{
+	handoff_t *node = atomic_exchange_explicit(&rt->mailbox, NULL, memory_order_acquire);
+
+	for (; node != NULL; node = node->next) {
+		uint64_t t0 = replay_ns();
+		mm->free(node->p);
+		rt->lat[rt->nlat++] = replay_ns() - t0;
+	}
+}
+
+static void *replay_thread(void *vargp)
+{
+	replay_t *rt = vargp;
+	handoff_t *node = rt->nodes;
+	int i, index;
+	char *p;
+
+	pthread_barrier_wait(&replay_start);
+	for (i = 0; i < rt->num_ops; i++) {
+		traceop_t *op = &rt->ops[i];
+		uint64_t t0;
+
+		if ((i & 15) == 0)
+			replay_drain(rt);
+		index = op->index;
+		if (rt->remote[i]) {
+			_Atomic(handoff_t *) *box = &replay[rt->consumer].mailbox;
+			node->p = rt->blocks[index];
+			node->next = atomic_load_explicit(box, memory_order_relaxed);
+			while (!atomic_compare_exchange_weak_explicit(box, &node->next, node,
+						memory_order_release, memory_order_relaxed))
+				;
+			node++;
+			continue;
+		}
+
+		t0 = replay_ns();
+		switch (op->type) {
+			case ALLOC:
+				if ((p = mm_alloc(op)) == NULL)
+					app_error("mm_malloc error in replay_thread");
+				rt->blocks[index] = p;
+				break;
+			case REALLOC:
+				if ((p = mm->realloc(rt->blocks[index], op->size)) == NULL && op->size != 0)
+					app_error("mm_realloc error in replay_thread");
+				rt->blocks[index] = p;
+				break;
+			case FREE:
+				mm->free(index < 0 ? NULL : rt->blocks[index]);
+				break;
+		}
+		rt->lat[rt->nlat++] = replay_ns() - t0;
+	}
+
+	/* every thread is done handing off, so the mailbox fills no more */
+	pthread_barrier_wait(&replay_done);
+	replay_drain(rt);
+	return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void run_replay(int num_tracefiles, const char *tracedir,
+		char **tracefiles)
+{
+	int n = replay_threads;
+	trace_t **traces;
+	stats_t stats;
+	pthread_t tid[MAX_REPLAY_THREADS];
+	long handed[MAX_REPLAY_THREADS] = { 0 };
+	long calls = 0;
+	uint64_t start, elapsed;
+	int t, i;
+
+	if (mm != mm_variants)
+		app_error("-T replays mm.c only, not the -m variants\n");
+	if (mm_thread_safe == NULL)
+		app_error("-T needs a thread-safe mm package, e.g. make MMFLAGS=-DMM_CONCURRENT\n");
+	if (replay_consumer >= n)
+		app_error("-P: there is no thread %d\n", replay_consumer);
+	if (stream_chunk > 0)
+		app_error("-T loads the traces whole, it cannot stream them with -C\n");
+	if ((traces = malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+		unix_error("malloc failed in run_replay");
+	for (i = 0; i < num_tracefiles; i++)
+		traces[i] = read_trace(&stats, tracedir, tracefiles[i]);
+
+	/* give every thread its requests and pick the frees it hands off */
+	for (t = 0; t < n; t++) {
+		replay_t *rt = &replay[t];
+		int first = t % num_tracefiles, step = n;
+		long num_ops = 0, num_ids = 0, names = 0;
+		int k, base;
+
+		/* traces t, t + n, t + 2n, ..., or trace t % num_tracefiles */
+		if (num_tracefiles <= n)
+			step = num_tracefiles;
+		for (k = first; k < num_tracefiles; k += step) {
+			num_ops += traces[k]->num_ops + traces[k]->num_ids;
+			num_ids += traces[k]->num_ids;
+			names += strlen(traces[k]->filename) + 1;
+		}
+		if (num_ops > INT_MAX || num_ids > INT_MAX)
+			app_error("-T: thread %d has too many requests to replay\n", t);
+		rt->consumer = replay_consumer >= 0 ? replay_consumer : (t + 1) % n;
+		if ((rt->ops = malloc(num_ops * sizeof(traceop_t))) == NULL ||
+				(rt->remote = calloc(num_ops, 1)) == NULL ||
+				(rt->blocks = calloc(num_ids, sizeof(char *))) == NULL ||
+				(rt->trace = malloc(names)) == NULL)
+			unix_error("malloc failed in run_replay");
+		rt->num_ops = 0;
+		rt->trace[0] = '\0';
+		for (k = first, base = 0; k < num_tracefiles; k += step) {
+			trace_t *trace = traces[k];
+			char *live = NULL;
+
+			if (rt->trace[0] != '\0')
+				strcat(rt->trace, " ");
+			strcat(rt->trace, trace->filename);
+			if (k + step < num_tracefiles &&
+					(live = calloc(trace->num_ids, 1)) == NULL)
+				unix_error("malloc failed in run_replay");
+			for (i = 0; i < trace->num_ops + (live ? trace->num_ids : 0); i++) {
+				traceop_t *op = &trace->ops[i], end = { .type = FREE, .index = i - trace->num_ops };
+
+				/* then free what is still live, before the next trace */
+				if (i >= trace->num_ops) {
+					if (!live[end.index])
+						continue;
+					op = &end;
+				}
+				/* free(NULL) has no block id, it goes to slice 0 */
+				int owner = op->index < 0 ? 0 : op->index % n;
+				if (num_tracefiles == 1 && owner != t)
+					continue;
+				if (live && op->index >= 0)
+					live[op->index] = op->type != FREE;
+				rt->remote[rt->num_ops] = op->type == FREE && op->index >= 0 &&
+					rt->consumer != t && replay_is_remote(t, rt->num_ops);
+				handed[rt->consumer] += rt->remote[rt->num_ops];
+				rt->ops[rt->num_ops] = *op;
+				/* the ids of each trace get their own blocks */
+				if (op->index >= 0)
+					rt->ops[rt->num_ops].index += base;
+				rt->num_ops++;
+			}
+			free(live);
+			base += trace->num_ids;
+		}
+	}
+	for (t = 0; t < n; t++) {
+		replay_t *rt = &replay[t];
+		long nremote = 0;
+
+		for (i = 0; i < rt->num_ops; i++)
+			nremote += rt->remote[i];
+		if ((rt->nodes = malloc((nremote + 1) * sizeof(handoff_t))) == NULL ||
+				(rt->lat = malloc((rt->num_ops + handed[t] + 1) * sizeof(uint32_t))) == NULL)
+			unix_error("malloc failed in run_replay");
+		rt->nlat = 0;
+		atomic_init(&rt->mailbox, NULL);
+	}
+
+	mem_reset_brk();
+	mem_discard();
+	if (mm->init() < 0)
+		app_error("mm_init failed in run_replay");
+	pthread_barrier_init(&replay_start, NULL, n + 1);
+	pthread_barrier_init(&replay_done, NULL, n);
+	for (t = 0; t < n; t++)
+		pthread_create(&tid[t], NULL, replay_thread, &replay[t]);
+	pthread_barrier_wait(&replay_start);
+	start = replay_ns();
+	for (t = 0; t < n; t++)
+		pthread_join(tid[t], NULL);
+	elapsed = replay_ns() - start;
+	pthread_barrier_destroy(&replay_start);
+	pthread_barrier_destroy(&replay_done);
+
+	printf("\nReplay on %d thread%s, %d%% of the frees handed to ", n,
+			n == 1 ? "" : "s", replay_remote);
+	if (replay_consumer >= 0)
+		printf("thread %d:\n", replay_consumer);
+	else
+		printf("the next thread:\n");
+	printf("%6s%10s%9s%9s%9s%9s%11s  %s\n", "thread", "calls",
+			"p50 ns", "p90", "p99", "p99.9", "max", "trace");
+	for (t = 0; t < n; t++) {
+		replay_t *rt = &replay[t];
+		uint32_t *lat = rt->lat;
+		long m = rt->nlat;
+
+		qsort(lat, m, sizeof(uint32_t), cmp_u32);
+		printf("%6d%10ld", t, m);
+		if (m > 0)
+			printf("%9u%9u%9u%9u%11u", lat[m / 2], lat[m * 90 / 100],
+					lat[m * 99 / 100], lat[m * 999 / 1000], lat[m - 1]);
+		else
+			printf("%9s%9s%9s%9s%11s", "-", "-", "-", "-", "-");
+		printf("  %s\n", rt->trace);
+		calls += m;
+	}
+	printf("Aggregate: %ld calls in %.3f ms, %.0f Kops/s\n", calls,
+			elapsed / 1e6, calls / (elapsed / 1e9) / 1e3);
+	printf("Heap footprint (KB): peak %zu, end %zu, resident %zu\n",
+			mem_heap_hwm() / 1024, (mem_heapsize() + mem_mapped()) / 1024,
+			mem_resident() / 1024);
+
+	for (t = 0; t < n; t++) {
+		free(replay[t].trace);
+		free(replay[t].ops);
+		free(replay[t].remote);
+		free(replay[t].blocks);
+		free(replay[t].nodes);
+		free(replay[t].lat);
+	}
+	for (i = 0; i < num_tracefiles; i++)
+		free_trace(traces[i]);
+	free(traces);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1086,11 +2049,11 @@ static int eval_libc_valid(trace_t *trace)
 
 	reinit_trace(trace);
 
-	for (i = 0;  i < trace->num_ops;  i++) {
+	for (i = 0;  more_ops(trace, &i);  i++) {
 		switch (trace->ops[i].type) {
 
 			case ALLOC: /* malloc */
-				if ((p = malloc(trace->ops[i].size)) == NULL) {
+				if ((p = libc_alloc(&trace->ops[i])) == NULL) {
 					malloc_error(trace, i, "libc malloc failed");
 					unix_error("System message");
 				}
@@ -1131,18 +2094,17 @@ static int eval_libc_valid(trace_t *trace)
 static void eval_libc_speed(void *ptr)
 {
 	int i;
-	int index, size, newsize;
+	int index, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 
 	reinit_trace(trace);
 
-	for (i = 0;  i < trace->num_ops;  i++) {
+	for (i = 0;  more_ops(trace, &i);  i++) {
 		switch (trace->ops[i].type) {
 			case ALLOC: /* malloc */
 				index = trace->ops[i].index;
-				size = trace->ops[i].size;
-				if ((p = malloc(size)) == NULL)
+				if ((p = libc_alloc(&trace->ops[i])) == NULL)
 					unix_error("malloc failed in eval_libc_speed");
 				trace->blocks[index] = p;
 				break;
@@ -1175,6 +2137,44 @@ static void eval_libc_speed(void *ptr)
  ************************************/
 
 
+/*
+ * perf_index - returns the performance index of a run out of 100, and
+ *     the weighted average utilization and throughput it is made of
+ */
+static double perf_index(int n, stats_t *stats, double *avg_util,
+		double *avg_throughput, double *p1, double *p2)
+{
+	double secs = 0, ops = 0, util = 0, weight = 0;
+	int i;
+
+	for (i=0; i < n; i++) {
+		secs += stats[i].secs * stats[i].weight;
+		ops += stats[i].ops * stats[i].weight;
+		util += stats[i].util * stats[i].weight;
+		weight += stats[i].weight;
+	}
+	*avg_util = (weight == 0) ? 0 : util/weight;
+	*avg_throughput = (weight == 0 || secs == 0) ? 0 : ops/secs;
+
+	if (*avg_util < MIN_SPACE) {
+		*p1 = 0.0;
+	} else if (*avg_util > MAX_SPACE) {
+		*p1 = UTIL_WEIGHT;
+	} else {
+		*p1 = (*avg_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE) * UTIL_WEIGHT;
+	}
+
+	if (*avg_throughput < MIN_SPEED) {
+		*p2 = 0.0;
+	} else if (*avg_throughput > MAX_SPEED) {
+		*p2 = 1.0 - UTIL_WEIGHT;
+	} else {
+		*p2 = (*avg_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) * (1.0 - UTIL_WEIGHT);
+	}
+
+	return (*p1 + *p2)*100.0;
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -1235,6 +2235,171 @@ static void printresults(int n, stats_t *stats)
 				"-");
 	}
 
+	if (perfctr_flag)
+		printcounters(n, stats);
+}
+
+/*
+ * printcounters - prints the IPC and the cache, TLB and branch misses per
+ *     request that perf_event_open counted during one run of each trace
+ */
+static void printcounters(int n, stats_t *stats)
+{
+	int i, e;
+	const perfctr_t *ctr;
+
+	printf("\n  %6s", "IPC");
+	for (e = PERFCTR_L1D_MISSES; e < PERFCTR_NEVENTS; e++)
+		printf("%8s", perfctr_name(e));
+	printf("  %s\n", "misses per op, trace");
+	for (i=0; i < n; i++) {
+		ctr = &stats[i].ctr;
+		if (!stats[i].valid)
+			continue;
+		if (ctr->valid[PERFCTR_CYCLES] && ctr->valid[PERFCTR_INSTRUCTIONS] &&
+				ctr->count[PERFCTR_CYCLES] > 0)
+			printf("  %6.2f", ctr->count[PERFCTR_INSTRUCTIONS] /
+					ctr->count[PERFCTR_CYCLES]);
+		else
+			printf("  %6s", "-");
+		for (e = PERFCTR_L1D_MISSES; e < PERFCTR_NEVENTS; e++) {
+			if (ctr->valid[e])
+				printf("%8.3f", ctr->count[e] / stats[i].ops);
+			else
+				printf("%8s", "-");
+		}
+		printf("  %s\n", stats[i].filename);
+	}
+}
+
+/*
+ * printrealloc - for the traces that call realloc, prints how many payload
+ *     bytes the mm package copied and how many it avoided copying
+ */
+static void printrealloc(int n, stats_t *stats)
+{
+	int i;
+	double total;
+
+	for (i=0; i < n; i++)
+		if (stats[i].realloc_copied + stats[i].realloc_avoided > 0)
+			break;
+	if (i == n)
+		return;
+
+	printf("Realloc copies for mm malloc:\n");
+	printf("  %12s%12s%9s  %s\n", "copied", "avoided", "avoided", "trace");
+	for (i=0; i < n; i++) {
+		total = (double)stats[i].realloc_copied + stats[i].realloc_avoided;
+		if (!stats[i].valid || total == 0)
+			continue;
+		printf("  %12zu%12zu%8.0f%%  %s\n",
+				stats[i].realloc_copied,
+				stats[i].realloc_avoided,
+				stats[i].realloc_avoided / total * 100.0,
+				stats[i].filename);
+	}
+	printf("\n");
+}
+
+/*
+ * printcalloc - for the traces that call calloc, prints how many bytes the
+ *     mm package cleared and how many it knew read as zeros already
+ */
+static void printcalloc(int n, stats_t *stats)
+{
+	int i;
+	double total;
+
+	for (i=0; i < n; i++)
+		if (stats[i].calloc_cleared + stats[i].calloc_skipped > 0)
+			break;
+	if (i == n)
+		return;
+
+	printf("Calloc clears for mm malloc:\n");
+	printf("  %12s%12s%9s  %s\n", "cleared", "skipped", "skipped", "trace");
+	for (i=0; i < n; i++) {
+		total = (double)stats[i].calloc_cleared + stats[i].calloc_skipped;
+		if (!stats[i].valid || total == 0)
+			continue;
+		printf("  %12zu%12zu%8.0f%%  %s\n",
+				stats[i].calloc_cleared,
+				stats[i].calloc_skipped,
+				stats[i].calloc_skipped / total * 100.0,
+				stats[i].filename);
+	}
+	printf("\n");
+}
+
+/*
+ * printfootprint - prints, in KB, the largest heap of each trace, the heap
+ *     left when the trace is done, and how much of that is still resident,
+ *     and in huge pages if the heap may have them
+ */
+static void printfootprint(int n, stats_t *stats)
+{
+	int i;
+	int huge = mem_backing() != MEM_BACKING_BASE;
+
+	printf("Heap footprint for mm malloc (KB):\n");
+	printf("  %10s%10s%10s", "peak", "end", "resident");
+	if (huge)
+		printf("%10s", "huge");
+	printf("  %s\n", "trace");
+	for (i=0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		printf("  %10zu%10zu%10zu",
+				stats[i].heap_hwm / 1024,
+				stats[i].heap_end / 1024,
+				stats[i].resident / 1024);
+		if (huge)
+			printf("%10zu", stats[i].huge / 1024);
+		printf("  %s\n", stats[i].filename);
+	}
+	printf("\n");
+}
+
+/*
+ * open_stats - create STATS_FILE and write its header
+ */
+static void open_stats(void)
+{
+	int i;
+
+	if (mm->stats == NULL)
+		app_error("-S: the mm package does not provide mm_stats\n");
+	if ((stats_file = fopen(STATS_FILE, "w")) == NULL)
+		unix_error("open_stats: could not open %s", STATS_FILE);
+	fprintf(stats_file, "trace,op,heap,mapped,allocated,free,largest_free,"
+			"fragmentation,splits,coalesces,extends,trims");
+	for (i = 0; i < MM_STATS_NCLASS; i++)
+		fprintf(stats_file, ",count%d", i);
+	for (i = 0; i < MM_STATS_NCLASS; i++)
+		fprintf(stats_file, ",bytes%d", i);
+	fprintf(stats_file, "\n");
+}
+
+/*
+ * sample_stats - append one row of mm_stats, taken after opnum ops of
+ *     the trace, to STATS_FILE
+ */
+static void sample_stats(const trace_t *trace, long opnum)
+{
+	mm_stats_t s;
+	int i;
+
+	mm->stats(&s);
+	fprintf(stats_file, "%s,%ld,%zu,%zu,%zu,%zu,%zu,%.4f,%zu,%zu,%zu,%zu",
+			trace->filename, opnum, s.heap_size, s.mapped, s.allocated,
+			s.free_bytes, s.largest_free, s.fragmentation,
+			s.splits, s.coalesces, s.extends, s.trims);
+	for (i = 0; i < MM_STATS_NCLASS; i++)
+		fprintf(stats_file, ",%zu", s.class_count[i]);
+	for (i = 0; i < MM_STATS_NCLASS; i++)
+		fprintf(stats_file, ",%zu", s.class_bytes[i]);
+	fprintf(stats_file, "\n");
 }
 
 /*
@@ -1270,7 +2435,8 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
 
 	errors++;
 
-	printf("ERROR [trace %s, line %d]: ", trace->filename, LINENUM(opnum));
+	printf("ERROR [trace %s, line %ld]: ", trace->filename,
+			LINENUM(trace->op_base + opnum));
 	vprintf(fmt, ap);
 	putchar('\n');
 
@@ -1282,7 +2448,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+	fprintf(stderr, "Usage: mdriver [-hlVdDFM] [-m <name>] [-H <MB>] [-B <pages>] [-S <n>] [-C <n>] [-T <n> [-P <p>[:t]]] [-f <file>]\n");
 	fprintf(stderr, "Options\n");
 	fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
 	fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1293,5 +2459,17 @@ static void usage(void)
 	fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
 	fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
 	fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
+	fprintf(stderr, "\t-F         Print the peak and final heap footprint.\n");
+	fprintf(stderr, "\t-H <MB>    Heap size in MB (default %d).\n", MAX_HEAP >> 20);
+	fprintf(stderr, "\t-B <pages> Back the heap with base (default), thp or hugetlb pages.\n");
+	fprintf(stderr, "\t-p         Also count hardware events (IPC, misses per op).\n");
+	fprintf(stderr, "\t-z         Free with mm_free_sized, and frees in a row with mm_free_batch.\n");
+	fprintf(stderr, "\t-S <n>     Write mm_stats every n ops to %s.\n", STATS_FILE);
+	fprintf(stderr, "\t-C <n>     Stream each trace n requests at a time instead of loading it.\n");
+	fprintf(stderr, "\t-T <n>     Replay on n threads: n slices of one trace, or the traces\n");
+	fprintf(stderr, "\t           round robin. Needs a thread-safe package.\n");
+	fprintf(stderr, "\t-P <p>[:t] With -T, hand p%% of the frees to the next thread, or to thread t.\n");
+	fprintf(stderr, "\t-m <name>  Test the allocator variant <name> instead of mm.c.\n");
+	fprintf(stderr, "\t-M         Test every allocator variant and compare them.\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
 }
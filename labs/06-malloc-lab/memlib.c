@@ -3,6 +3,7 @@
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE				/* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -11,61 +12,441 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
 /* private variables */
 static char *heap;
-static char *mem_brk;
 static char *mem_max_addr;
+static size_t mem_max_heap = MAX_HEAP;	/* bytes reserved for the heap */
+
+/*
+ * The heap can be backed by 2 MB pages, see mem_set_backing. Both huge
+ * backings start the heap on a 2 MB boundary of a larger reservation. With
+ * MEM_BACKING_HUGETLB the reservation is inaccessible, and each 2 MB the
+ * breaks reach is mapped from the hugetlb pool when first needed, since a
+ * hugetlb mapping takes its pages from the pool when it is made; a chunk the
+ * pool cannot supply gets base pages instead.
+ */
+static int mem_backing_kind = MEM_BACKING_BASE;
+static char *heap_map;			/* the reservation, and its length */
+static size_t heap_map_len;
+static unsigned char *huge_chunk;	/* hugetlb: one CHUNK_* per 2 MB */
+static pthread_mutex_t huge_lock = PTHREAD_MUTEX_INITIALIZER;
+static int huge_fallback;		/* chunks the pool could not supply */
+enum { CHUNK_UNMAPPED, CHUNK_HUGE, CHUNK_BASE };
+
+/*
+ * The heap can be split into equal regions with their own break, so that
+ * independent allocator arenas each grow a contiguous heap. Each region's
+ * break must only be moved by one thread at a time.
+ */
+static char *mem_brk[MEM_MAX_REGIONS];
+static char *mem_hwm[MEM_MAX_REGIONS];	/* highest break since the last reset */
+static char *mem_dirty[MEM_MAX_REGIONS];	/* ... since the pages were last released */
+static int mem_nregions = 1;
+static size_t mem_region_bytes = MAX_HEAP;
+
+/*
+ * Large blocks can also be mapped on their own, outside the heap. They come
+ * from a separate area of MAX_MMAP bytes, handed out in whole pages; a map
+ * with one byte per page records which pages are in use.
+ */
+static char *mmap_area;
+static unsigned char *mmap_used;
+static size_t mmap_npages;
+static size_t mmap_hi;			/* pages past this one have never been used */
+static size_t mmap_bytes;		/* bytes mapped now */
+static size_t mmap_hwm;			/* most bytes mapped at once since the last reset */
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
-			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
-			dev_zero,				/* fd */
-			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
-	mem_brk = heap;					/* heap is empty initially */
+	size_t huge_bytes = (mem_max_heap + MEM_HUGE_PAGE - 1) & ~(MEM_HUGE_PAGE - 1);
+
+	/* mapped at a suggested start, and only touched pages take memory */
+	if (mem_backing_kind == MEM_BACKING_BASE) {
+		heap_map_len = mem_max_heap;
+		heap_map = mmap((void *)0x800000000, heap_map_len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		heap = heap_map;
+	} else {
+		heap_map_len = huge_bytes + MEM_HUGE_PAGE;
+		heap_map = mmap((void *)0x800000000, heap_map_len,
+				mem_backing_kind == MEM_BACKING_THP ? PROT_READ | PROT_WRITE : PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		heap = (char *)(((uintptr_t)heap_map + MEM_HUGE_PAGE - 1) & ~(MEM_HUGE_PAGE - 1));
+	}
+	if (heap_map == MAP_FAILED) {
+		fprintf(stderr, "ERROR: mem_init failed to reserve %zu bytes\n", heap_map_len);
+		exit(1);
+	}
+	if (mem_backing_kind == MEM_BACKING_THP &&
+			madvise(heap, huge_bytes, MADV_HUGEPAGE) < 0)
+		fprintf(stderr, "mem_init: no transparent huge pages, using base pages\n");
+	if (mem_backing_kind == MEM_BACKING_HUGETLB) {
+		huge_chunk = calloc(huge_bytes / MEM_HUGE_PAGE, 1);
+		huge_fallback = 0;
+	}
+	mem_max_addr = heap + mem_max_heap;
+	mmap_area = mmap(NULL, MAX_MMAP, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	mmap_npages = MAX_MMAP / mem_pagesize();
+	mmap_used = calloc(mmap_npages, 1);
+	mem_nregions = 1;				/* the heap reads as zeros ... */
+	mem_region_bytes = mem_max_heap;
+	mem_dirty[0] = heap;
+	mem_set_regions(1);				/* ... and is empty initially */
+}
+
+/*
+ * mem_set_backing - back the heap with base pages, transparent huge pages
+ *		or hugetlb pages, one of MEM_BACKING_*; call it before mem_init
+ */
+void mem_set_backing(int backing) {
+	assert(heap == NULL && backing >= MEM_BACKING_BASE && backing <= MEM_BACKING_HUGETLB);
+	mem_backing_kind = backing;
+}
+
+/*
+ * mem_backing - returns what backs the heap, one of MEM_BACKING_*
+ */
+int mem_backing(void) {
+	return mem_backing_kind;
+}
+
+/* hugetlb: map the 2 MB chunks of the heap that [lo, hi) touches */
+static void huge_commit(char *lo, char *hi) {
+	size_t first = (lo - heap) / MEM_HUGE_PAGE;
+	size_t last = (hi - heap + MEM_HUGE_PAGE - 1) / MEM_HUGE_PAGE;
+
+	pthread_mutex_lock(&huge_lock);
+	for (size_t i = first; i < last; i++) {
+		char *chunk = heap + i * MEM_HUGE_PAGE;
+		if (huge_chunk[i] != CHUNK_UNMAPPED)
+			continue;
+		huge_chunk[i] = CHUNK_HUGE;
+		if (mmap(chunk, MEM_HUGE_PAGE, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_FIXED, -1, 0) == MAP_FAILED) {
+			if (huge_fallback++ == 0)
+				fprintf(stderr, "mem_sbrk: the hugetlb pool is empty, "
+						"using base pages (see /proc/sys/vm/nr_hugepages)\n");
+			/* a failed MAP_FIXED may have unmapped the chunk already */
+			mmap(chunk, MEM_HUGE_PAGE, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+			huge_chunk[i] = CHUNK_BASE;
+		}
+	}
+	pthread_mutex_unlock(&huge_lock);
+}
+
+/*
+ * mem_set_max_heap - set the bytes mem_init reserves for the heap, up to
+ *		MAX_HEAP_LIMIT; call it before mem_init
+ */
+void mem_set_max_heap(size_t bytes) {
+	assert(heap == NULL && bytes > 0 && bytes <= MAX_HEAP_LIMIT);
+	mem_max_heap = bytes & ~(mem_pagesize() - 1);
+	mem_region_bytes = mem_max_heap;
+}
+
+/*
+ * mem_max_heap_size - returns the bytes reserved for the heap
+ */
+size_t mem_max_heap_size(void) {
+	return mem_max_heap;
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	munmap(heap_map, heap_map_len);
+	heap = NULL;
+	free(huge_chunk);
+	huge_chunk = NULL;
+	munmap(mmap_area, MAX_MMAP);
+	free(mmap_used);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *		and unmap everything that was mapped with mem_mmap
  */
 void mem_reset_brk(){
-	mem_brk = heap;
+	for (int i = 0; i < mem_nregions; i++)
+		mem_brk[i] = mem_hwm[i] = heap + i * mem_region_bytes;
+	if (mmap_hi > 0) {
+		madvise(mmap_area, mmap_hi * mem_pagesize(), MADV_DONTNEED);
+		memset(mmap_used, 0, mmap_hi);
+	}
+	mmap_hi = mmap_bytes = mmap_hwm = 0;
+}
+
+/*
+ * mem_set_regions - split the heap into n equal, page-aligned regions and
+ *		make them all empty. Region 0 always starts at mem_heap_lo().
+ */
+void mem_set_regions(int n) {
+	char *old_dirty[MEM_MAX_REGIONS];
+	int old_n = mem_nregions;
+	size_t old_bytes = mem_region_bytes;
+
+	assert(n >= 1 && n <= MEM_MAX_REGIONS);
+	memcpy(old_dirty, mem_dirty, sizeof(old_dirty));
+	mem_nregions = n;
+	mem_region_bytes = (mem_max_heap / n) & ~(mem_pagesize() - 1);
+	mem_reset_brk();
+	/* a new region reads as zeros above what the old ones in it wrote */
+	for (int i = 0; i < n; i++) {
+		char *base = heap + i * mem_region_bytes;
+		mem_dirty[i] = base;
+		for (int j = 0; j < old_n; j++) {
+			char *old_base = heap + j * old_bytes;
+			if (old_dirty[j] > old_base && old_dirty[j] > base &&
+					old_base < base + mem_region_bytes && old_dirty[j] > mem_dirty[i])
+				mem_dirty[i] = old_dirty[j];
+		}
+	}
+}
+
+/*
+ * mem_region_size - bytes each region can grow to
+ */
+size_t mem_region_size(void) {
+	return mem_region_bytes;
 }
 
 /* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ * mem_region_sbrk - simple model of the sbrk function for one region.
+ *		Extends the region by incr bytes and returns the start address of
+ *		the new area. A negative incr shrinks the region and gives the
+ *		whole pages it drops back to the system.
  */
-void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
+void *mem_region_sbrk(int region, ptrdiff_t incr) {
+	char *old_brk = mem_brk[region];
+	char *base = heap + region * mem_region_bytes;
+	char *limit = base + mem_region_bytes;
 
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+	if (limit > mem_max_addr)
+		limit = mem_max_addr;
+	if ((old_brk + incr < base) || ((old_brk + incr) > limit)) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
-	mem_brk += incr;
+	if (mem_backing_kind == MEM_BACKING_HUGETLB && incr > 0)
+		huge_commit(old_brk, old_brk + incr);
+	mem_brk[region] += incr;
+	if (incr < 0) {
+		size_t pagesize = mem_pagesize();
+		char *lo = (char *)(((size_t)mem_brk[region] + pagesize - 1) & ~(pagesize - 1));
+		/* up to the old break, the region reads as zeros again */
+		if (lo < old_brk && mem_release(lo, old_brk - lo) && mem_dirty[region] <= old_brk)
+			mem_dirty[region] = lo;
+	}
+	if (mem_brk[region] > mem_hwm[region])
+		mem_hwm[region] = mem_brk[region];
+	if (mem_brk[region] > mem_dirty[region])
+		mem_dirty[region] = mem_brk[region];
 	return (void *)old_brk;
 }
 
+/*
+ * mem_region_zero - returns the address from which the region reads as
+ *		zeros up to its end: the break has not passed it since the region's
+ *		pages were last released
+ */
+void *mem_region_zero(int region) {
+	return (void *)mem_dirty[region];
+}
+
+/*
+ * mem_release - model of madvise(MADV_DONTNEED): the contents of the whole
+ *		pages in [addr, addr + len) are lost, and they stop counting as
+ *		resident until they are touched again. Hugetlb pages go only whole;
+ *		a transparent huge page is split. Returns whether all those pages
+ *		read as zeros now.
+ */
+int mem_release(void *addr, size_t len) {
+	size_t pagesize = mem_pagesize();
+	size_t lo = ((size_t)addr + pagesize - 1) & ~(pagesize - 1);
+	size_t hi = ((size_t)addr + len) & ~(pagesize - 1);
+
+	if (mem_backing_kind == MEM_BACKING_HUGETLB) {
+		int zeroed = 1;
+		/* chunk by chunk, those from the pool only whole */
+		for (size_t end; lo < hi; lo = end) {
+			size_t chunk = (lo - (size_t)heap) / MEM_HUGE_PAGE;
+			end = (size_t)heap + (chunk + 1) * MEM_HUGE_PAGE;
+			if (end > hi)
+				end = hi;
+			if (huge_chunk[chunk] != CHUNK_HUGE ||
+					(lo == (size_t)heap + chunk * MEM_HUGE_PAGE && end - lo == MEM_HUGE_PAGE))
+				madvise((void *)lo, end - lo, MADV_DONTNEED);
+			else
+				zeroed = 0;
+		}
+		return zeroed;
+	}
+	if (lo < hi)
+		madvise((void *)lo, hi - lo, MADV_DONTNEED);
+	return 1;
+}
+
+/*
+ * mem_discard - release every page of the heap, so that mem_resident
+ *		counts only what is touched from now on
+ */
+void mem_discard(void) {
+	madvise(heap, mem_backing_kind == MEM_BACKING_BASE ? mem_max_heap :
+			(mem_max_heap + MEM_HUGE_PAGE - 1) & ~(MEM_HUGE_PAGE - 1), MADV_DONTNEED);
+	for (int i = 0; i < mem_nregions; i++)
+		mem_dirty[i] = mem_brk[i];
+	madvise(mmap_area, MAX_MMAP, MADV_DONTNEED);
+}
+
+/* mark pages [first, first + n) of the mmap area used or unused */
+static void mmap_mark(size_t first, size_t n, int used) {
+	memset(mmap_used + first, used, n);
+	if (used && first + n > mmap_hi)
+		mmap_hi = first + n;
+	if (used)
+		mmap_bytes += n * mem_pagesize();
+	else
+		mmap_bytes -= n * mem_pagesize();
+	if (mmap_bytes > mmap_hwm)
+		mmap_hwm = mmap_bytes;
+}
+
+/* first run of n unused pages in the mmap area, mmap_npages if none */
+static size_t mmap_find(size_t n) {
+	size_t run = 0;
+
+	for (size_t i = 0; i < mmap_npages; i++) {
+		run = mmap_used[i] ? 0 : run + 1;
+		if (run == n)
+			return i + 1 - n;
+	}
+	return mmap_npages;
+}
+
+/*
+ * mem_mmap - model of an anonymous mmap: maps len bytes, rounded up to
+ *		whole pages, outside the heap and returns their zero-filled start
+ */
+void *mem_mmap(size_t len) {
+	size_t pagesize = mem_pagesize();
+	size_t n = (len + pagesize - 1) / pagesize;
+	size_t first = mmap_find(n);
+
+	if (n == 0 || first == mmap_npages) {
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_mmap failed. Ran out of memory...\n");
+		return (void *)-1;
+	}
+	mmap_mark(first, n, 1);
+	return mmap_area + first * pagesize;
+}
+
+/*
+ * mem_munmap - model of munmap for memory from mem_mmap: the whole pages
+ *		in [addr, addr + len) are given back and read as zeros when mapped again
+ */
+void mem_munmap(void *addr, size_t len) {
+	size_t pagesize = mem_pagesize();
+	size_t first = ((char *)addr - mmap_area) / pagesize;
+	size_t n = (len + pagesize - 1) / pagesize;
+
+	madvise(addr, n * pagesize, MADV_DONTNEED);
+	mmap_mark(first, n, 0);
+}
+
+/*
+ * mem_mremap - model of mremap(MREMAP_MAYMOVE) for memory from mem_mmap.
+ *		The mapping grows or shrinks in place when it can. Otherwise its pages
+ *		are moved to a free run with the real mremap, so nothing is copied,
+ *		or copied there when the real mremap cannot move them: a run that was
+ *		grown in place after an earlier move spans two kernel mappings.
+ *		Returns the new start, or (void *)-1 with the old mapping intact.
+ */
+void *mem_mremap(void *addr, size_t old_len, size_t new_len) {
+	size_t pagesize = mem_pagesize();
+	size_t first = ((char *)addr - mmap_area) / pagesize;
+	size_t old_n = (old_len + pagesize - 1) / pagesize;
+	size_t new_n = (new_len + pagesize - 1) / pagesize;
+	size_t i, to;
+
+	if (new_n <= old_n) {
+		if (new_n < old_n)
+			mem_munmap((char *)addr + new_n * pagesize, (old_n - new_n) * pagesize);
+		return addr;
+	}
+	for (i = first + old_n; i < first + new_n && i < mmap_npages; i++)
+		if (mmap_used[i])
+			break;
+	if (i == first + new_n) {
+		mmap_mark(first + old_n, new_n - old_n, 1);
+		return addr;
+	}
+
+	if ((to = mmap_find(new_n)) == mmap_npages) {
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_mremap failed. Ran out of memory...\n");
+		return (void *)-1;
+	}
+	/* the pages move, and their old place is filled with fresh ones */
+	if (mremap(addr, old_n * pagesize, new_n * pagesize, MREMAP_MAYMOVE | MREMAP_FIXED,
+				mmap_area + to * pagesize) != MAP_FAILED) {
+		if (mmap(addr, old_n * pagesize, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+			return (void *)-1;
+		mmap_mark(to, new_n, 1);
+		mmap_mark(first, old_n, 0);
+		return mmap_area + to * pagesize;
+	}
+	/* the free run reads as zeros, so only the old pages need copying */
+	memcpy(mmap_area + to * pagesize, addr, old_n * pagesize);
+	mmap_mark(to, new_n, 1);
+	mem_munmap(addr, old_n * pagesize);
+	return mmap_area + to * pagesize;
+}
+
+/*
+ * mem_is_mapped - whether every byte of [lo, hi] lies in pages that are
+ *		currently mapped with mem_mmap
+ */
+int mem_is_mapped(void *lo, void *hi) {
+	size_t pagesize = mem_pagesize();
+
+	if ((char *)lo < mmap_area || (char *)hi >= mmap_area + MAX_MMAP || lo > hi)
+		return 0;
+	for (size_t i = ((char *)lo - mmap_area) / pagesize;
+			i <= (size_t)((char *)hi - mmap_area) / pagesize; i++)
+		if (!mmap_used[i])
+			return 0;
+	return 1;
+}
+
+/*
+ * mem_mapped() - returns the bytes currently mapped with mem_mmap
+ */
+size_t mem_mapped() {
+	return mmap_bytes;
+}
+
+/* 
+ * mem_sbrk - extend the heap of region 0, the whole heap unless it
+ *		has been split with mem_set_regions
+ */
+void *mem_sbrk(int incr) {
+	return mem_region_sbrk(0, incr);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -74,17 +455,96 @@ void *mem_heap_lo(){
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte, in the highest
+ *		region that has grown
  */
 void *mem_heap_hi(){
-	return (void *)(mem_brk - 1);
+	char *hi = mem_brk[0];
+	for (int i = 1; i < mem_nregions; i++)
+		if (mem_brk[i] > heap + i * mem_region_bytes)
+			hi = mem_brk[i];
+	return (void *)(hi - 1);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, summed over regions
  */
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	size_t size = 0;
+	for (int i = 0; i < mem_nregions; i++)
+		size += mem_brk[i] - (heap + i * mem_region_bytes);
+	return size;
+}
+
+/*
+ * mem_heap_hwm() - returns the largest heap size since the last reset,
+ *		summed over regions, plus the most bytes mapped at once
+ */
+size_t mem_heap_hwm() {
+	size_t size = mmap_hwm;
+	for (int i = 0; i < mem_nregions; i++)
+		size += mem_hwm[i] - (heap + i * mem_region_bytes);
+	return size;
+}
+
+/* pages in [base, base + npages pages) that are resident, -1 on failure */
+static long count_resident(char *base, size_t npages) {
+	unsigned char *vec;
+	long resident = 0;
+
+	if (npages == 0)
+		return 0;
+	if ((vec = malloc(npages)) == NULL || mincore(base, npages * mem_pagesize(), vec) < 0) {
+		free(vec);
+		return -1;
+	}
+	for (size_t j = 0; j < npages; j++)
+		resident += vec[j] & 1;
+	free(vec);
+	return resident;
+}
+
+/*
+ * mem_resident() - returns the bytes of the heap and of mapped memory
+ *		that are backed by physical memory, as reported by mincore
+ */
+size_t mem_resident() {
+	size_t pagesize = mem_pagesize();
+	long resident, n;
+
+	if ((resident = count_resident(mmap_area, mmap_hi)) < 0)
+		return 0;
+	for (int i = 0; i < mem_nregions; i++) {
+		char *base = heap + i * mem_region_bytes;
+		if ((n = count_resident(base, (mem_hwm[i] - base + pagesize - 1) / pagesize)) < 0)
+			return 0;
+		resident += n;
+	}
+	return resident * pagesize;
+}
+
+/*
+ * mem_huge() - returns the bytes of the heap that are backed by huge pages,
+ *		transparent or hugetlb, as reported by /proc/self/smaps
+ */
+size_t mem_huge() {
+	FILE *f = fopen("/proc/self/smaps", "r");
+	char line[256];
+	unsigned long lo, hi;
+	size_t kb, huge = 0;
+	int in_heap = 0;
+
+	if (f == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+			in_heap = (char *)lo < heap + mem_max_heap && (char *)hi > heap;
+		else if (in_heap && (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 ||
+					sscanf(line, "Private_Hugetlb: %zu kB", &kb) == 1))
+			huge += kb << 10;
+	}
+	fclose(f);
+	return huge;
 }
 
 /*
@@ -1,11 +1,40 @@
+#include <stddef.h>
 #include <unistd.h>
 
+#define MEM_MAX_REGIONS 64
+
+/* What backs the heap, see mem_set_backing */
+enum {
+	MEM_BACKING_BASE,		/* base pages */
+	MEM_BACKING_THP,		/* transparent huge pages, madvise(MADV_HUGEPAGE) */
+	MEM_BACKING_HUGETLB,	/* MAP_HUGETLB pages from the reserved pool */
+};
+#define MEM_HUGE_PAGE ((size_t)2 << 20)
+
 void mem_init(void);               
 void mem_deinit(void);
+void mem_set_max_heap(size_t bytes);
+size_t mem_max_heap_size(void);
+void mem_set_backing(int backing);
+int mem_backing(void);
 void *mem_sbrk(int incr);
+void mem_set_regions(int n);
+size_t mem_region_size(void);
+void *mem_region_sbrk(int region, ptrdiff_t incr);
+void *mem_region_zero(int region);
+int mem_release(void *addr, size_t len);
+void mem_discard(void);
+void *mem_mmap(size_t len);
+void mem_munmap(void *addr, size_t len);
+void *mem_mremap(void *addr, size_t old_len, size_t new_len);
+int mem_is_mapped(void *lo, void *hi);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_mapped(void);
+size_t mem_heap_hwm(void);
+size_t mem_resident(void);
+size_t mem_huge(void);
 size_t mem_pagesize(void);
 
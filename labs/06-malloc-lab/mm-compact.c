@@ -0,0 +1,18 @@
+/*
+ * mm-compact.c
+ * the layout and policy of mm-final.c without its extras:
+ * 4-byte headers and footers, 32-bit offsets as list links
+ * segregated free lists (15 buckets), unordered with LIFO policy
+ * best of the first match and the next 10
+ * footers only on free blocks
+ *
+ * generated from mm-policy.c, see there for the policy constants
+ */
+#define MM_FREE_LIST 1
+#define MM_NBUCKETS 15
+#define MM_ORDER MM_ORDER_LIFO
+#define MM_FIT MM_FIT_GOOD
+#define MM_FIT_SCAN 10
+#define MM_FOOTERS 0
+#define MM_OFFSETS 1
+#include "mm-policy.c"
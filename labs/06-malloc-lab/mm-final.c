@@ -3,15 +3,62 @@
  * min_block_size=16
  * with optional boundary tag for allocated blocks
  * reduced-size header/footer
- * make the next/prev pointers to be the address offset (8 bytes -> 4 bytes)
+ * make the next/prev pointers to be the address offset (8 bytes -> 4 bytes),
+ * counted in 8-byte units so that 32 bits reach 32 GB of heap
  * padding with extra 4 bytes to make payload 8-byte-aligned
  * further find best from next 10 blocks after the first match is found
  * 
  * explicit list of free blocks
  * unordered with LIFO policy
  * segregated free list structure (15 buckets)
+ *
+ * optionally, free blocks of at least MM_TREE_THRESHOLD bytes are kept in a treap
+ * ordered by (size, address) instead, for an exact best fit among large
+ * blocks; the priority is a hash of the block's offset
+ *
+ * with -DMM_TLSF, two-level segregated fit (TLSF) instead:
+ * free lists indexed by (log2 size, next 4 bits of size), with a bitmap per
+ * level so find_fit locates a large enough non-empty list with two ctz;
+ * list heads live in the arena, links are 0-terminated offsets
+ *
+ * requests of up to SLAB_MAX_SIZE bytes are served from page-sized slabs,
+ * one list of slabs per 8-byte size class, once the class has enough live
+ * blocks on the heap; slab objects have no header, a bitmap at the start of the slab
+ * records which are in use, and a bitmap of heap pages tells free() whether
+ * a pointer lies in a slab; empty slabs go back to the heap as free blocks;
+ * -DMM_NO_SLAB turns this off
+ *
+ * memory goes back to the system when a large free block has stayed free
+ * for a while and ends the heap (the heap shrinks) or lies inside it (its
+ * pages are released, while its header, links and footer stay in place)
+ *
+ * memalign carves an aligned block out of a free block and puts the slack
+ * in front of it back on the free lists
+ *
+ * calloc clears only what it cannot tell reads as zeros: a free block whose
+ * footer has bit 2 set reads as zeros past its links, which holds for a block
+ * made of heap the break had not reached before and for a free block whose
+ * pages were all released; mapped blocks are fresh pages
+ *
+ * free_sized takes the size asked for the block and skips the checks it
+ * rules out; free_batch merges runs of neighbours in one pass, with the
+ * blocks of the batch marked in their headers, and puts each merged block
+ * on the lists once
+ *
+ * requests of at least MM_MMAP_THRESHOLD bytes bypass the heap: each gets
+ * its own mapping, whose header has bit 2 set so that free() unmaps it and
+ * realloc() resizes it with mremap; it holds the length in pages, heap
+ * block headers hold bytes, so heap blocks stay below 4 GB and are not
+ * coalesced past that
+ *
+ * with -DMM_CONCURRENT, thread safe:
+ * per-thread caches of small blocks (tcache) in front of MM_NARENAS arenas,
+ * each with its own lock, segregated lists and region of the heap;
+ * blocks freed by a thread of another arena go onto the owner's lock-free
+ * remote free list and are returned on its next locked operation
  */
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,9 +67,14 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#ifdef MM_CONCURRENT
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /* do not change the following! */
 #ifdef DRIVER
@@ -31,6 +83,11 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define free_sized mm_free_sized
+#define free_batch mm_free_batch
 #endif /* def DRIVER */
 
 typedef uint32_t word_t;
@@ -49,6 +106,8 @@ static const bool use_dynamic_chunksize = false;
 static const size_t chunksize = (1 << 8);
 static const size_t min_chunksize = 0;
 static const size_t max_chunksize = 0;
+// extra room left behind a block that realloc grows at the end of the heap
+static const size_t realloc_slack = (1 << 10);
 
 // static const size_t block_size = sizeof(block_t);
 static const size_t min_block_size = 2 * dsize; // 16 bytes
@@ -56,7 +115,21 @@ static const size_t prologue_size = dsize;
 static const size_t epilogue_size = wsize;
 
 static const word_t alloc_mask = 0x1;
+static const word_t mmap_mask = 0x4;            // block has a mapping of its own
+static const word_t batch_mask = 0x4;           // heap block: in the free_batch under way
+static const word_t zero_mask = 0x4;            // free block's footer: reads as zeros past the links
 static const word_t size_mask = ~(word_t) 0x7;
+static const size_t max_block_size = (word_t) ~(word_t) 0x7;    // largest heap block a header holds
+static const unsigned mmap_page_shift = 12;     // mapped blocks' headers count 4 KB pages
+
+// heap offsets count units of 1 << MM_OFFSET_SHIFT bytes, so 32 bits address
+// 4 GB << MM_OFFSET_SHIFT of heap, and the heap grows no further; blocks are
+// 8-byte aligned, which allows up to 3; e.g. make MMFLAGS=-DMM_OFFSET_SHIFT=0
+// for plain byte offsets
+#ifndef MM_OFFSET_SHIFT
+#define MM_OFFSET_SHIFT 3
+#endif
+#define MM_MAX_HEAP ((size_t) UINT32_MAX << MM_OFFSET_SHIFT)
 
 typedef struct block
 {
@@ -65,22 +138,176 @@ typedef struct block
 	unsigned char payload[0];
 	// because of the dynamic memory, the footer cannot be determined when creation
 	// so it is more like a "virtual" memory block that is adjacent to the header of the next block
-	word_t prev_offset;
-	word_t next_offset;
+	union
+	{
+		struct
+		{
+			word_t prev_offset;
+			word_t next_offset;
+		};
+		struct                  // free block in the large block tree
+		{
+			word_t left_offset;
+			word_t right_offset;
+		};
+	};
 
     word_t dummy;
 } block_t;
 
-static block_t *heap_listp = NULL;
-static block_t *seg_free_list = NULL;
-static unsigned char *heap_start = NULL;
+#ifdef MM_TLSF
+#define TLSF_SL_LOG2 4                          // second level: 16 lists per power of two
+#define TLSF_SL (1 << TLSF_SL_LOG2)
+#define TLSF_SMALL (TLSF_SL << 3)               // below this, one exact list per 8 bytes (fl 0)
+#define TLSF_FL (32 - TLSF_SL_LOG2 - 3 + 1)     // first level: up to 2^32
+#endif
+
+// free blocks this large go into the tree, 0 keeps them all in lists;
+// e.g. make MMFLAGS=-DMM_TREE_THRESHOLD=4096
+#ifndef MM_TREE_THRESHOLD
+#define MM_TREE_THRESHOLD 0
+#endif
+
+// a free block this large at the end of the heap is given back with a
+// negative sbrk, down to MM_TRIM_PAD bytes, and the whole pages inside free
+// blocks this large are released with madvise; 0 turns either off.
+// A heap that is freed and grown again refaults every page it gave back,
+// so a block goes back only once it has stayed free across MM_TRIM_DELAY
+// frees, e.g. make MMFLAGS="-DMM_RELEASE_THRESHOLD=16384 -DMM_TRIM_DELAY=0"
+#ifndef MM_TRIM_THRESHOLD
+#define MM_TRIM_THRESHOLD (1 << 20)
+#endif
+#ifndef MM_TRIM_PAD
+#define MM_TRIM_PAD (MM_TRIM_THRESHOLD / 2)
+#endif
+#ifndef MM_RELEASE_THRESHOLD
+#define MM_RELEASE_THRESHOLD (1 << 20)
+#endif
+#ifndef MM_TRIM_DELAY
+#define MM_TRIM_DELAY 256
+#endif
+// the smaller of the two, the size from which a free block waits
+#if MM_TRIM_THRESHOLD > 0 && (MM_RELEASE_THRESHOLD == 0 || MM_TRIM_THRESHOLD < MM_RELEASE_THRESHOLD)
+#define MM_IDLE_THRESHOLD MM_TRIM_THRESHOLD
+#else
+#define MM_IDLE_THRESHOLD MM_RELEASE_THRESHOLD
+#endif
+
+// requests this large are mapped on their own, 0 keeps them all in the heap
+#ifndef MM_MMAP_THRESHOLD
+#define MM_MMAP_THRESHOLD (128 << 10)
+#endif
+
+// small objects live in slabs, except with the thread caches of MM_CONCURRENT
+#if !defined(MM_CONCURRENT) && !defined(MM_NO_SLAB)
+#define MM_SLAB
+#define SLAB_SIZE 4096                          // a page, and the slab's alignment
+#define SLAB_MAX_SIZE 64                        // largest object kept in slabs
+#define SLAB_NCLASS (SLAB_MAX_SIZE / 8)         // classes of 8, 16, ..., 64 bytes
+#define SLAB_MAP_WORDS 8                        // in-slab bitmap, up to 512 objects
+#define SLAB_MIN_BYTES (SLAB_SIZE * 3 / 2)      // live bytes of a class before it gets slabs
+
+typedef struct slab
+{
+	word_t prev_page;                           // slabs of the class with free objects
+	word_t next_page;
+	uint16_t osize;
+	uint16_t nobj;
+	uint16_t nfree;
+	uint16_t hint;                              // no free object in used[0..hint)
+	uint64_t used[SLAB_MAP_WORDS];              // bit i: object i is allocated
+	unsigned char objects[];
+} slab_t;
+#endif
+
+typedef struct arena
+{
+	block_t *heap_listp;
+	block_t *seg_free_list;
+	uint32_t tree_root;                     // offset of the treap root, 0 if empty
+	block_t *grown_tail;                    // last block realloc grew at the end of the heap
+#ifdef MM_SLAB
+	uint32_t slabs[SLAB_NCLASS];            // pages of slabs with free objects, 0 if none
+	uint32_t demand[SLAB_NCLASS];           // live heap blocks small enough for each class
+#endif
+#ifdef MM_TLSF
+	uint32_t fl_bitmap;                     // bit i: sl_bitmap[i] != 0
+	uint32_t sl_bitmap[TLSF_FL];            // bit j: heads[i][j] != 0
+	uint32_t heads[TLSF_FL][TLSF_SL];       // offsets of the first blocks, 0 if empty
+#endif
+	unsigned char *heap_start;  // base for the 32-bit offsets and slab page numbers
+	int region;                 // memlib region the arena's heap grows in
+	size_t tail_wait;           // frees left before the free block ending the heap is given back
+	block_t *idle;              // other free block waiting to be given back, NULL if none
+	size_t idle_wait;           // frees left before it is
+	size_t nsplits, ncoalesces, nextends, ntrims;   // for mm_stats
+#ifdef MM_CONCURRENT
+	pthread_mutex_t lock;
+	_Atomic(void *) remote_free; // payloads freed by other arenas' threads, linked through the payload
+#endif
+} arena_t;
+
+#ifdef MM_CONCURRENT
+#define MM_NARENAS 8
+#define TCACHE_MAX_SIZE 256     // largest block size kept in a thread cache
+#define TCACHE_COUNT 16         // blocks kept per size
+#define TCACHE_NBINS ((TCACHE_MAX_SIZE - 16) / 8 + 1)
+
+typedef struct tcache
+{
+	unsigned long generation;   // heap the cached blocks belong to
+	uint8_t count[TCACHE_NBINS];
+	void *bins[TCACHE_NBINS];   // payloads, linked through the payload
+} tcache_t;
+
+static arena_t arenas[MM_NARENAS];
+static atomic_uint next_arena = 0;
+static atomic_ulong generation = 1;     // bumped by mm_init to drop stale caches
+static unsigned char *region_base = NULL;
+static size_t region_bytes = 0;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+static __thread arena_t *home_arena = NULL; // arena the thread allocates from
+static __thread tcache_t tcache;
+// arena being operated on, whose lock the thread holds
+static __thread arena_t *arena = NULL;
+// memlib's mappings are not thread safe
+static pthread_mutex_t mmap_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static arena_t main_arena = { .region = 0 };
+static arena_t *arena = &main_arena;
+#endif
+
+#ifdef MM_SLAB
+// bit i: the i-th page of the heap is a slab
+static uint64_t slab_pages[MAX_HEAP_LIMIT / SLAB_SIZE / 64];
+static size_t slab_pages_hi = 0;                // words of slab_pages that may be set
+#endif
+
+// payload bytes realloc moved, and bytes it kept in place instead;
+// bytes calloc cleared, and bytes it knew read as zeros
+#ifdef MM_CONCURRENT
+static atomic_size_t realloc_copied, realloc_avoided;
+static atomic_size_t calloc_cleared, calloc_skipped;
+#else
+static size_t realloc_copied, realloc_avoided;
+static size_t calloc_cleared, calloc_skipped;
+#endif
 
 static const uint8_t nseg = 15;
+#ifdef MM_TLSF
+static const uint8_t nsentinel = 0;
+#else
+static const uint8_t nsentinel = 15;  // list heads at the start of the heap, one per segment
+#endif
 static const uint8_t n_power_start = 7;
 static const uint8_t exact_interval_cutoff = 64;
 // segments = {[16],(16,32],(32,48],(48,64], (2^6,2^7], (2^7, 2^8], (2^8, 2^9], (2^9, 2^10], ..., (2^15, 2^16], (2^16, +inf)}
 
+#ifndef MM_TLSF
 static const uint8_t n_next_best_after_first = 10;
+#endif
 
 static size_t max(size_t x, size_t y);
 static size_t min(size_t x, size_t y);
@@ -129,7 +356,9 @@ static void remove_from_free_list(block_t *block);
 
 // segmented free allocator helper functions
 static uint8_t get_seg_index(size_t asize);
+#ifndef MM_TLSF
 static block_t *find_seg_free_list(size_t asize);
+#endif
 
 // pointer-to-offset helper functions
 static uint32_t get_heap_offset(block_t *block);
@@ -251,6 +480,9 @@ static void mark_prev_free_to_next(block_t *block)
 {
 	block_t *block_next = find_next(block);
 	block_next->header &= (~0x2);
+	// a free successor that coalesce_block left apart keeps its footer in step
+	if (!get_is_alloc(block_next))
+		write_footer(block_next, get_size(block_next), false, false);
 }
 
 static word_t* get_prev_footer(block_t *block)
@@ -272,6 +504,18 @@ static block_t* find_prev(block_t *block)
 	return (block_t *) ((unsigned char *) block - extract_size(*footer));
 }
 
+// a free block reads as zeros from its end of links to its footer; writing
+// the footer again clears the mark
+static bool get_is_zero(block_t *block)
+{
+	return *get_footer(block) & zero_mask;
+}
+
+static void mark_zero(block_t *block)
+{
+	*get_footer(block) |= zero_mask;
+}
+
 static uint8_t get_seg_index(size_t asize)
 {
 	uint8_t index = (asize <= exact_interval_cutoff) ? (round_up(asize, min_block_size) / min_block_size - 1) : 
@@ -280,23 +524,214 @@ static uint8_t get_seg_index(size_t asize)
 	return index;
 }
 
+#ifndef MM_TLSF
 static block_t *find_seg_free_list(size_t asize)
 {
-	return seg_free_list + get_seg_index(asize);
+	return arena->seg_free_list + get_seg_index(asize);
 }
+#endif
 
+// headers lie a word past a multiple of 8 from heap_start, so adding the
+// word makes the offset exact in 8-byte units and never 0
 static uint32_t get_heap_offset(block_t *block)
 {
-    return (uint32_t) ((unsigned char *)block - heap_start);
+    return (uint32_t) (((unsigned char *)block - arena->heap_start + wsize) >> MM_OFFSET_SHIFT);
 }
 
 static block_t *deref_heap_offset(uint32_t offset)
 {
-    return (block_t *)(heap_start + offset);
+    return (block_t *)(arena->heap_start + ((size_t) offset << MM_OFFSET_SHIFT) - wsize);
+}
+
+#ifdef MM_TLSF
+// list (fl, sl) that a free block of size asize belongs to
+static void tlsf_mapping(size_t asize, unsigned *fl, unsigned *sl)
+{
+	if (asize < TLSF_SMALL)
+	{
+		*fl = 0;
+		*sl = asize >> 3;
+	}
+	else
+	{
+		unsigned log2 = 31 - __builtin_clz((uint32_t) asize);
+		*fl = log2 - (TLSF_SL_LOG2 + 3) + 1;
+		*sl = (asize >> (log2 - TLSF_SL_LOG2)) - TLSF_SL;
+	}
+}
+
+static void insert_free_block(block_t *block)
+{
+	unsigned fl, sl;
+	uint32_t offset = get_heap_offset(block);
+
+	tlsf_mapping(get_size(block), &fl, &sl);
+	block->prev_offset = 0;
+	block->next_offset = arena->heads[fl][sl];
+	if (block->next_offset != 0)
+		deref_heap_offset(block->next_offset)->prev_offset = offset;
+	arena->heads[fl][sl] = offset;
+	arena->fl_bitmap |= 1u << fl;
+	arena->sl_bitmap[fl] |= 1u << sl;
+}
+
+// block must still carry the size it was inserted with
+static void remove_from_free_list(block_t *block)
+{
+	if (block == arena->idle)
+		arena->idle = NULL;
+	if (block->next_offset != 0)
+		deref_heap_offset(block->next_offset)->prev_offset = block->prev_offset;
+	if (block->prev_offset != 0)
+	{
+		deref_heap_offset(block->prev_offset)->next_offset = block->next_offset;
+	}
+	else
+	{
+		unsigned fl, sl;
+		tlsf_mapping(get_size(block), &fl, &sl);
+		arena->heads[fl][sl] = block->next_offset;
+		if (block->next_offset == 0)
+		{
+			arena->sl_bitmap[fl] &= ~(1u << sl);
+			if (arena->sl_bitmap[fl] == 0)
+				arena->fl_bitmap &= ~(1u << fl);
+		}
+	}
+}
+#else
+static bool use_tree(size_t size)
+{
+#if MM_TREE_THRESHOLD > 0
+	return size >= MM_TREE_THRESHOLD;
+#else
+	(void)size;
+	return false;
+#endif
+}
+
+// treap priority, a hash of the offset so it needs no storage
+static uint32_t tree_priority(uint32_t offset)
+{
+	offset ^= offset >> 16;
+	offset *= 0x45d9f3b;
+	offset ^= offset >> 16;
+	return offset;
+}
+
+// order by size, then by address
+static bool tree_less(block_t *a, block_t *b)
+{
+	return get_size(a) < get_size(b) || (get_size(a) == get_size(b) && a < b);
+}
+
+// split the subtree at t into the keys less than block (*l) and greater (*r)
+static void tree_split(uint32_t t, block_t *block, uint32_t *l, uint32_t *r)
+{
+	while (t != 0)
+	{
+		block_t *node = deref_heap_offset(t);
+		if (tree_less(node, block))
+		{
+			*l = t;
+			l = &node->right_offset;
+			t = node->right_offset;
+		}
+		else
+		{
+			*r = t;
+			r = &node->left_offset;
+			t = node->left_offset;
+		}
+	}
+	*l = 0;
+	*r = 0;
+}
+
+// merge two subtrees where every key in a is less than every key in b
+static uint32_t tree_merge(uint32_t a, uint32_t b)
+{
+	uint32_t root;
+	uint32_t *link = &root;
+
+	while (a != 0 && b != 0)
+	{
+		if (tree_priority(a) > tree_priority(b))
+		{
+			*link = a;
+			link = &deref_heap_offset(a)->right_offset;
+			a = *link;
+		}
+		else
+		{
+			*link = b;
+			link = &deref_heap_offset(b)->left_offset;
+			b = *link;
+		}
+	}
+	*link = (a != 0) ? a : b;
+	return root;
+}
+
+static void tree_insert(block_t *block)
+{
+	uint32_t offset = get_heap_offset(block);
+	uint32_t priority = tree_priority(offset);
+	uint32_t *link = &arena->tree_root;
+
+	// descend to where the block's priority puts it, then split below it
+	while (*link != 0 && tree_priority(*link) > priority)
+	{
+		block_t *node = deref_heap_offset(*link);
+		link = tree_less(block, node) ? &node->left_offset : &node->right_offset;
+	}
+	tree_split(*link, block, &block->left_offset, &block->right_offset);
+	*link = offset;
+}
+
+static void tree_remove(block_t *block)
+{
+	uint32_t offset = get_heap_offset(block);
+	uint32_t *link = &arena->tree_root;
+
+	while (*link != offset)
+	{
+		block_t *node = deref_heap_offset(*link);
+		link = tree_less(block, node) ? &node->left_offset : &node->right_offset;
+	}
+	*link = tree_merge(block->left_offset, block->right_offset);
+}
+
+// smallest block of at least asize bytes, lowest address among equals
+static block_t *tree_best_fit(size_t asize)
+{
+	block_t *best = NULL;
+	uint32_t t = arena->tree_root;
+
+	while (t != 0)
+	{
+		block_t *node = deref_heap_offset(t);
+		if (get_size(node) >= asize)
+		{
+			best = node;
+			t = node->left_offset;
+		}
+		else
+		{
+			t = node->right_offset;
+		}
+	}
+	return best;
 }
 
 static void insert_free_block(block_t *block)
 {
+	if (use_tree(get_size(block)))
+	{
+		tree_insert(block);
+		return;
+	}
+
 	block_t *free_listp = find_seg_free_list(get_size(block));
 
 	block->prev_offset = get_heap_offset(free_listp);
@@ -306,25 +741,44 @@ static void insert_free_block(block_t *block)
 	(deref_heap_offset(block->next_offset))->prev_offset = get_heap_offset(block);
 }
 
+// block must still carry the size it was inserted with
 static void remove_from_free_list(block_t *block)
 {
+	if (block == arena->idle)
+		arena->idle = NULL;
+	if (use_tree(get_size(block)))
+	{
+		tree_remove(block);
+		return;
+	}
+
 	(deref_heap_offset(block->prev_offset))->next_offset = block->next_offset;
 	(deref_heap_offset(block->next_offset))->prev_offset = block->prev_offset;
 }
+#endif
 
 static block_t* extend_heap(size_t size)
 {
 	void *bp;
-	// size = round_up(size, min_block_size);
-    size = round_up(size, dsize);
-	if ((bp = mem_sbrk(size)) == (void *)-1)
+	unsigned char *zero = mem_region_zero(arena->region);
+	// the new free block needs room for its list links and footer
+	size = round_up(max(size, min_block_size), dsize);
+	// past MM_MAX_HEAP the offsets of its blocks would wrap; past the end of
+	// the region memlib would fail, and complain, so a full region lets the
+	// caller move on to another arena quietly
+	size_t used = (unsigned char *) mem_region_sbrk(arena->region, 0) - arena->heap_start;
+	if (size > min(MM_MAX_HEAP, mem_region_size()) - used)
+		return NULL;
+	if ((bp = mem_region_sbrk(arena->region, size)) == (void *)-1)
 		return NULL;
 	
 	dbg_printf("extend heap by size %zd\n", size);
+	arena->nextends++;
 
 	// initialize free block header / footer and the epilogue header
 	block_t *block = (block_t *)(((unsigned char *)bp) - epilogue_size);
 	bool is_prev_alloc = get_is_prev_alloc(find_next(block));
+	bool is_prev_zero = !is_prev_alloc && (*get_prev_footer(block) & zero_mask);
 
 	write_header(block, size, false, is_prev_alloc);
 	write_footer(block, size, false, is_prev_alloc);
@@ -334,7 +788,23 @@ static block_t* extend_heap(size_t size)
 	write_header(new_epilogue, 0, true, false); 
 
 	// coalesce if the previous block was free
-	return coalesce_block(block);
+	block_t *merged = coalesce_block(block);
+	if (zero <= (unsigned char *) bp)
+	{
+		// the new heap reads as zeros; a merged block does too if the
+		// previous one did, once the tags between them are cleared
+		if (merged == block)
+		{
+			mark_zero(block);
+		}
+		else if (is_prev_zero)
+		{
+			*get_prev_footer(block) = 0;
+			block->header = 0;
+			mark_zero(merged);
+		}
+	}
+	return merged;
 }
 
 static block_t* coalesce_block(block_t *block)
@@ -346,15 +816,21 @@ static block_t* coalesce_block(block_t *block)
 	bool is_prev_alloc = get_is_prev_alloc(block);
 	bool is_next_alloc = get_is_alloc(block_next);
 	size_t size = get_size(block);
+	size_t next_size = is_next_alloc ? 0 : get_size(block_next);
+	size_t prev_size = is_prev_alloc ? 0 : extract_size(*get_prev_footer(block));
+	// a free neighbour stays apart if the merged block would not fit a header
+	bool merge_next = !is_next_alloc && size + next_size <= max_block_size;
+	bool merge_prev = !is_prev_alloc && size + prev_size + (merge_next ? next_size : 0) <= max_block_size;
 		
 	// check cases
-	if (is_prev_alloc && is_next_alloc)
+	if (!merge_prev && !merge_next)
 	{
 		mark_prev_free_to_next(block);		
 		// 1- for block, clear both pointers and concat the prev and next (both directions)
 	}
-	else if (is_prev_alloc && !is_next_alloc)
+	else if (!merge_prev)
 	{
+		arena->ncoalesces++;
 		size += get_size(block_next);
 		write_header(block, size, false, is_prev_alloc);
 		write_footer(block, size, false, is_prev_alloc);
@@ -365,15 +841,17 @@ static block_t* coalesce_block(block_t *block)
 		// 2- for block, repeat the free_list operation as case 1
 		remove_from_free_list(block_next);
 	}
-	else if (!is_prev_alloc)
+	else
 	{
 		block_t *block_prev = find_prev(block);
 		bool is_prev_prev_alloc = get_is_prev_alloc(block_prev);
 		assert(block_prev != NULL);
 
-		if (is_next_alloc)
+		if (!merge_next)
 		{
+			arena->ncoalesces++;
 			size += get_size(block_prev);
+			remove_from_free_list(block_prev);
 			write_header(block_prev, size, false, is_prev_prev_alloc);
 			write_footer(block_prev, size, false, is_prev_prev_alloc);
 			block = block_prev;
@@ -383,11 +861,13 @@ static block_t* coalesce_block(block_t *block)
 			// insert the new block at the root of the list
 			// 1- for block (after assigned with block_prev), clear both pointers and concat the prev and next (both directions)
 			// 2- for block, repeat the free_list operation as case 1
-			remove_from_free_list(block_prev);
 		}
 		else
 		{
+			arena->ncoalesces += 2;
 			size += get_size(block_next) + get_size(block_prev);
+			remove_from_free_list(block_prev);
+			remove_from_free_list(block_next);
 			write_header(block_prev, size, false, is_prev_prev_alloc);
 			write_footer(block_prev, size, false, is_prev_prev_alloc); 
 			block = block_prev;
@@ -397,8 +877,6 @@ static block_t* coalesce_block(block_t *block)
 			// 1- for block_next, clear both pointers and concat the prev and next (both directions)
 			// 2- for block (after assigned with block_prev), clear both pointers and concat the prev and next (both directions)
 			// 3- for block, repeat the free_list operation as case 1
-			remove_from_free_list(block_prev);
-			remove_from_free_list(block_next);
 		}
 	}
 
@@ -406,10 +884,22 @@ static block_t* coalesce_block(block_t *block)
 	return block;
 }
 
+// whether a free block this large waits to be given back
+static bool is_idle_size(size_t size)
+{
+#if MM_IDLE_THRESHOLD > 0
+	return size >= MM_IDLE_THRESHOLD;
+#else
+	(void)size;
+	return false;
+#endif
+}
+
 static void split_block(block_t *block, size_t asize)
 {
 	size_t block_size = get_size(block);
 
+	arena->nsplits++;
 	write_header(block, asize, true, get_is_prev_alloc(block));
 
 	block_t *block_next = find_next(block);
@@ -422,6 +912,7 @@ static void split_block(block_t *block, size_t asize)
 static void* place_and_return_payload(block_t *block, size_t asize)
 {
 	size_t block_size = get_size(block);
+	bool is_idle = block == arena->idle;
 	remove_from_free_list(block);
 
 	if ((block_size - asize) < min_block_size)
@@ -431,12 +922,55 @@ static void* place_and_return_payload(block_t *block, size_t asize)
 	}
 	else
 	{
+		// what is left of a block that reads as zeros still does; its footer
+		// is rewritten where the old one was
+		bool is_zero = get_is_zero(block);
 		split_block(block, asize);		
+		if (is_zero)
+			mark_zero(find_next(block));
+		// and it goes on waiting to be given back
+		if (is_idle && is_idle_size(block_size - asize))
+			arena->idle = find_next(block);
 	}
 
 	return header_to_payload(block);
 }
 
+#ifdef MM_TLSF
+static block_t* find_fit(size_t asize)
+{
+	unsigned fl, sl;
+	uint32_t sl_map, fl_map;
+	block_t *block;
+
+	// the head of asize's own list may already be large enough
+	tlsf_mapping(asize, &fl, &sl);
+	if (arena->heads[fl][sl] != 0)
+	{
+		block = deref_heap_offset(arena->heads[fl][sl]);
+		if (get_size(block) >= asize)
+			return block;
+	}
+
+	// every block in the lists after it is large enough
+	if (++sl == TLSF_SL)
+	{
+		sl = 0;
+		fl++;
+	}
+	sl_map = (fl < TLSF_FL) ? arena->sl_bitmap[fl] & (~0u << sl) : 0;
+	if (sl_map == 0)
+	{
+		fl_map = (fl + 1 < TLSF_FL) ? arena->fl_bitmap & (~0u << (fl + 1)) : 0;
+		if (fl_map == 0)
+			return NULL;
+		fl = __builtin_ctz(fl_map);
+		sl_map = arena->sl_bitmap[fl];
+	}
+	sl = __builtin_ctz(sl_map);
+	return deref_heap_offset(arena->heads[fl][sl]);
+}
+#else
 static block_t* find_fit(size_t asize)
 {
 	block_t *block;
@@ -444,9 +978,16 @@ static block_t* find_fit(size_t asize)
     size_t best_size;
     size_t block_size;
 	uint8_t idx = get_seg_index(asize);
+
+	if (use_tree(asize))
+	{
+		return tree_best_fit(asize);
+	}
+
+	// buckets past the threshold's stay empty, their blocks are in the tree
 	for (uint8_t choice = idx; choice < nseg; choice++)
 	{
-		for (block = deref_heap_offset((seg_free_list + choice)->next_offset); get_size(block) > 0; block = deref_heap_offset(block->next_offset))
+		for (block = deref_heap_offset((arena->seg_free_list + choice)->next_offset); get_size(block) > 0; block = deref_heap_offset(block->next_offset))
 		{
             block_size = get_size(block);
 			if (asize <= block_size)
@@ -480,12 +1021,27 @@ static block_t* find_fit(size_t asize)
         }
     }
 
+    if (best_block == NULL)
+    {
+        // any large block fits, take the smallest
+        best_block = tree_best_fit(asize);
+    }
+
 	return best_block;
 }
+#endif
 
 static void init_seg_list()
 {
-	for (uint8_t i = 0; i < nseg; i++)
+	block_t *seg_free_list = arena->seg_free_list;
+
+	arena->tree_root = 0;
+#ifdef MM_TLSF
+	memset(arena->heads, 0, sizeof(arena->heads));
+	memset(arena->sl_bitmap, 0, sizeof(arena->sl_bitmap));
+	arena->fl_bitmap = 0;
+#endif
+	for (uint8_t i = 0; i < nsentinel; i++)
 	{
 		write_header(seg_free_list + i, 0, true, true);
 		(seg_free_list + i)->next_offset = get_heap_offset(seg_free_list + i);
@@ -493,23 +1049,38 @@ static void init_seg_list()
 	}
 }
 
-int mm_init(void)
+// create the initial empty heap of the current arena
+static int init_arena(void)
 {
-	/* Create the initial empty heap */
-	heap_start = (unsigned char *) mem_sbrk(nseg * min_block_size + wsize + prologue_size + epilogue_size);
+	unsigned char *heap_start;
+
+	heap_start = (unsigned char *) mem_region_sbrk(arena->region, nsentinel * min_block_size + wsize + prologue_size + epilogue_size);
 	if (heap_start == (void *)-1)
 		return -1;
+	arena->heap_start = heap_start;
+	arena->grown_tail = NULL;
+	arena->tail_wait = MM_TRIM_DELAY;
+	arena->idle = NULL;
+	arena->idle_wait = 0;
+	arena->nsplits = arena->ncoalesces = arena->nextends = arena->ntrims = 0;
+#ifdef MM_SLAB
+	memset(arena->slabs, 0, sizeof(arena->slabs));
+	memset(arena->demand, 0, sizeof(arena->demand));
+	memset(slab_pages, 0, slab_pages_hi * sizeof(slab_pages[0]));
+	slab_pages_hi = 0;
+#endif
 	
-	block_t *prologue_start = (block_t *)(heap_start + nseg * min_block_size + wsize);
+	block_t *prologue_start = (block_t *)(heap_start + wsize + nsentinel * min_block_size);
 	// write the prologue block
 	write_header(prologue_start, prologue_size, true, true);
 	// write the epilogue block
 	block_t *epilogue_block = find_next(prologue_start);
 	write_header(epilogue_block, 0, true, true);
 
-	heap_listp = epilogue_block;
-	// setup the segmented free allocator
-	seg_free_list = (block_t *) heap_start;
+	arena->heap_listp = epilogue_block;
+	// setup the segmented free allocator; the list heads are blocks too,
+	// at a word past a multiple of 8
+	arena->seg_free_list = (block_t *) (heap_start + wsize);
 	init_seg_list();
 
 	if (extend_heap(chunksize) == NULL)
@@ -518,174 +1089,1384 @@ int mm_init(void)
 	return 0;
 }
 
-void* malloc(size_t size)
+// the free block of the current arena to place asize bytes in, growing
+// the heap if none fits
+static block_t *arena_fit(size_t asize)
 {
-	dbg_requires(mm_checkheap(__LINE__));
-
-	size_t asize;
 	size_t extendsize;
 	block_t *block;
-	void *bp = NULL;
 
-	if (size == 0)
-	{
-		// dbg_ensures(mm_checkheap(__LINE__));
-		return bp;
-	}
-	
-	if (heap_listp == NULL)
+	if (asize > max_block_size || (arena->heap_listp == NULL && init_arena() < 0))
 	{
-		mm_init();
+		return NULL;
 	}
 
-	asize = get_asize(size);
 	block = find_fit(asize);
 
 	if (block == NULL)
 	{
-        // if (use_dynamic_chunksize)
-        // {
-        //     if (asize > chunksize) 
-        //     {
-        //         extendsize = asize;
-        //         // request larger chunk, so dynamically increase chunksize by factor of 2
-        //         chunksize = min(max_chunksize, chunksize << 1);
-        //     } 
-        //     else 
-        //     {
-        //         extendsize = chunksize;
-        //         if (asize < chunksize)
-        //             // request smaller chunk, so dynamically decrease chunksize by factor of 2
-        //             chunksize = max(min_chunksize, chunksize >> 1);
-        //     }
-        // }
-
 		extendsize = max(asize, chunksize);
 
 		block = extend_heap(extendsize);
-		if (block == NULL)
-		{
-			return bp;
-		}
 	}
-
-	bp = place_and_return_payload(block, asize);
-
-	return bp;
+	return block;
 }
 
-void free(void *bp)
+// allocate asize bytes from the current arena
+static void *arena_malloc(size_t asize)
 {
-	if (bp == NULL)
-		return;
+	block_t *block = arena_fit(asize);
 
-	block_t *block = payload_to_header(bp);
-	size_t size = get_size(block);
-	bool is_prev_alloc = get_is_prev_alloc(block);
+	return block == NULL ? NULL : place_and_return_payload(block, asize);
+}
 
-	write_header(block, size, false, is_prev_alloc);
-	write_footer(block, size, false, is_prev_alloc);
+// allocate asize bytes from the current arena and clear the first n of
+// them; of a block that reads as zeros, only its links and, if the block
+// is taken whole, its old footer
+static void *arena_calloc(size_t asize, size_t n)
+{
+	block_t *block = arena_fit(asize);
+	unsigned char *bp;
+	size_t size, lo, hi;
 
-	coalesce_block(block);
+	if (block == NULL)
+		return NULL;
+	size = get_size(block);
+	lo = get_is_zero(block) ? min(n, sizeof(block_t) - wsize) : n;
+	bp = place_and_return_payload(block, asize);
+	// [lo, hi) of the payload reads as zeros already
+	hi = get_size(block) == size ? min(n, max(lo, size - dsize)) : n;
+	memset(bp, 0, lo);
+	memset(bp + hi, 0, n - hi);
+	calloc_cleared += n - (hi - lo);
+	calloc_skipped += hi - lo;
+	return bp;
 }
 
-void *realloc(void *old_bp, size_t size)
+// shrink the heap if the free block ends it and is large enough
+static bool trim_heap(block_t *block)
 {
-	block_t *block = payload_to_header(old_bp);
-	size_t oldsize;
-	void *new_bp;
+#if MM_TRIM_THRESHOLD > 0
+	size_t size = get_size(block);
+	// keep some of the block so that the heap does not have to grow
+	// back right away
+	size_t keep = MM_TRIM_PAD ? round_up(max(MM_TRIM_PAD, min_block_size), dsize) : 0;
 
-	/* If size == 0 then this is just free, and we return NULL. */
-	if(size == 0) 
+	if (size < MM_TRIM_THRESHOLD || size <= keep || get_size(find_next(block)) != 0)
+		return false;
+
+	size_t trim = size - keep;
+	bool is_prev_alloc = get_is_prev_alloc(block);
+	block_t *epilogue = (block_t *) ((unsigned char *) block + keep);
+
+	remove_from_free_list(block);
+	if (mem_region_sbrk(arena->region, -(ptrdiff_t) trim) == (void *)-1)
 	{
-		free(old_bp);
-		return NULL;
+		insert_free_block(block);
+		return false;
 	}
-
-	/* If old_bp is NULL, then this is just malloc. */
-	if(old_bp == NULL) 
+	arena->ntrims++;
+	write_header(epilogue, 0, true, keep == 0 ? is_prev_alloc : false);
+	if (keep > 0)
 	{
-		return malloc(size);
+		write_header(block, keep, false, is_prev_alloc);
+		write_footer(block, keep, false, is_prev_alloc);
+		insert_free_block(block);
 	}
+	return true;
+#else
+	(void)block;
+	return false;
+#endif
+}
 
-	new_bp = malloc(size);
+// release the whole pages inside a large free block
+static void release_pages(block_t *block)
+{
+#if MM_RELEASE_THRESHOLD > 0
+	// keep the header, the list or tree links and the footer
+	unsigned char *lo = (unsigned char *) block + sizeof(block_t);
+	unsigned char *hi = (unsigned char *) block + get_size(block) - wsize;
 
-	/* If realloc() fails the original block is left untouched  */
-	if(!new_bp) 
+	if (get_size(block) < MM_RELEASE_THRESHOLD || !mem_release(lo, hi - lo))
+		return;
+	// clearing the partial pages at its ends makes the block read as zeros
+	size_t pagesize = mem_pagesize();
+	unsigned char *page_lo = (unsigned char *) round_up((size_t) lo, pagesize);
+	unsigned char *page_hi = (unsigned char *) ((size_t) hi & ~(pagesize - 1));
+	if (page_lo <= page_hi)
 	{
-		return NULL;
+		memset(lo, 0, page_lo - lo);
+		memset(page_hi, 0, hi - page_hi);
+		mark_zero(block);
 	}
+#else
+	(void)block;
+#endif
+}
 
-	/* Copy the old data. */
-	oldsize = get_payload_size(block);
-	if(size < oldsize) 
-		oldsize = size;
-		
-	memcpy(new_bp, old_bp, oldsize);
+// trim the heap, or release the pages of a large free block, whichever
+// it can be given back with
+static void give_back(block_t *block)
+{
+	// a block released before reads as zeros until a dirty one joins it
+	if (!trim_heap(block) && !get_is_zero(block))
+		release_pages(block);
+}
 
-	/* Free the old block. */
-	free(old_bp);
+// after n blocks of the current arena were freed, block among them, or
+// NULL, give back the free block that ends the heap once it has been large
+// across MM_TRIM_DELAY frees. Any other large free block waits as long,
+// but only the newest: one that takes in the block waiting, or comes after
+// it, waits out the rest of its time in its place, and the older one
+// stays until a free merges into it
+static void give_back_idle(block_t *block, size_t n)
+{
+	block_t *epilogue = (block_t *) ((unsigned char *) mem_region_sbrk(arena->region, 0) - epilogue_size);
+	block_t *tail = get_is_prev_alloc(epilogue) ? NULL : find_prev(epilogue);
 
-	return new_bp;
+	if (tail == NULL || !is_idle_size(get_size(tail)))
+	{
+		arena->tail_wait = MM_TRIM_DELAY;
+	}
+	else
+	{
+		arena->tail_wait -= min(n, arena->tail_wait);
+		if (arena->tail_wait == 0)
+			give_back(tail);
+	}
+
+	if (block != NULL && block != tail && is_idle_size(get_size(block)))
+	{
+		arena->idle = block;
+		if (arena->idle_wait == 0)
+		{
+			arena->idle_wait = MM_TRIM_DELAY;
+			n = 0;
+		}
+	}
+	arena->idle_wait -= min(n, arena->idle_wait);
+	block = arena->idle;
+	if (block == NULL || arena->idle_wait > 0)
+		return;
+	arena->idle = NULL;
+	give_back(block);
 }
 
-void *calloc(size_t nmemb, size_t size)
+// return a block to the current arena
+static void arena_free(block_t *block)
 {
-	size_t asize = nmemb * size;
-	void *new_bp;
-
-	// Multiplication overflowed
-	if (asize / nmemb != size)
-		return NULL;
+	size_t size = get_size(block);
+	bool is_prev_alloc = get_is_prev_alloc(block);
 
-	new_bp = malloc(asize);
-	memset(new_bp, 0, asize);
+	write_header(block, size, false, is_prev_alloc);
+	write_footer(block, size, false, is_prev_alloc);
 
-	return new_bp;
+	give_back_idle(coalesce_block(block), 1);
 }
 
-void mm_checkheap(int verbose) 
+// free the blocks of the current arena whose payloads bps holds, in one
+// pass: each run of neighbours that are freed now or already free becomes
+// one block, and the merged blocks go onto the free lists only at the end.
+// The blocks of the batch, and merged blocks not on the lists yet, carry
+// batch_mask, which is how a run tells them from its other neighbours
+// without sorting the batch; bps is reused to hold the merged blocks
+static void arena_free_batch(void **bps, size_t n)
 {
-    if (!heap_listp) 
+	size_t i, nmerged = 0;
+
+	for (i = 0; i < n; i++)
+		payload_to_header(bps[i])->header |= batch_mask;
+
+	for (i = 0; i < n; i++)
 	{
-        printf("NULL heap list pointer!\n");
-    }
+		block_t *block = payload_to_header(bps[i]);
 
-    block_t *curr = heap_listp;
-    block_t *next;
-    block_t *hi = mem_heap_hi();
-    block_t *curr_free;
+		// already taken in by a run
+		if (!(block->header & batch_mask))
+			continue;
 
-    size_t n_free = 0, n_free_seg = 0;
-    if (!get_is_alloc(curr))
-    {
-        n_free += 1;
-    }
-    printf("heap size %lu\n", mem_heapsize());
-    while ((next = find_next(curr)) + 1 < hi) {
-        word_t hdr = curr->header;
-		if (!get_is_alloc(curr))
-		{
-			word_t ftr = *get_prev_footer(next);
+		size_t size = get_size(block);
+		bool is_prev_alloc = get_is_prev_alloc(block);
 
-			if (hdr != ftr) {
-				printf("Header (0x%08X) != footer (0x%08X)\n", hdr, ftr);
-			}
-		}
-		else
+		if (!is_prev_alloc)
 		{
-			size_t hdr_size = get_size(curr);
-			size_t actual_size = min_block_size * (next - curr);
-			if (hdr_size != actual_size)
+			block_t *block_prev = find_prev(block);
+			if (size + get_size(block_prev) <= max_block_size)
 			{
-				printf("check size %d and %d for alloc block %p\n", hdr_size, actual_size, curr);
+				// a run merged before is not on the lists; it keeps its
+				// start, and its entry in bps is skipped once inserted
+				arena->ncoalesces++;
+				if (!(block_prev->header & batch_mask))
+					remove_from_free_list(block_prev);
+				size += get_size(block_prev);
+				is_prev_alloc = get_is_prev_alloc(block_prev);
+				block = block_prev;
 			}
+		}
 
-			word_t any_footer = *get_prev_footer(next);
-			if (hdr_size == extract_size(any_footer))
+		// take in the successors that are freed now or already free
+		for (;;)
+		{
+			block_t *block_next = (block_t *) ((unsigned char *) block + size);
+			word_t next = block_next->header;
+
+			if ((extract_is_alloc(next) && !(next & batch_mask)) ||
+				size + extract_size(next) > max_block_size)
+				break;
+			arena->ncoalesces++;
+			if (!(next & batch_mask))
+				remove_from_free_list(block_next);
+			block_next->header = next & ~batch_mask;
+			size += extract_size(next);
+		}
+
+		write_header(block, size, false, is_prev_alloc);
+		write_footer(block, size, false, is_prev_alloc);
+		block->header |= batch_mask;
+		mark_prev_free_to_next(block);
+		bps[nmerged++] = header_to_payload(block);
+	}
+
+	for (i = 0; i < nmerged; i++)
+	{
+		block_t *block = payload_to_header(bps[i]);
+		if (block->header & batch_mask)
+		{
+			block->header &= ~batch_mask;
+			insert_free_block(block);
+			give_back_idle(block, 0);
+		}
+	}
+	give_back_idle(NULL, n);
+}
+
+// room a growing block of asize bytes reserves for its next realloc
+static size_t realloc_reserve(size_t asize)
+{
+	return min(asize / 4, realloc_slack);
+}
+
+// resize an allocated block of the current arena without moving it, by
+// splitting off the tail, absorbing a free successor or growing the heap
+// when the block is the last one; returns false if there is no room
+static bool arena_resize(block_t *block, size_t asize)
+{
+	size_t size = get_size(block);
+	bool is_prev_alloc = get_is_prev_alloc(block);
+	block_t *block_next = find_next(block);
+
+	if (asize <= size)
+	{
+		// small shrinks keep the tail, which may be slack reserved below
+		if (size - asize >= min_block_size && size - asize > realloc_reserve(size))
+		{
+			arena->nsplits++;
+			write_header(block, asize, true, is_prev_alloc);
+			block_next = find_next(block);
+			write_header(block_next, size - asize, false, true);
+			write_footer(block_next, size - asize, false, true);
+			coalesce_block(block_next);
+		}
+		return true;
+	}
+
+	size_t avail = size;
+	if (!get_is_alloc(block_next))
+		avail += get_size(block_next);
+	// the merged block would not fit a header
+	if (avail > max_block_size || asize > max_block_size)
+		return false;
+
+	if (avail < asize)
+	{
+		block_t *tail = get_is_alloc(block_next) ? block_next : find_next(block_next);
+		// only the epilogue has size 0
+		if (get_size(tail) != 0)
+			return false;
+		// a block that keeps growing at the end of the heap reserves some
+		// slack, so that the next few calls do not have to extend the heap
+		// again; it is kept inside the block where no malloc can take it
+		if (block == arena->grown_tail)
+			asize = min(round_up(asize + realloc_reserve(asize), dsize), max_block_size);
+		arena->grown_tail = block;
+		if (extend_heap(asize - avail) == NULL)
+			return false;
+		block_next = find_next(block);
+		avail = size + get_size(block_next);
+	}
+
+	remove_from_free_list(block_next);
+	write_header(block, avail, true, is_prev_alloc);
+	if (avail - asize >= min_block_size)
+		split_block(block, asize);
+	else
+		mark_prev_alloc_to_next(block);
+	return true;
+}
+
+// first header address at or after block where a block with its payload
+// aligned to align can start, leaving no gap or a free block in front
+static unsigned char *aligned_header(block_t *block, size_t align)
+{
+	uintptr_t bp = (uintptr_t) header_to_payload(block);
+	uintptr_t aligned = (bp + align - 1) & ~(uintptr_t) (align - 1);
+
+	if (aligned != bp && aligned - bp < min_block_size)
+		aligned += align;
+	return (unsigned char *) aligned - wsize;
+}
+
+// allocate asize bytes from the current arena with the payload aligned to
+// align, a power of two
+static void *arena_malloc_aligned(size_t asize, size_t align)
+{
+	unsigned char *start;
+	block_t *block;
+
+	if (asize + align + min_block_size > max_block_size ||
+		(arena->heap_listp == NULL && init_arena() < 0))
+	{
+		return NULL;
+	}
+
+	// any block this large has an aligned spot with room on both sides
+	block = find_fit(asize + align + min_block_size);
+
+	if (block == NULL)
+	{
+		// grow the heap just enough to fit the block at its end
+		block_t *epilogue = (block_t *) ((unsigned char *) mem_region_sbrk(arena->region, 0) - epilogue_size);
+
+		block = get_is_prev_alloc(epilogue) ? epilogue : find_prev(epilogue);
+		start = aligned_header(block, align);
+		if (start + asize > (unsigned char *) epilogue)
+		{
+			block = extend_heap(start + asize - (unsigned char *) epilogue);
+			if (block == NULL)
+			{
+				return NULL;
+			}
+		}
+	}
+
+	// cut off the part in front as a free block, then place as usual
+	size_t size = get_size(block);
+	bool is_prev_alloc = get_is_prev_alloc(block);
+
+	start = aligned_header(block, align);
+	remove_from_free_list(block);
+	if (start != (unsigned char *) block)
+	{
+		size_t front = start - (unsigned char *) block;
+
+		arena->nsplits++;
+		write_header(block, front, false, is_prev_alloc);
+		write_footer(block, front, false, is_prev_alloc);
+		insert_free_block(block);
+		block = (block_t *) start;
+		size -= front;
+		is_prev_alloc = false;
+	}
+
+	write_header(block, size, true, is_prev_alloc);
+	if (size - asize >= min_block_size)
+		split_block(block, asize);
+	else
+		mark_prev_alloc_to_next(block);
+
+	return header_to_payload(block);
+}
+
+#ifdef MM_SLAB
+static size_t slab_class(size_t size)
+{
+	return (size - 1) / 8;
+}
+
+// the slab bp lies in, NULL if bp is an ordinary block
+static slab_t *slab_of(void *bp)
+{
+	size_t page = ((unsigned char *) bp - arena->heap_start) / SLAB_SIZE;
+
+	// mapped blocks lie outside the heap
+	if (page >= MAX_HEAP_LIMIT / SLAB_SIZE)
+		return NULL;
+	if (((slab_pages[page / 64] >> (page % 64)) & 1) == 0)
+		return NULL;
+	return (slab_t *) (arena->heap_start + page * SLAB_SIZE);
+}
+
+// slabs are linked by page number, page 0 holds the list heads
+static uint32_t get_slab_page(slab_t *slab)
+{
+	return (uint32_t) (((unsigned char *) slab - arena->heap_start) / SLAB_SIZE);
+}
+
+static slab_t *deref_slab_page(uint32_t page)
+{
+	return (slab_t *) (arena->heap_start + (size_t) page * SLAB_SIZE);
+}
+
+static void mark_slab_page(slab_t *slab, bool is_slab)
+{
+	size_t page = get_slab_page(slab);
+
+	if (is_slab)
+	{
+		slab_pages[page / 64] |= 1ULL << (page % 64);
+		slab_pages_hi = max(slab_pages_hi, page / 64 + 1);
+	}
+	else
+	{
+		slab_pages[page / 64] &= ~(1ULL << (page % 64));
+	}
+}
+
+// put a slab with free objects at the head of its class's list
+static void slab_push(slab_t *slab)
+{
+	uint32_t *head = &arena->slabs[slab_class(slab->osize)];
+
+	slab->prev_page = 0;
+	slab->next_page = *head;
+	if (*head != 0)
+		deref_slab_page(*head)->prev_page = get_slab_page(slab);
+	*head = get_slab_page(slab);
+}
+
+static void slab_unlink(slab_t *slab)
+{
+	if (slab->prev_page != 0)
+		deref_slab_page(slab->prev_page)->next_page = slab->next_page;
+	else
+		arena->slabs[slab_class(slab->osize)] = slab->next_page;
+	if (slab->next_page != 0)
+		deref_slab_page(slab->next_page)->prev_page = slab->prev_page;
+}
+
+static slab_t *slab_new(size_t osize)
+{
+	// the slab block's header sits in the previous page, so one word less
+	slab_t *slab = arena_malloc_aligned(SLAB_SIZE, SLAB_SIZE);
+
+	if (slab == NULL)
+		return NULL;
+
+	slab->osize = osize;
+	slab->nobj = (SLAB_SIZE - wsize - sizeof(slab_t)) / osize;
+	slab->nfree = slab->nobj;
+	slab->hint = 0;
+	// objects past the end are marked allocated so they are never found
+	memset(slab->used, 0xff, sizeof(slab->used));
+	for (size_t i = 0; i < slab->nobj; i++)
+		slab->used[i / 64] &= ~(1ULL << (i % 64));
+
+	mark_slab_page(slab, true);
+	slab_push(slab);
+	return slab;
+}
+
+// NULL if the class does not use slabs yet, or the heap is exhausted
+static void *slab_malloc(size_t size)
+{
+	size_t c = slab_class(size);
+	slab_t *slab;
+
+	if (arena->slabs[c] != 0)
+	{
+		slab = deref_slab_page(arena->slabs[c]);
+	}
+	else if (arena->demand[c] * (c + 1) * 8 < SLAB_MIN_BYTES)
+	{
+		// a few small blocks are cheaper than a page of them
+		return NULL;
+	}
+	else if ((slab = slab_new((c + 1) * 8)) == NULL)
+	{
+		return NULL;
+	}
+
+	size_t i = slab->hint;
+	while (slab->used[i] == ~0ULL)
+		i++;
+	size_t bit = __builtin_ctzll(~slab->used[i]);
+
+	slab->used[i] |= 1ULL << bit;
+	slab->hint = i;
+	if (--slab->nfree == 0)
+		slab_unlink(slab);
+	return slab->objects + (i * 64 + bit) * slab->osize;
+}
+
+// track the live heap blocks that a slab class could hold instead
+static void count_small_block(block_t *block, int delta)
+{
+	size_t c = get_size(block) / dsize - 2;
+
+	if (c < SLAB_NCLASS)
+		arena->demand[c] += delta;
+}
+
+static void slab_free(slab_t *slab, void *bp)
+{
+	size_t i = ((unsigned char *) bp - slab->objects) / slab->osize;
+
+	slab->used[i / 64] &= ~(1ULL << (i % 64));
+	if (i / 64 < slab->hint)
+		slab->hint = i / 64;
+	if (slab->nfree++ == 0)
+		slab_push(slab);
+
+	// an empty slab goes back to the heap, unless it is the last of its class
+	if (slab->nfree == slab->nobj && (slab->prev_page != 0 || slab->next_page != 0))
+	{
+		slab_unlink(slab);
+		mark_slab_page(slab, false);
+		arena_free(payload_to_header(slab));
+	}
+}
+#endif
+
+// whether a request this large is mapped on its own
+static bool use_mmap(size_t size)
+{
+#if MM_MMAP_THRESHOLD > 0
+	return size >= MM_MMAP_THRESHOLD;
+#else
+	(void)size;
+	return false;
+#endif
+}
+
+// whether bp was allocated with mmap_malloc; slab objects have no header
+static bool is_mmapped(void *bp)
+{
+#ifdef MM_SLAB
+	if (slab_of(bp) != NULL)
+		return false;
+#endif
+	return payload_to_header(bp)->header & mmap_mask;
+}
+
+// bytes to map for a payload of size bytes off bytes into the mapping:
+// dsize, so that the header sits one word in and the payload is 8-byte
+// aligned, or up to a page for memalign
+static size_t mmap_length(size_t size, size_t off)
+{
+	return round_up(size + off, mem_pagesize());
+}
+
+// the header lies in the mapping's first page
+static unsigned char *mmap_start(block_t *block)
+{
+	return (unsigned char *) ((uintptr_t) block & ~(uintptr_t) (mem_pagesize() - 1));
+}
+
+// a mapped block's header holds its length in pages, up to 2 TB
+static word_t pack_mmap(size_t len)
+{
+	return pack(len >> mmap_page_shift << 3, true, true) | mmap_mask;
+}
+
+static size_t get_mmap_size(block_t *block)
+{
+	return get_size(block) >> 3 << mmap_page_shift;
+}
+
+// align is a power of two of at most a page
+static void *mmap_malloc(size_t size, size_t align)
+{
+	size_t off = max(align, dsize);
+	size_t len = mmap_length(size, off);
+	unsigned char *start;
+
+#ifdef MM_CONCURRENT
+	pthread_mutex_lock(&mmap_lock);
+#endif
+	start = mem_mmap(len);
+#ifdef MM_CONCURRENT
+	pthread_mutex_unlock(&mmap_lock);
+#endif
+	if (start == (void *)-1)
+		return NULL;
+
+	block_t *block = (block_t *) (start + off - wsize);
+	block->header = pack_mmap(len);
+	return header_to_payload(block);
+}
+
+static void mmap_free(block_t *block)
+{
+#ifdef MM_CONCURRENT
+	pthread_mutex_lock(&mmap_lock);
+#endif
+	mem_munmap(mmap_start(block), get_mmap_size(block));
+#ifdef MM_CONCURRENT
+	pthread_mutex_unlock(&mmap_lock);
+#endif
+}
+
+// a mapped block stays mapped while it is large enough, and is moved into
+// the heap otherwise
+static void *mmap_realloc(block_t *block, size_t size)
+{
+	size_t off = (unsigned char *) header_to_payload(block) - mmap_start(block);
+	size_t oldsize = get_mmap_size(block) - off;
+	size_t len = mmap_length(size, off);
+	unsigned char *start;
+	void *new_bp;
+
+	if (!use_mmap(size))
+	{
+		if ((new_bp = malloc(size)) == NULL)
+			return NULL;
+		memcpy(new_bp, header_to_payload(block), size);
+		realloc_copied += size;
+		mmap_free(block);
+		return new_bp;
+	}
+
+#ifdef MM_CONCURRENT
+	pthread_mutex_lock(&mmap_lock);
+#endif
+	start = mem_mremap(mmap_start(block), get_mmap_size(block), len);
+#ifdef MM_CONCURRENT
+	pthread_mutex_unlock(&mmap_lock);
+#endif
+	if (start == (void *)-1)
+		return NULL;
+
+	block = (block_t *) (start + off - wsize);
+	block->header = pack_mmap(len);
+	realloc_avoided += min(oldsize, size);
+	return header_to_payload(block);
+}
+
+#ifdef MM_CONCURRENT
+static arena_t *arena_of(block_t *block)
+{
+	return &arenas[((unsigned char *)block - region_base) / region_bytes];
+}
+
+static void lock_arena(arena_t *a)
+{
+	pthread_mutex_lock(&a->lock);
+	arena = a;
+}
+
+static void unlock_arena(void)
+{
+	pthread_mutex_unlock(&arena->lock);
+	arena = NULL;
+}
+
+// take back the blocks other threads freed into the locked arena
+static void drain_remote_frees(void)
+{
+	void *bp = atomic_exchange_explicit(&arena->remote_free, NULL, memory_order_acquire);
+
+	while (bp != NULL)
+	{
+		void *next = *(void **)bp;
+		arena_free(payload_to_header(bp));
+		bp = next;
+	}
+}
+
+static void free_to_owner(block_t *block)
+{
+	arena_t *owner = arena_of(block);
+
+	if (owner == home_arena)
+	{
+		lock_arena(owner);
+		arena_free(block);
+		unlock_arena();
+	}
+	else
+	{
+		// Treiber push; the owner detaches the whole list at once, so no ABA
+		void **bp = header_to_payload(block);
+		void *head = atomic_load_explicit(&owner->remote_free, memory_order_relaxed);
+		do
+		{
+			*bp = head;
+		} while (!atomic_compare_exchange_weak_explicit(&owner->remote_free, &head, bp,
+		                                                memory_order_release,
+		                                                memory_order_relaxed));
+	}
+}
+
+static void tcache_flush(void *unused)
+{
+	(void) unused;
+	if (tcache.generation != atomic_load(&generation))
+	{
+		memset(&tcache, 0, sizeof(tcache));
+		return;
+	}
+	for (int i = 0; i < TCACHE_NBINS; i++)
+	{
+		while (tcache.bins[i] != NULL)
+		{
+			void *bp = tcache.bins[i];
+			tcache.bins[i] = *(void **)bp;
+			free_to_owner(payload_to_header(bp));
+		}
+		tcache.count[i] = 0;
+	}
+}
+
+static void tcache_key_init(void)
+{
+	pthread_key_create(&tcache_key, tcache_flush);
+}
+
+// bind the calling thread to an arena and make sure its cache is current
+static void thread_init(void)
+{
+	if (home_arena == NULL)
+	{
+		pthread_once(&tcache_once, tcache_key_init);
+		// a non-NULL value makes the destructor run at thread exit
+		pthread_setspecific(tcache_key, &tcache);
+		home_arena = &arenas[atomic_fetch_add(&next_arena, 1) % MM_NARENAS];
+	}
+	if (tcache.generation != atomic_load_explicit(&generation, memory_order_relaxed))
+	{
+		memset(&tcache, 0, sizeof(tcache));
+		tcache.generation = atomic_load(&generation);
+	}
+}
+#endif
+
+#ifdef MM_CONCURRENT
+int mm_thread_safe(void)
+{
+	return 1;
+}
+#endif
+
+void mm_realloc_stats(size_t *copied, size_t *avoided)
+{
+	*copied = realloc_copied;
+	*avoided = realloc_avoided;
+}
+
+void mm_calloc_stats(size_t *cleared, size_t *skipped)
+{
+	*cleared = calloc_cleared;
+	*skipped = calloc_skipped;
+}
+
+// add the blocks and counters of the current arena to stats
+static void arena_stats(mm_stats_t *stats)
+{
+	block_t *block;
+
+	for (block = arena->heap_listp; get_size(block) > 0; block = find_next(block))
+	{
+		size_t size = get_size(block);
+		if (get_is_alloc(block))
+		{
+			stats->allocated += size;
+			continue;
+		}
+		uint8_t c = get_seg_index(size);
+		stats->class_count[c]++;
+		stats->class_bytes[c] += size;
+		stats->free_bytes += size;
+		stats->largest_free = max(stats->largest_free, size);
+	}
+	// block is the epilogue, the last word of the heap
+	stats->heap_size += (unsigned char *) block + epilogue_size - arena->heap_start;
+	stats->splits += arena->nsplits;
+	stats->coalesces += arena->ncoalesces;
+	stats->extends += arena->nextends;
+	stats->trims += arena->ntrims;
+}
+
+void mm_stats(mm_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+#ifdef MM_CONCURRENT
+	for (int i = 0; i < MM_NARENAS; i++)
+	{
+		lock_arena(&arenas[i]);
+		if (arena->heap_listp != NULL)
+			arena_stats(stats);
+		unlock_arena();
+	}
+	pthread_mutex_lock(&mmap_lock);
+	stats->mapped = mem_mapped();
+	pthread_mutex_unlock(&mmap_lock);
+#else
+	if (arena->heap_listp != NULL)
+		arena_stats(stats);
+	stats->mapped = mem_mapped();
+#endif
+	if (stats->free_bytes > 0)
+		stats->fragmentation = 1.0 - (double) stats->largest_free / stats->free_bytes;
+}
+
+int mm_init(void)
+{
+	realloc_copied = 0;
+	realloc_avoided = 0;
+	calloc_cleared = 0;
+	calloc_skipped = 0;
+#ifdef MM_CONCURRENT
+	mem_set_regions(MM_NARENAS);
+	region_base = mem_heap_lo();
+	region_bytes = mem_region_size();
+	for (int i = 0; i < MM_NARENAS; i++)
+	{
+		arenas[i].heap_listp = NULL;
+		arenas[i].region = i;
+		pthread_mutex_init(&arenas[i].lock, NULL);
+		atomic_store(&arenas[i].remote_free, NULL);
+	}
+	// every cached block belongs to the old heap
+	atomic_fetch_add(&generation, 1);
+	return 0;
+#else
+	arena->heap_listp = NULL;
+	return init_arena();
+#endif
+}
+
+void* malloc(size_t size)
+{
+	dbg_requires(mm_checkheap(__LINE__));
+
+	size_t asize;
+	void *bp = NULL;
+
+	if (size == 0)
+	{
+		// dbg_ensures(mm_checkheap(__LINE__));
+		return bp;
+	}
+
+	if (use_mmap(size))
+	{
+		return mmap_malloc(size, dsize);
+	}
+
+	asize = get_asize(size);
+#ifdef MM_CONCURRENT
+	thread_init();
+	if (asize <= TCACHE_MAX_SIZE)
+	{
+		size_t i = (asize - min_block_size) / dsize;
+		if ((bp = tcache.bins[i]) != NULL)
+		{
+			tcache.bins[i] = *(void **)bp;
+			tcache.count[i]--;
+			return bp;
+		}
+	}
+	lock_arena(home_arena);
+	drain_remote_frees();
+	bp = arena_malloc(asize);
+	unlock_arena();
+	// the home arena's region is exhausted, borrow from the others
+	for (int i = 1; bp == NULL && i < MM_NARENAS; i++)
+	{
+		lock_arena(&arenas[(home_arena - arenas + i) % MM_NARENAS]);
+		bp = arena_malloc(asize);
+		unlock_arena();
+	}
+#else
+#ifdef MM_SLAB
+	if (size <= SLAB_MAX_SIZE && (bp = slab_malloc(size)) != NULL)
+		return bp;
+	if ((bp = arena_malloc(asize)) != NULL)
+		count_small_block(payload_to_header(bp), 1);
+#else
+	bp = arena_malloc(asize);
+#endif
+#endif
+
+	return bp;
+}
+
+void free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	block_t *block = payload_to_header(bp);
+	if (is_mmapped(bp))
+	{
+		mmap_free(block);
+		return;
+	}
+#ifdef MM_CONCURRENT
+	// read without the lock: while the block is allocated only its prev_alloc
+	// bit can change under us, never the size
+	size_t size = get_size(block);
+
+	thread_init();
+	// cached blocks stay allocated as far as their arena is concerned
+	if (size <= TCACHE_MAX_SIZE)
+	{
+		size_t i = (size - min_block_size) / dsize;
+		if (tcache.count[i] < TCACHE_COUNT)
+		{
+			*(void **)bp = tcache.bins[i];
+			tcache.bins[i] = bp;
+			tcache.count[i]++;
+			return;
+		}
+	}
+	free_to_owner(block);
+#else
+#ifdef MM_SLAB
+	slab_t *slab = slab_of(bp);
+	if (slab != NULL)
+	{
+		slab_free(slab, bp);
+		return;
+	}
+	count_small_block(block, -1);
+#endif
+	arena_free(block);
+#endif
+}
+
+// size is the size last asked for bp, which saves reading the header on
+// the way in: a block asked smaller than MM_MMAP_THRESHOLD is never mapped,
+// one larger than SLAB_MAX_SIZE never lies in a slab, and a thread cache
+// bin can be picked from size alone
+void free_sized(void *bp, size_t size)
+{
+	if (bp == NULL)
+		return;
+	if (use_mmap(size))
+	{
+		// mapped, or a large memalign block on the heap
+		free(bp);
+		return;
+	}
+
+	block_t *block = payload_to_header(bp);
+#ifdef MM_CONCURRENT
+	size_t asize = get_asize(size);
+
+	thread_init();
+	// the block may be larger than asize, which only wastes its tail
+	if (asize <= TCACHE_MAX_SIZE)
+	{
+		size_t i = (asize - min_block_size) / dsize;
+		if (tcache.count[i] < TCACHE_COUNT)
+		{
+			*(void **)bp = tcache.bins[i];
+			tcache.bins[i] = bp;
+			tcache.count[i]++;
+			return;
+		}
+	}
+	free_to_owner(block);
+#else
+#ifdef MM_SLAB
+	slab_t *slab;
+	if (size <= SLAB_MAX_SIZE && (slab = slab_of(bp)) != NULL)
+	{
+		slab_free(slab, bp);
+		return;
+	}
+	count_small_block(block, -1);
+#endif
+	arena_free(block);
+#endif
+}
+
+// free n blocks at once; ptrs is overwritten. Mapped blocks and slab
+// objects are freed one by one, the heap blocks in one pass that merges
+// neighbours before anything goes onto the free lists. Under MM_CONCURRENT
+// the batch bypasses the thread cache, and the blocks of other arenas go
+// onto their remote free lists
+void free_batch(void **ptrs, size_t n)
+{
+	size_t nheap = 0;
+
+#ifdef MM_CONCURRENT
+	thread_init();
+#endif
+	for (size_t i = 0; i < n; i++)
+	{
+		void *bp = ptrs[i];
+
+		if (bp == NULL)
+			continue;
+#ifdef MM_SLAB
+		slab_t *slab = slab_of(bp);
+		if (slab != NULL)
+		{
+			slab_free(slab, bp);
+			continue;
+		}
+#endif
+		block_t *block = payload_to_header(bp);
+		if (block->header & mmap_mask)
+		{
+			mmap_free(block);
+			continue;
+		}
+#ifdef MM_CONCURRENT
+		if (arena_of(block) != home_arena)
+		{
+			free_to_owner(block);
+			continue;
+		}
+#endif
+#ifdef MM_SLAB
+		count_small_block(block, -1);
+#endif
+		ptrs[nheap++] = bp;
+	}
+	if (nheap == 0)
+		return;
+
+#ifdef MM_CONCURRENT
+	lock_arena(home_arena);
+	arena_free_batch(ptrs, nheap);
+	unlock_arena();
+#else
+	arena_free_batch(ptrs, nheap);
+#endif
+}
+
+void *realloc(void *old_bp, size_t size)
+{
+	block_t *block = payload_to_header(old_bp);
+	size_t oldsize;
+	bool resized;
+	void *new_bp;
+
+	/* If size == 0 then this is just free, and we return NULL. */
+	if(size == 0) 
+	{
+		free(old_bp);
+		return NULL;
+	}
+
+	/* If old_bp is NULL, then this is just malloc. */
+	if(old_bp == NULL) 
+	{
+		return malloc(size);
+	}
+
+	/* A block with a mapping of its own is remapped. */
+	if(is_mmapped(old_bp))
+	{
+		return mmap_realloc(block, size);
+	}
+
+	/* Try to resize in place first, so nothing has to be copied. */
+#ifdef MM_CONCURRENT
+	oldsize = get_payload_size(block);
+	lock_arena(arena_of(block));
+	resized = arena_resize(block, get_asize(size));
+	unlock_arena();
+#elif defined(MM_SLAB)
+	slab_t *slab = slab_of(old_bp);
+	if (slab != NULL)
+	{
+		/* A slab object stays put within its size class. */
+		oldsize = slab->osize;
+		resized = slab_class(size) == slab_class(oldsize);
+	}
+	else
+	{
+		oldsize = get_payload_size(block);
+		count_small_block(block, -1);
+		resized = arena_resize(block, get_asize(size));
+		count_small_block(block, 1);
+	}
+#else
+	oldsize = get_payload_size(block);
+	resized = arena_resize(block, get_asize(size));
+#endif
+	if(size < oldsize) 
+		oldsize = size;
+	if(resized)
+	{
+		realloc_avoided += oldsize;
+		return old_bp;
+	}
+
+	new_bp = malloc(size);
+
+	/* If realloc() fails the original block is left untouched  */
+	if(!new_bp) 
+	{
+		return NULL;
+	}
+
+	/* Copy the old data. */
+	memcpy(new_bp, old_bp, oldsize);
+	realloc_copied += oldsize;
+
+	/* Free the old block. */
+	free(old_bp);
+
+	return new_bp;
+}
+
+// alignment is a power of two; the block comes from the heap unless it is
+// large and needs no more than a page's alignment
+void *memalign(size_t alignment, size_t size)
+{
+	void *bp;
+
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	if (alignment <= dsize)
+		return malloc(size);
+	if (size == 0)
+		return NULL;
+	if (use_mmap(size) && alignment <= mem_pagesize())
+		return mmap_malloc(size, alignment);
+
+	size_t asize = get_asize(size);
+#ifdef MM_CONCURRENT
+	thread_init();
+	lock_arena(home_arena);
+	drain_remote_frees();
+	bp = arena_malloc_aligned(asize, alignment);
+	unlock_arena();
+	for (int i = 1; bp == NULL && i < MM_NARENAS; i++)
+	{
+		lock_arena(&arenas[(home_arena - arenas + i) % MM_NARENAS]);
+		bp = arena_malloc_aligned(asize, alignment);
+		unlock_arena();
+	}
+#else
+	bp = arena_malloc_aligned(asize, alignment);
+#ifdef MM_SLAB
+	if (bp != NULL)
+		count_small_block(payload_to_header(bp), 1);
+#endif
+#endif
+	return bp;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *bp;
+
+	if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	if (size == 0)
+	{
+		*memptr = NULL;
+		return 0;
+	}
+	if ((bp = memalign(alignment, size)) == NULL)
+		return ENOMEM;
+	*memptr = bp;
+	return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+// clears only what may not read as zeros already, see arena_calloc
+void *calloc(size_t nmemb, size_t size)
+{
+	size_t n = nmemb * size;
+	void *bp;
+
+	// Multiplication overflowed
+	if (size != 0 && n / size != nmemb)
+		return NULL;
+
+	// a new mapping is fresh pages
+	if (use_mmap(n))
+	{
+		if ((bp = mmap_malloc(n, dsize)) != NULL)
+			calloc_skipped += n;
+		return bp;
+	}
+	// slab objects and cached blocks are cleared in full
+#if defined(MM_SLAB)
+	if (n <= SLAB_MAX_SIZE)
+#elif defined(MM_CONCURRENT)
+	if (n == 0 || get_asize(n) <= TCACHE_MAX_SIZE)
+#else
+	if (n == 0)
+#endif
+	{
+		if ((bp = malloc(n)) != NULL)
+		{
+			memset(bp, 0, n);
+			calloc_cleared += n;
+		}
+		return bp;
+	}
+
+	size_t asize = get_asize(n);
+#ifdef MM_CONCURRENT
+	thread_init();
+	lock_arena(home_arena);
+	drain_remote_frees();
+	bp = arena_calloc(asize, n);
+	unlock_arena();
+	for (int i = 1; bp == NULL && i < MM_NARENAS; i++)
+	{
+		lock_arena(&arenas[(home_arena - arenas + i) % MM_NARENAS]);
+		bp = arena_calloc(asize, n);
+		unlock_arena();
+	}
+#elif defined(MM_SLAB)
+	if ((bp = arena_calloc(asize, n)) != NULL)
+		count_small_block(payload_to_header(bp), 1);
+#else
+	bp = arena_calloc(asize, n);
+#endif
+	return bp;
+}
+
+#ifndef MM_TLSF
+// check order and priorities below offset t, return the number of nodes
+static size_t check_tree(uint32_t t, uint32_t parent, block_t *lo, block_t *hi)
+{
+    if (t == 0)
+    {
+        return 0;
+    }
+    block_t *node = deref_heap_offset(t);
+    if (!use_tree(get_size(node)) || get_is_alloc(node))
+    {
+        printf("block[%p] does not belong in the tree\n", node);
+    }
+    if ((lo != NULL && !tree_less(lo, node)) || (hi != NULL && !tree_less(node, hi)))
+    {
+        printf("block[%p] out of order in the tree\n", node);
+    }
+    if (parent != 0 && tree_priority(t) > tree_priority(parent))
+    {
+        printf("block[%p] has a higher priority than its parent\n", node);
+    }
+    return 1 + check_tree(node->left_offset, t, lo, node)
+             + check_tree(node->right_offset, t, node, hi);
+}
+#endif
+
+#ifdef MM_SLAB
+// check the bitmap and free count of one slab
+static void check_slab(slab_t *slab)
+{
+	size_t nfree = 0;
+
+	if (get_size(payload_to_header(slab)) < SLAB_SIZE)
+	{
+		printf("slab[%p] block is only %zu bytes\n", slab, get_size(payload_to_header(slab)));
+	}
+	for (size_t i = 0; i < SLAB_MAP_WORDS * 64; i++)
+	{
+		bool used = (slab->used[i / 64] >> (i % 64)) & 1;
+		if (used)
+			continue;
+		if (i >= slab->nobj)
+			printf("slab[%p] object %zu past the end is free\n", slab, i);
+		if (i / 64 < slab->hint)
+			printf("slab[%p] free object %zu before the hint\n", slab, i);
+		nfree++;
+	}
+	if (nfree != slab->nfree)
+	{
+		printf("slab[%p] has %zu free objects, counted %u\n", slab, nfree, slab->nfree);
+	}
+}
+#endif
+
+void mm_checkheap(int verbose) 
+{
+#ifdef MM_CONCURRENT
+    // check the calling thread's arena
+    if (arena == NULL)
+    {
+        thread_init();
+        lock_arena(home_arena);
+        mm_checkheap(verbose);
+        unlock_arena();
+        return;
+    }
+#endif
+    if (!arena->heap_listp) 
+	{
+        printf("NULL heap list pointer!\n");
+        return;
+    }
+
+    block_t *curr = arena->heap_listp;
+    block_t *next;
+    // the last byte of this arena's region, not of the highest one grown
+    block_t *hi = (block_t *) ((unsigned char *) mem_region_sbrk(arena->region, 0) - 1);
+    block_t *curr_free;
+
+    size_t n_free = 0, n_free_seg = 0;
+    if (!get_is_alloc(curr))
+    {
+        n_free += 1;
+    }
+    printf("heap size %lu\n", mem_heapsize());
+    while ((next = find_next(curr)) + 1 < hi) {
+        word_t hdr = curr->header;
+		if (!get_is_alloc(curr))
+		{
+			word_t ftr = *get_prev_footer(next);
+
+			if (hdr != (ftr & ~zero_mask)) {
+				printf("Header (0x%08X) != footer (0x%08X)\n", hdr, ftr);
+			}
+			// a block marked zero must read as zeros past its links
+			if (ftr & zero_mask)
+			{
+				for (unsigned char *p = (unsigned char *) curr + sizeof(block_t); p < (unsigned char *) next - wsize; p++)
+				{
+					if (*p != 0)
+					{
+						printf("free block %p marked zero has a nonzero byte at %p\n", curr, p);
+						break;
+					}
+				}
+			}
+		}
+		else
+		{
+			size_t hdr_size = get_size(curr);
+			size_t actual_size = min_block_size * (next - curr);
+			if (hdr_size != actual_size)
+			{
+				printf("check size %d and %d for alloc block %p\n", hdr_size, actual_size, curr);
+			}
+
+			word_t any_footer = *get_prev_footer(next);
+			if (hdr_size == extract_size(any_footer))
 			{
 				printf("accidentally have footer for alloc block %p\n", curr);
 			}
+#ifdef MM_SLAB
+			slab_t *slab = slab_of(header_to_payload(curr));
+			if (slab != NULL && (void *) slab != header_to_payload(curr))
+			{
+				printf("alloc block %p inside slab %p\n", curr, slab);
+			}
+			else if (slab != NULL)
+			{
+				check_slab(slab);
+			}
+#endif
 		}
 
 		if (!get_is_alloc(curr) && !get_is_alloc(next))
@@ -698,10 +2479,34 @@ void mm_checkheap(int verbose)
         }
         curr = next;
     }
+#ifdef MM_TLSF
+    for (unsigned fl = 0; fl < TLSF_FL; fl++)
+    {
+        for (unsigned sl = 0; sl < TLSF_SL; sl++)
+        {
+            uint32_t offset = arena->heads[fl][sl];
+            if ((offset != 0) != ((arena->sl_bitmap[fl] >> sl) & 1))
+            {
+                printf("bitmap out of sync for list (%u, %u)\n", fl, sl);
+            }
+            for (uint32_t prev = 0; offset != 0; prev = offset, offset = deref_heap_offset(offset)->next_offset)
+            {
+                unsigned block_fl, block_sl;
+                block_t *curr_block = deref_heap_offset(offset);
+                tlsf_mapping(get_size(curr_block), &block_fl, &block_sl);
+                if (block_fl != fl || block_sl != sl || curr_block->prev_offset != prev)
+                {
+                    printf("block[%p] misplaced in list (%u, %u)\n", curr_block, fl, sl);
+                }
+                n_free_seg += 1;
+            }
+        }
+    }
+#endif
     size_t i = 0;
-    while (i < nseg)
+    while (i < nsentinel)
     {
-        curr_free = seg_free_list + i;
+        curr_free = arena->seg_free_list + i;
         i++;
         block_t *curr_block = deref_heap_offset(curr_free->next_offset);
         if (curr_block == curr_free)
@@ -721,6 +2526,24 @@ void mm_checkheap(int verbose)
             curr_block = next_block;
         }
     }
+#ifndef MM_TLSF
+    n_free_seg += check_tree(arena->tree_root, 0, NULL, NULL);
+#endif
+#ifdef MM_SLAB
+    for (size_t c = 0; c < SLAB_NCLASS; c++)
+    {
+        uint32_t prev = 0;
+        for (uint32_t page = arena->slabs[c]; page != 0; page = deref_slab_page(page)->next_page)
+        {
+            slab_t *slab = deref_slab_page(page);
+            if (slab_of(slab) != slab || slab_class(slab->osize) != c || slab->prev_page != prev || slab->nfree == 0)
+            {
+                printf("slab[%p] misplaced in the list of class %zu\n", slab, c);
+            }
+            prev = page;
+        }
+    }
+#endif
     if (n_free != n_free_seg)
     {
         printf("inconsistent number of free blocks between heap %d and segregated free lists %d\n", n_free, n_free_seg);
@@ -0,0 +1,546 @@
+/*
+ * mm-policy.c
+ * one allocator, specialized at compile time by the policy constants
+ * below; each mm-<variant>.c sets a policy and includes this file
+ *
+ * MM_FREE_LIST   0: implicit list, a fit walks every block of the heap
+ *                1: explicit doubly linked free lists, MM_NBUCKETS of them
+ *                   segregated by size: [min block], then (2^k, 2^(k+1)],
+ *                   the last one holding everything larger
+ * MM_ORDER       MM_ORDER_LIFO: freed blocks go to the front of their list
+ *                MM_ORDER_ADDRESS: lists are kept in address order
+ * MM_FIT         MM_FIT_FIRST: the first block that fits
+ *                MM_FIT_BEST: the smallest block that fits
+ *                MM_FIT_GOOD: the smallest of the first MM_FIT_SCAN + 1
+ *                blocks that fit
+ * MM_FOOTERS     1: every block has a footer
+ *                0: only free blocks do; bit 1 of a header tells whether
+ *                   the block before it is allocated
+ * MM_OFFSETS     0: 8-byte headers and list pointers, 16-byte alignment
+ *                1: 4-byte headers and 32-bit list offsets from the start
+ *                   of the heap, 8-byte alignment
+ *
+ * The policy is all constants, so every branch on it folds away and each
+ * variant is as specialized as a hand-written one. The functions are named
+ * <MM_PREFIX>_init, _malloc, ... so that several variants link into one
+ * driver (see mm-variants.h); without MM_PREFIX they are mm_init, ...
+ *
+ * Block layout: header, payload, and a footer if the block is free or
+ * MM_FOOTERS is set. A free block on an explicit list keeps the previous
+ * and next links at the start of its payload. The list heads sit at the
+ * start of the heap, before the prologue.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm-variants.h"
+
+#define MM_ORDER_LIFO 0
+#define MM_ORDER_ADDRESS 1
+
+#define MM_FIT_FIRST 0
+#define MM_FIT_BEST 1
+#define MM_FIT_GOOD 2
+
+/* the default policy is that of mm-segregated.c */
+#ifndef MM_FREE_LIST
+#define MM_FREE_LIST 1
+#endif
+#ifndef MM_NBUCKETS
+#define MM_NBUCKETS 15
+#endif
+#ifndef MM_ORDER
+#define MM_ORDER MM_ORDER_LIFO
+#endif
+#ifndef MM_FIT
+#define MM_FIT MM_FIT_FIRST
+#endif
+#ifndef MM_FIT_SCAN
+#define MM_FIT_SCAN 10
+#endif
+#ifndef MM_FOOTERS
+#define MM_FOOTERS 0
+#endif
+#ifndef MM_OFFSETS
+#define MM_OFFSETS 0
+#endif
+
+#ifdef MM_PREFIX
+#define MM_CAT2(a, b) a##_##b
+#define MM_CAT(a, b) MM_CAT2(a, b)
+#define MM_NAME(f) MM_CAT(MM_PREFIX, f)
+#else
+#define MM_NAME(f) mm_##f
+#endif
+
+/* a description of the policy, for the driver's tables */
+#define MM_STR2(x) #x
+#define MM_STR(x) MM_STR2(x)
+#if MM_FREE_LIST == 0
+#define MM_LIST_STR "implicit list"
+#elif MM_NBUCKETS == 1
+#define MM_LIST_STR "explicit list"
+#else
+#define MM_LIST_STR MM_STR(MM_NBUCKETS) " segregated lists"
+#endif
+#if MM_FREE_LIST == 0
+#define MM_ORDER_STR ""
+#elif MM_ORDER == MM_ORDER_ADDRESS
+#define MM_ORDER_STR ", address order"
+#else
+#define MM_ORDER_STR ", LIFO"
+#endif
+#if MM_FIT == MM_FIT_BEST
+#define MM_FIT_STR ", best fit"
+#elif MM_FIT == MM_FIT_GOOD
+#define MM_FIT_STR ", best of " MM_STR(MM_FIT_SCAN) " fits"
+#else
+#define MM_FIT_STR ", first fit"
+#endif
+
+const char MM_NAME(policy)[] = MM_LIST_STR MM_ORDER_STR MM_FIT_STR
+#if MM_FOOTERS
+	", footers"
+#endif
+#if MM_OFFSETS
+	", 4-byte tags and offsets"
+#endif
+	;
+
+#if MM_OFFSETS
+typedef uint32_t tag_t;		/* a header or footer */
+typedef uint32_t link_t;	/* offset of a free block from heap_base, 0 for none */
+#else
+typedef uint64_t tag_t;
+typedef uintptr_t link_t;	/* address of a free block, 0 for none */
+#endif
+
+typedef struct block
+{
+	tag_t header;
+	unsigned char payload[0];
+} block_t;
+
+static const size_t tsize = sizeof(tag_t);
+static const size_t align = 2 * sizeof(tag_t);
+static const size_t chunksize = 1 << 8;
+
+/* header and footer, and the two links if the block goes on a list */
+static const size_t min_block_size = 2 * sizeof(tag_t) + (MM_FREE_LIST ? 2 * sizeof(link_t) : 0);
+
+static const tag_t alloc_mask = 0x1;
+static const tag_t prev_alloc_mask = 0x2;
+static const tag_t size_mask = ~(tag_t)0x7;
+
+static unsigned char *heap_base = NULL;
+static block_t *heap_listp = NULL;	/* the prologue */
+static link_t *heads = NULL;		/* MM_NBUCKETS list heads */
+
+static size_t max(size_t x, size_t y)
+{
+	return (x > y) ? x : y;
+}
+
+static size_t round_up(size_t size, size_t n)
+{
+	return n * ((size + n - 1) / n);
+}
+
+static size_t get_asize(size_t size)
+{
+	return max(round_up(size + tsize + (MM_FOOTERS ? tsize : 0), align), min_block_size);
+}
+
+static tag_t pack(size_t size, bool alloc, bool prev_alloc)
+{
+	return size | (alloc ? alloc_mask : 0) | (prev_alloc ? prev_alloc_mask : 0);
+}
+
+static size_t get_size(block_t *block)
+{
+	return block->header & size_mask;
+}
+
+static bool get_alloc(block_t *block)
+{
+	return block->header & alloc_mask;
+}
+
+static bool get_prev_alloc(block_t *block)
+{
+	if (MM_FOOTERS)
+		return ((tag_t *) block)[-1] & alloc_mask;
+	return block->header & prev_alloc_mask;
+}
+
+static tag_t *get_footer(block_t *block)
+{
+	return (tag_t *) ((unsigned char *) block + get_size(block) - tsize);
+}
+
+static size_t get_payload_size(block_t *block)
+{
+	return get_size(block) - tsize - (MM_FOOTERS ? tsize : 0);
+}
+
+static block_t *payload_to_header(void *bp)
+{
+	return (block_t *) ((unsigned char *) bp - offsetof(block_t, payload));
+}
+
+static block_t *find_next(block_t *block)
+{
+	return (block_t *) ((unsigned char *) block + get_size(block));
+}
+
+/* only valid if the previous block has a footer */
+static block_t *find_prev(block_t *block)
+{
+	tag_t footer = ((tag_t *) block)[-1];
+	return (block_t *) ((unsigned char *) block - (footer & size_mask));
+}
+
+static void write_block(block_t *block, size_t size, bool alloc, bool prev_alloc)
+{
+	block->header = pack(size, alloc, prev_alloc);
+	if (MM_FOOTERS || !alloc)
+		*get_footer(block) = block->header;
+}
+
+static void write_epilogue(block_t *block, bool prev_alloc)
+{
+	block->header = pack(0, true, prev_alloc);
+}
+
+/* tell the block after block whether block is allocated */
+static void set_next_prev_alloc(block_t *block, bool alloc)
+{
+	block_t *next = find_next(block);
+
+	if (MM_FOOTERS)
+		return;
+	next->header = alloc ? (next->header | prev_alloc_mask) : (next->header & ~prev_alloc_mask);
+	if (!get_alloc(next))
+		*get_footer(next) = next->header;
+}
+
+/*
+ * Free lists
+ */
+static block_t *to_block(link_t link)
+{
+	if (MM_OFFSETS)
+		return link ? (block_t *) (heap_base + link) : NULL;
+	return (block_t *) (uintptr_t) link;
+}
+
+static link_t to_link(block_t *block)
+{
+	if (MM_OFFSETS)
+		return block ? (link_t) ((unsigned char *) block - heap_base) : 0;
+	return (link_t) (uintptr_t) block;
+}
+
+static link_t *get_links(block_t *block)
+{
+	return (link_t *) block->payload;	/* prev, next */
+}
+
+static int get_bucket(size_t size)
+{
+	int i;
+
+	if (MM_NBUCKETS == 1 || size <= min_block_size)
+		return 0;
+	/* ceil(log2(size)) - log2(min_block_size) */
+	i = (64 - __builtin_clzl(size - 1)) - __builtin_ctzl(min_block_size);
+	return i < MM_NBUCKETS ? i : MM_NBUCKETS - 1;
+}
+
+static void insert_free_block(block_t *block)
+{
+	link_t *head;
+	block_t *prev = NULL, *next;
+
+	if (!MM_FREE_LIST)
+		return;
+	head = &heads[get_bucket(get_size(block))];
+	next = to_block(*head);
+	if (MM_ORDER == MM_ORDER_ADDRESS)
+	{
+		while (next != NULL && next < block)
+		{
+			prev = next;
+			next = to_block(get_links(next)[1]);
+		}
+	}
+	get_links(block)[0] = to_link(prev);
+	get_links(block)[1] = to_link(next);
+	if (prev != NULL)
+		get_links(prev)[1] = to_link(block);
+	else
+		*head = to_link(block);
+	if (next != NULL)
+		get_links(next)[0] = to_link(block);
+}
+
+static void remove_free_block(block_t *block)
+{
+	block_t *prev, *next;
+
+	if (!MM_FREE_LIST)
+		return;
+	prev = to_block(get_links(block)[0]);
+	next = to_block(get_links(block)[1]);
+	if (prev != NULL)
+		get_links(prev)[1] = get_links(block)[1];
+	else
+		heads[get_bucket(get_size(block))] = get_links(block)[1];
+	if (next != NULL)
+		get_links(next)[0] = get_links(block)[0];
+}
+
+/*
+ * Fits. The buckets hold disjoint, growing size ranges, so the best fit
+ * in the first bucket with any fit is the best fit overall.
+ */
+static block_t *find_fit(size_t asize)
+{
+	block_t *block, *best = NULL;
+	size_t size, best_size = SIZE_MAX;
+	int fits = 0, i;
+
+	for (i = MM_FREE_LIST ? get_bucket(asize) : 0; i < (MM_FREE_LIST ? MM_NBUCKETS : 1); i++)
+	{
+		block = MM_FREE_LIST ? to_block(heads[i]) : heap_listp;
+		while (MM_FREE_LIST ? block != NULL : get_size(block) > 0)
+		{
+			size = get_size(block);
+			if ((MM_FREE_LIST || !get_alloc(block)) && size >= asize)
+			{
+				if (MM_FIT == MM_FIT_FIRST || size == asize)
+					return block;
+				if (size < best_size)
+				{
+					best = block;
+					best_size = size;
+				}
+				if (MM_FIT == MM_FIT_GOOD && ++fits > MM_FIT_SCAN)
+					return best;
+			}
+			block = MM_FREE_LIST ? to_block(get_links(block)[1]) : find_next(block);
+		}
+		if (best != NULL)
+			return best;
+	}
+	return NULL;
+}
+
+/* Merge a free block that is on no list with its free neighbours and
+   put the result on its list */
+static block_t *coalesce_block(block_t *block)
+{
+	block_t *next = find_next(block);
+	block_t *prev;
+	size_t size = get_size(block);
+
+	if (!get_alloc(next))
+	{
+		remove_free_block(next);
+		size += get_size(next);
+	}
+	if (!get_prev_alloc(block))
+	{
+		prev = find_prev(block);
+		remove_free_block(prev);
+		size += get_size(prev);
+		block = prev;
+	}
+	/* the block before a free block is always allocated */
+	write_block(block, size, false, true);
+	insert_free_block(block);
+	set_next_prev_alloc(block, false);
+	return block;
+}
+
+static block_t *extend_heap(size_t size)
+{
+	void *bp;
+	block_t *block;
+
+	size = round_up(size, align);
+	if ((bp = mem_sbrk(size)) == (void *)-1)
+		return NULL;
+
+	/* the old epilogue becomes the header of the new block */
+	block = payload_to_header(bp);
+	write_block(block, size, false, get_prev_alloc(block));
+	write_epilogue(find_next(block), false);
+	return coalesce_block(block);
+}
+
+static void place(block_t *block, size_t asize)
+{
+	size_t size = get_size(block);
+	block_t *rest;
+
+	remove_free_block(block);
+	if (size - asize >= min_block_size)
+	{
+		write_block(block, asize, true, true);
+		rest = find_next(block);
+		write_block(rest, size - asize, false, true);
+		insert_free_block(rest);
+	}
+	else
+	{
+		write_block(block, size, true, true);
+		set_next_prev_alloc(block, true);
+	}
+}
+
+int MM_NAME(init)(void)
+{
+	size_t heads_size = MM_FREE_LIST ? round_up(MM_NBUCKETS * sizeof(link_t), align) : 0;
+	unsigned char *start;
+
+	/* list heads, then a prologue of one aligned header and footer with
+	   the payload alignment, then the epilogue */
+	if ((start = mem_sbrk(heads_size + 2 * align)) == (void *)-1)
+		return -1;
+	heap_base = start;
+	heads = (link_t *) start;
+	if (MM_FREE_LIST)
+		memset(heads, 0, MM_NBUCKETS * sizeof(link_t));
+
+	heap_listp = (block_t *) (start + heads_size + align - tsize);
+	heap_listp->header = pack(align, true, true);
+	*get_footer(heap_listp) = heap_listp->header;
+	write_epilogue(find_next(heap_listp), true);
+
+	if (extend_heap(chunksize) == NULL)
+		return -1;
+	return 0;
+}
+
+void *MM_NAME(malloc)(size_t size)
+{
+	size_t asize;
+	block_t *block;
+
+	if (size == 0)
+		return NULL;
+	if (heap_listp == NULL && MM_NAME(init)() < 0)
+		return NULL;
+
+	asize = get_asize(size);
+	if ((block = find_fit(asize)) == NULL &&
+			(block = extend_heap(max(asize, chunksize))) == NULL)
+		return NULL;
+	place(block, asize);
+	return block->payload;
+}
+
+void MM_NAME(free)(void *bp)
+{
+	block_t *block;
+
+	if (bp == NULL)
+		return;
+	block = payload_to_header(bp);
+	write_block(block, get_size(block), false, get_prev_alloc(block));
+	coalesce_block(block);
+}
+
+void *MM_NAME(realloc)(void *old_bp, size_t size)
+{
+	size_t oldsize;
+	void *new_bp;
+
+	/* If size == 0 then this is just free, and we return NULL. */
+	if (size == 0)
+	{
+		MM_NAME(free)(old_bp);
+		return NULL;
+	}
+
+	/* If old_bp is NULL, then this is just malloc. */
+	if (old_bp == NULL)
+		return MM_NAME(malloc)(size);
+
+	/* If realloc() fails the original block is left untouched  */
+	if ((new_bp = MM_NAME(malloc)(size)) == NULL)
+		return NULL;
+
+	oldsize = get_payload_size(payload_to_header(old_bp));
+	memcpy(new_bp, old_bp, size < oldsize ? size : oldsize);
+	MM_NAME(free)(old_bp);
+	return new_bp;
+}
+
+void *MM_NAME(calloc)(size_t nmemb, size_t size)
+{
+	size_t asize = nmemb * size;
+	void *bp;
+
+	if (nmemb != 0 && asize / nmemb != size)
+		return NULL;
+	if ((bp = MM_NAME(malloc)(asize)) != NULL)
+		memset(bp, 0, asize);
+	return bp;
+}
+
+/*
+ * Walks the heap and the lists: alignment, tags, no two free blocks in a
+ * row, prev_alloc bits, and every free block on the right list once
+ */
+void MM_NAME(checkheap)(int lineno)
+{
+	block_t *block, *prev;
+	size_t nfree = 0, nlisted = 0;
+	bool prev_alloc = true;
+	int i;
+
+	if (heap_listp == NULL)
+	{
+		printf("%d: NULL heap list pointer!\n", lineno);
+		return;
+	}
+	for (block = find_next(heap_listp); get_size(block) > 0; block = find_next(block))
+	{
+		if ((uintptr_t) block->payload % align != 0)
+			printf("%d: payload %p is not aligned\n", lineno, (void *) block->payload);
+		if ((MM_FOOTERS || !get_alloc(block)) && block->header != *get_footer(block))
+			printf("%d: header and footer of %p differ\n", lineno, (void *) block);
+		if (!MM_FOOTERS && get_prev_alloc(block) != prev_alloc)
+			printf("%d: wrong prev_alloc bit at %p\n", lineno, (void *) block);
+		if (!prev_alloc && !get_alloc(block))
+			printf("%d: free blocks %p and the one before not coalesced\n", lineno, (void *) block);
+		prev_alloc = get_alloc(block);
+		nfree += !prev_alloc;
+	}
+	if (!MM_FREE_LIST)
+		return;
+	for (i = 0; i < MM_NBUCKETS; i++)
+	{
+		prev = NULL;
+		for (block = to_block(heads[i]); block != NULL; block = to_block(get_links(block)[1]))
+		{
+			if (get_alloc(block) || get_bucket(get_size(block)) != i)
+				printf("%d: %p does not belong on list %d\n", lineno, (void *) block, i);
+			if (to_block(get_links(block)[0]) != prev)
+				printf("%d: bad prev link at %p\n", lineno, (void *) block);
+			if (MM_ORDER == MM_ORDER_ADDRESS && prev != NULL && prev > block)
+				printf("%d: list %d out of address order\n", lineno, i);
+			prev = block;
+			nlisted++;
+		}
+	}
+	if (nlisted != nfree)
+		printf("%d: %zu free blocks but %zu on the lists\n", lineno, nfree, nlisted);
+}
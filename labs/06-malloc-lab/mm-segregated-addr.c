@@ -0,0 +1,14 @@
+/*
+ * mm-segregated-addr.c
+ * segregated free lists (15 buckets)
+ * kept in address order, first fit
+ * footers only on free blocks
+ *
+ * generated from mm-policy.c, see there for the policy constants
+ */
+#define MM_FREE_LIST 1
+#define MM_NBUCKETS 15
+#define MM_ORDER MM_ORDER_ADDRESS
+#define MM_FIT MM_FIT_FIRST
+#define MM_FOOTERS 0
+#include "mm-policy.c"
@@ -0,0 +1,29 @@
+/*
+ * mm-variants.c - the table of allocators built into mdriver
+ */
+#include <stddef.h>
+
+#include "mm.h"
+#include "mm-variants.h"
+
+/* Optional in mm.c */
+#pragma weak mm_memalign
+#pragma weak mm_free_sized
+#pragma weak mm_free_batch
+#pragma weak mm_realloc_stats
+#pragma weak mm_calloc_stats
+#pragma weak mm_stats
+
+#define MM_VARIANT_ENTRY(name) \
+	{ #name, name##_policy, name##_init, name##_malloc, name##_free, \
+	  name##_realloc, name##_calloc, name##_checkheap, \
+	  NULL, NULL, NULL, NULL, NULL, NULL },
+
+const mm_variant_t mm_variants[] = {
+	{ "mm", "mm.c", mm_init, mm_malloc, mm_free, mm_realloc, mm_calloc,
+	  mm_checkheap, mm_memalign, mm_free_sized, mm_free_batch,
+	  mm_realloc_stats, mm_calloc_stats, mm_stats },
+	MM_VARIANTS(MM_VARIANT_ENTRY)
+};
+
+const int mm_num_variants = sizeof(mm_variants) / sizeof(mm_variants[0]);
@@ -0,0 +1,54 @@
+/*
+ * mm-variants.h - the allocators built into mdriver
+ *
+ * Besides mm.c, every variant listed here is generated from mm-policy.c
+ * by mm-<variant>.c (with '_' for '-'), which sets its policy. The Makefile
+ * compiles each one with -DMM_PREFIX=<variant>; keep its VARIANTS in step.
+ * Include after mm.h.
+ */
+#ifndef __MM_VARIANTS_H__
+#define __MM_VARIANTS_H__
+
+#define MM_VARIANTS(V) \
+	V(implicit) \
+	V(implicit2) \
+	V(explicit) \
+	V(explicit_best) \
+	V(segregated) \
+	V(segregated_best) \
+	V(segregated_addr) \
+	V(compact)
+
+#define MM_DECLARE_VARIANT(name) \
+	extern const char name##_policy[]; \
+	extern int name##_init(void); \
+	extern void *name##_malloc(size_t size); \
+	extern void name##_free(void *ptr); \
+	extern void *name##_realloc(void *ptr, size_t size); \
+	extern void *name##_calloc(size_t nmemb, size_t size); \
+	extern void name##_checkheap(int lineno);
+MM_VARIANTS(MM_DECLARE_VARIANT)
+
+typedef struct {
+	const char *name;
+	const char *policy;
+	int (*init)(void);
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+	void *(*realloc)(void *ptr, size_t size);
+	void *(*calloc)(size_t nmemb, size_t size);
+	void (*checkheap)(int lineno);
+	/* NULL unless the package has them, like mm.c's */
+	void *(*memalign)(size_t alignment, size_t size);
+	void (*free_sized)(void *ptr, size_t size);
+	void (*free_batch)(void **ptrs, size_t n);
+	void (*realloc_stats)(size_t *copied, size_t *avoided);
+	void (*calloc_stats)(size_t *cleared, size_t *skipped);
+	void (*stats)(mm_stats_t *stats);
+} mm_variant_t;
+
+/* mm.c first, then MM_VARIANTS in order */
+extern const mm_variant_t mm_variants[];
+extern const int mm_num_variants;
+
+#endif /* __MM_VARIANTS_H__ */
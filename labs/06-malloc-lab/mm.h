@@ -8,6 +8,13 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+/* optional: only traces with aligned requests need mm_memalign */
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+/* optional: mdriver -z frees with these, or with mm_free without them */
+extern void mm_free_sized(void *ptr, size_t size);
+extern void mm_free_batch(void **ptrs, size_t n);
 
 #else
 
@@ -16,11 +23,50 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
+extern void free_sized(void *ptr, size_t size);
+extern void free_batch(void **ptrs, size_t n);
 
 #endif
 
 extern int mm_init(void);
 
+/* Payload bytes realloc copied and avoided copying since mm_init. Optional:
+   the driver checks for the symbol before calling it. */
+extern void mm_realloc_stats(size_t *copied, size_t *avoided);
+
+/* Bytes calloc cleared and bytes it knew read as zeros since mm_init.
+   Optional, like mm_realloc_stats. */
+extern void mm_calloc_stats(size_t *cleared, size_t *skipped);
+
+/* A snapshot of the allocator. Free blocks are counted per size class:
+   class i < 4 holds blocks of up to 16 * (i + 1) bytes, class i < 14 blocks of
+   up to 2^(i + 3) bytes and class 14 everything larger. */
+#define MM_STATS_NCLASS 15
+typedef struct {
+	size_t heap_size;       /* bytes of heap ... */
+	size_t mapped;          /* ... and of blocks mapped on their own */
+	size_t allocated;       /* bytes of allocated heap blocks, headers and slabs included */
+	size_t free_bytes;      /* bytes of free heap blocks ... */
+	size_t largest_free;    /* ... and of the largest one */
+	double fragmentation;   /* 1 - largest_free / free_bytes */
+	size_t class_count[MM_STATS_NCLASS];
+	size_t class_bytes[MM_STATS_NCLASS];
+	/* counted since mm_init */
+	size_t splits;          /* blocks split in two */
+	size_t coalesces;       /* free neighbours merged */
+	size_t extends;         /* heap extensions ... */
+	size_t trims;           /* ... and trims */
+} mm_stats_t;
+
+/* Fill in stats by walking the heap. Optional, like mm_realloc_stats. */
+extern void mm_stats(mm_stats_t *stats);
+
+/* Returns 1. Only thread-safe builds define it; mdriver -T requires it. */
+extern int mm_thread_safe(void);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int lineno);
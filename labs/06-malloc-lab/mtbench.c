@@ -0,0 +1,171 @@
+/*
+ * mtbench.c - multithreaded benchmark for the concurrent allocator
+ *
+ * Runs the same multithreaded workload against mm.c built with
+ * -DMM_CONCURRENT and against the libc allocator, for 1, 2, 4, ... threads.
+ * Two phases per run:
+ *   churn   - each thread repeatedly frees and reallocates random slots of
+ *             its own working set (thread-local traffic)
+ *   handoff - each thread allocates a batch that its neighbour frees
+ *             (every free is a remote free)
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define NSLOTS 256          // live blocks per thread during churn
+#define BATCH 64            // blocks handed to the neighbour per round
+#define MAX_THREADS 32
+
+typedef struct {
+	const char *name;
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+} allocator_t;
+
+static const allocator_t allocators[] = {
+	{ "mm", mm_malloc, mm_free },
+	{ "libc", malloc, free },
+};
+
+static const allocator_t *alloc;
+static int nthreads;
+static long nops;
+static pthread_barrier_t barrier;
+static void *mailbox[MAX_THREADS][BATCH];
+
+static unsigned long xorshift(unsigned long *state)
+{
+	unsigned long x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+// mostly small requests with an occasional larger one
+static size_t random_size(unsigned long *state)
+{
+	unsigned long r = xorshift(state);
+	if (r % 16 == 0)
+		return 256 + r / 16 % 768;
+	return 8 + r / 16 % 120;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *churn_thread(void *vargp)
+{
+	unsigned long state = 88172645463325252UL + (long)vargp;
+	void *slots[NSLOTS] = { NULL };
+
+	for (long n = 0; n < nops; n++)
+	{
+		unsigned long i = xorshift(&state) % NSLOTS;
+		size_t size = random_size(&state);
+		alloc->free(slots[i]);
+		slots[i] = alloc->malloc(size);
+		*(char *)slots[i] = (char)n;
+	}
+	for (int i = 0; i < NSLOTS; i++)
+		alloc->free(slots[i]);
+	return NULL;
+}
+
+static void *handoff_thread(void *vargp)
+{
+	long t = (long)vargp;
+	unsigned long state = 88172645463325252UL + t;
+
+	for (long n = 0; n < nops / BATCH; n++)
+	{
+		for (int i = 0; i < BATCH; i++)
+		{
+			mailbox[t][i] = alloc->malloc(random_size(&state));
+			*(char *)mailbox[t][i] = (char)i;
+		}
+		pthread_barrier_wait(&barrier);
+		for (int i = 0; i < BATCH; i++)
+			alloc->free(mailbox[(t + 1) % nthreads][i]);
+		pthread_barrier_wait(&barrier);
+	}
+	return NULL;
+}
+
+// total operations (mallocs and frees) per second over all threads
+static double run(void *(*fn)(void *))
+{
+	pthread_t tid[MAX_THREADS];
+	double start;
+
+	if (alloc->malloc == mm_malloc)
+		mm_init();
+	pthread_barrier_init(&barrier, NULL, nthreads);
+	start = now();
+	for (long t = 0; t < nthreads; t++)
+		pthread_create(&tid[t], NULL, fn, (void *)t);
+	for (int t = 0; t < nthreads; t++)
+		pthread_join(tid[t], NULL);
+	pthread_barrier_destroy(&barrier);
+	return 2.0 * nops * nthreads / (now() - start);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: mtbench [-n ops per thread] [-t max threads]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = MAX_THREADS;
+	int c;
+
+	nops = 200000;
+	while ((c = getopt(argc, argv, "n:t:h")) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			nops = atol(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			if (max_threads < 1 || max_threads > MAX_THREADS)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	mem_init();
+	printf("%ld ops per thread, %ld online CPUs\n", nops, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("threads  churn Mops/s (mm / libc)  handoff Mops/s (mm / libc)\n");
+	for (nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+	{
+		double result[2][2];
+		for (int a = 0; a < 2; a++)
+		{
+			alloc = &allocators[a];
+			result[a][0] = run(churn_thread);
+			result[a][1] = run(handoff_thread);
+		}
+		printf("%7d  %12.2f / %-12.2f %12.2f / %-12.2f\n", nthreads,
+		       result[0][0] / 1e6, result[1][0] / 1e6,
+		       result[0][1] / 1e6, result[1][1] / 1e6);
+	}
+	mem_deinit();
+	return 0;
+}
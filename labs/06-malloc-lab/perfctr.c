@@ -0,0 +1,94 @@
+/*
+ * perfctr.c - hardware event counts with perf_event_open, see perfctr.h
+ */
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+#define CACHE_MISS(cache) (PERF_COUNT_HW_CACHE_ ## cache | \
+	PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[PERFCTR_NEVENTS] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instrs", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1d", PERF_TYPE_HW_CACHE, CACHE_MISS(L1D) },
+    { "LLC", PERF_TYPE_HW_CACHE, CACHE_MISS(LL) },
+    { "dTLB", PERF_TYPE_HW_CACHE, CACHE_MISS(DTLB) },
+    { "branch", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int fds[PERFCTR_NEVENTS];
+static int initialized = 0;
+
+/*
+ * init_perfctr - open one disabled counter per event for this process
+ */
+int init_perfctr(void)
+{
+    struct perf_event_attr attr;
+    int i, n = 0;
+
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[i] >= 0)
+	    n++;
+    }
+    initialized = 1;
+    return n;
+}
+
+/*
+ * perfctr - Count the events during one run of f(argp). An event that
+ *     shared its counter with others is scaled by the time it ran.
+ */
+void perfctr(perfctr_test_funct f, void *argp, perfctr_t *ctr)
+{
+    uint64_t buf[3];    /* value, time enabled, time running */
+    int i;
+
+    if (!initialized)
+	init_perfctr();
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	if (fds[i] < 0)
+	    continue;
+	ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    f(argp);
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	ctr->valid[i] = 0;
+	ctr->count[i] = 0;
+	if (fds[i] < 0 || read(fds[i], buf, sizeof(buf)) != sizeof(buf) ||
+	    buf[2] == 0)
+	    continue;
+	ctr->valid[i] = 1;
+	ctr->count[i] = (double)buf[0] * buf[1] / buf[2];
+    }
+}
+
+const char *perfctr_name(int event)
+{
+    return events[event].name;
+}
@@ -0,0 +1,36 @@
+/*
+ * perfctr.h - hardware event counts for a test function, from the Linux
+ *     perf_event_open interface
+ *
+ * These complement fsecs: the cycle counter says how long a function
+ * takes, the event counts say where the time goes. Counters are counted
+ * in user mode only, so they also work with perf_event_paranoid = 2.
+ */
+
+typedef void (*perfctr_test_funct)(void *);
+
+/* The events counted, in the order of perfctr_t.count */
+enum {
+    PERFCTR_CYCLES,
+    PERFCTR_INSTRUCTIONS,
+    PERFCTR_L1D_MISSES,
+    PERFCTR_LLC_MISSES,
+    PERFCTR_DTLB_MISSES,
+    PERFCTR_BRANCH_MISSES,
+    PERFCTR_NEVENTS
+};
+
+typedef struct {
+    int valid[PERFCTR_NEVENTS];     /* was the event counted? */
+    double count[PERFCTR_NEVENTS];  /* scaled up if it was multiplexed */
+} perfctr_t;
+
+/* Open the counters. Returns how many events can be counted, 0 if the
+   kernel, the CPU or a container allows none. */
+int init_perfctr(void);
+
+/* Run f(argp) once with the counters on; all invalid if none are open */
+void perfctr(perfctr_test_funct f, void *argp, perfctr_t *ctr);
+
+/* Name of an event, for tables */
+const char *perfctr_name(int event);
@@ -0,0 +1,121 @@
+/*
+ * rep2bin.c - convert a .rep trace to the binary format of tracebin.h,
+ *     or back with -d
+ *
+ * usage: rep2bin [-d] <in> <out>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tracebin.h"
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: rep2bin [-d] <in> <out>\n");
+	fprintf(stderr, "\t-d  decode a binary trace back to .rep\n");
+	exit(1);
+}
+
+static void die(const char *file, const char *msg)
+{
+	fprintf(stderr, "rep2bin: %s: %s\n", file, msg);
+	exit(1);
+}
+
+static void encode(const char *inname, FILE *in, FILE *out)
+{
+	tracebin_header_t header;
+	tracebin_writer_t w;
+	char line[256], type[2];
+	long index, i = 0;
+	int n;
+	size_t size = 0, align = 0;
+
+	if (fscanf(in, "%d %ld %ld %d", &header.weight, &header.num_ids,
+				&header.num_ops, &header.ignore_ranges) != 4)
+		die(inname, "bad header");
+	if (tracebin_write_header(&w, out, &header) < 0)
+		die(inname, "write failed");
+	while (i < header.num_ops && fgets(line, sizeof(line), in) != NULL) {
+		if ((n = sscanf(line, "%1s %ld %zu %zu", type, &index, &size, &align)) <= 0)
+			continue;		/* blank line */
+		/* an alloc or realloc without a size (n == 2) keeps the previous
+		   request's, as in mdriver's .rep reader */
+		if (n < 2 || (type[0] == 'm' && n < 4))
+			die(inname, "malformed request");
+		if (tracebin_write_op(&w, type[0], index, type[0] == 'f' ? 0 : size,
+					type[0] == 'm' ? align : 0) < 0)
+			die(inname, "unknown request type or write failed");
+		i++;
+	}
+	if (i < header.num_ops)
+		die(inname, "fewer requests than the header says");
+}
+
+static void decode(const char *inname, FILE *in, FILE *out)
+{
+	tracebin_header_t header;
+	tracebin_reader_t r;
+	struct stat st;
+	void *map;
+	char type;
+	long index;
+	size_t size, align;
+
+	if (fstat(fileno(in), &st) < 0 || st.st_size == 0)
+		die(inname, "empty or unreadable");
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+	if (map == MAP_FAILED)
+		die(inname, "mmap failed");
+	if (tracebin_read_header(&r, map, st.st_size, &header) < 0)
+		die(inname, "not a binary trace");
+	fprintf(out, "%d\n%ld\n%ld\n%d\n", header.weight, header.num_ids,
+			header.num_ops, header.ignore_ranges);
+	for (long i = 0; i < header.num_ops; i++) {
+		if (tracebin_read_op(&r, &type, &index, &size, &align) < 0)
+			die(inname, "truncated or malformed request");
+		if (type == 'f')
+			fprintf(out, "f %ld\n", index);
+		else if (type == 'm')
+			fprintf(out, "m %ld %zu %zu\n", index, size, align);
+		else
+			fprintf(out, "%c %ld %zu\n", type, index, size);
+	}
+	munmap(map, st.st_size);
+}
+
+int main(int argc, char **argv)
+{
+	int decode_flag = 0;
+	int c;
+	FILE *in, *out;
+
+	while ((c = getopt(argc, argv, "dh")) != -1) {
+		switch (c) {
+		case 'd':
+			decode_flag = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2)
+		usage();
+
+	if ((in = fopen(argv[optind], "r")) == NULL)
+		die(argv[optind], "cannot open");
+	if ((out = fopen(argv[optind + 1], "w")) == NULL)
+		die(argv[optind + 1], "cannot create");
+	if (decode_flag)
+		decode(argv[optind], in, out);
+	else
+		encode(argv[optind], in, out);
+	fclose(in);
+	if (fclose(out) == EOF)
+		die(argv[optind + 1], "write failed");
+	return 0;
+}
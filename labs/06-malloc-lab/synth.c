@@ -0,0 +1,736 @@
+/*
+ * synth.c - generate synthetic traces from a workload spec, or fit a spec
+ *     to a trace
+ *
+ * usage: synth [-b] [-x <scale>] [-s <seed>] <spec> <out>
+ *        synth -f [-p <phases>] <trace> <spec>
+ *
+ * A spec is a list of phases, each a number of allocations drawn from a
+ * size distribution and a lifetime distribution. A lifetime counts the
+ * allocations made while the block is live, and a block whose lifetime
+ * is inf is freed at the end of the trace, which always frees everything.
+ * -x scales the allocations of every phase but not the lifetimes, so a
+ * longer trace keeps the heap of the shorter one. The trace is generated
+ * twice with the same seed, first to count its requests for the header.
+ *
+ * With -f, synth reads a .rep or binary trace, cuts it into phases of
+ * equal numbers of allocations and writes the spec that generates
+ * traces like it: sizes and lifetimes in power of two buckets, the
+ * lifetimes for each size bucket, and the share of callocs, aligned
+ * allocations and reallocs.
+ *
+ * The spec format is in traces/README.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tracebin.h"
+
+#define MAX_RANGES 66		/* a bucket for 0, one for each power of two, inf */
+#define LIFE_INF LONG_MAX
+
+/* lo..hi, both included, drawn uniformly; weight is relative */
+typedef struct {
+	double weight;
+	long lo, hi;
+} range_t;
+
+typedef struct {
+	int n;
+	range_t r[MAX_RANGES];
+} dist_t;
+
+typedef struct {
+	long allocs;
+	dist_t size;
+	dist_t life;			/* for the sizes without their own */
+	dist_t size_life[MAX_RANGES];	/* the lifetimes of size.r[i], if any */
+	dist_t align;			/* weights are percentages of allocations */
+	dist_t resize;			/* the sizes reallocs ask for, if not size */
+	double calloc_pct;
+	double realloc_pct;		/* reallocs per 100 allocations */
+	size_t live;			/* cap on the bytes live, 0 for none */
+} phase_t;
+
+/* A live block, in a min-heap on when it is freed */
+typedef struct {
+	long deadline;
+	long id;
+	size_t size;
+} block_t;
+
+typedef struct {
+	FILE *out;			/* NULL while counting */
+	int binary;
+	tracebin_writer_t w;
+	long ops;
+} sink_t;
+
+static phase_t *phases;
+static int num_phases;
+
+static block_t *heap;
+static size_t heap_len, heap_cap;
+
+static uint64_t rng;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: synth [-b] [-x <scale>] [-s <seed>] <spec> <out>\n");
+	fprintf(stderr, "       synth -f [-p <phases>] <trace> <spec>\n");
+	fprintf(stderr, "\t-b  write a binary trace instead of .rep text\n");
+	fprintf(stderr, "\t-x  scale the allocations of each phase (default 1)\n");
+	fprintf(stderr, "\t-s  random seed (default 15213)\n");
+	fprintf(stderr, "\t-f  fit a spec to a trace\n");
+	fprintf(stderr, "\t-p  number of phases to fit (default 1)\n");
+	exit(1);
+}
+
+static void die(const char *file, const char *msg)
+{
+	fprintf(stderr, "synth: %s: %s\n", file, msg);
+	exit(1);
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (p == NULL)
+		die("malloc", "out of memory");
+	return p;
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+	void *p = calloc(n, size);
+
+	if (p == NULL)
+		die("malloc", "out of memory");
+	return p;
+}
+
+/***********
+ * The spec
+ ***********/
+
+static const char *spec_name;
+static int spec_line;
+
+static void spec_error(const char *msg)
+{
+	fprintf(stderr, "synth: %s:%d: %s\n", spec_name, spec_line, msg);
+	exit(1);
+}
+
+/* Parses "<weight> <lo> [<hi>]" into r; inf is allowed for lifetimes */
+static void parse_range(const char *args, range_t *r, int inf)
+{
+	char lo[32], hi[32];
+	int n = sscanf(args, "%lf %31s %31s", &r->weight, lo, hi);
+	char *end;
+
+	if (n < 2 || r->weight < 0)
+		spec_error("expected <weight> <lo> [<hi>]");
+	if (inf && strcmp(lo, "inf") == 0) {
+		r->lo = r->hi = LIFE_INF;
+		if (n == 3)
+			spec_error("inf has no <hi>");
+		return;
+	}
+	r->lo = strtol(lo, &end, 10);
+	if (*end != '\0' || r->lo < 0)
+		spec_error("bad number");
+	r->hi = r->lo;
+	if (n == 3) {
+		r->hi = inf && strcmp(hi, "inf") == 0 ? LIFE_INF : strtol(hi, &end, 10);
+		if ((r->hi != LIFE_INF && *end != '\0') || r->hi < r->lo)
+			spec_error("bad <hi>");
+	}
+}
+
+static void add_range(dist_t *d, const range_t *r)
+{
+	if (d->n == MAX_RANGES)
+		spec_error("too many ranges in one phase");
+	d->r[d->n++] = *r;
+}
+
+/* What a phase line replaces the first time it appears in the phase */
+enum { SEEN_SIZE = 1, SEEN_LIFE = 2, SEEN_ALIGN = 4, SEEN_RESIZE = 8 };
+
+static void read_spec(const char *name)
+{
+	FILE *in;
+	char line[512], key[32], *hash;
+	phase_t cur;
+	int seen = 0, n;
+	range_t r;
+
+	spec_name = name;
+	if ((in = fopen(name, "r")) == NULL)
+		die(name, "cannot open");
+	memset(&cur, 0, sizeof(cur));
+	while (fgets(line, sizeof(line), in) != NULL) {
+		spec_line++;
+		if ((hash = strchr(line, '#')) != NULL)
+			*hash = '\0';
+		if (sscanf(line, "%31s %n", key, &n) < 1)
+			continue;
+		const char *args = line + n;
+
+		if (strcmp(key, "phase") == 0) {
+			if (num_phases > 0)
+				phases[num_phases - 1] = cur;
+			if (sscanf(args, "%ld", &cur.allocs) != 1 || cur.allocs < 0)
+				spec_error("expected phase <allocations>");
+			phases = realloc(phases, ++num_phases * sizeof(phase_t));
+			if (phases == NULL)
+				die("malloc", "out of memory");
+			seen = 0;
+		} else if (strcmp(key, "size") == 0) {
+			parse_range(args, &r, 0);
+			if (!(seen & SEEN_SIZE))
+				cur.size.n = 0;
+			seen |= SEEN_SIZE;
+			add_range(&cur.size, &r);
+			cur.size_life[cur.size.n - 1].n = 0;
+		} else if (strcmp(key, "life") == 0) {
+			parse_range(args, &r, 1);
+			if (seen & SEEN_SIZE) {
+				/* bound to the size line above */
+				add_range(&cur.size_life[cur.size.n - 1], &r);
+			} else {
+				if (!(seen & SEEN_LIFE))
+					cur.life.n = 0;
+				seen |= SEEN_LIFE;
+				add_range(&cur.life, &r);
+			}
+		} else if (strcmp(key, "align") == 0) {
+			if (!(seen & SEEN_ALIGN))
+				cur.align.n = 0;
+			seen |= SEEN_ALIGN;
+			/* "align 0" only clears the inherited ones */
+			if (sscanf(args, "%lf %ld", &r.weight, &r.lo) == 1 && r.weight == 0)
+				continue;
+			parse_range(args, &r, 0);
+			if (r.lo == 0 || (r.lo & (r.lo - 1)) != 0 || (r.hi & (r.hi - 1)) != 0)
+				spec_error("alignments are powers of two");
+			add_range(&cur.align, &r);
+		} else if (strcmp(key, "resize") == 0) {
+			parse_range(args, &r, 0);
+			if (!(seen & SEEN_RESIZE))
+				cur.resize.n = 0;
+			seen |= SEEN_RESIZE;
+			add_range(&cur.resize, &r);
+		} else if (strcmp(key, "calloc") == 0) {
+			if (sscanf(args, "%lf", &cur.calloc_pct) != 1 || cur.calloc_pct < 0)
+				spec_error("expected calloc <percent>");
+		} else if (strcmp(key, "realloc") == 0) {
+			if (sscanf(args, "%lf", &cur.realloc_pct) != 1 || cur.realloc_pct < 0)
+				spec_error("expected realloc <percent>");
+		} else if (strcmp(key, "live") == 0) {
+			if (sscanf(args, "%zu", &cur.live) != 1)
+				spec_error("expected live <bytes>");
+		} else {
+			spec_error("unknown directive");
+		}
+	}
+	fclose(in);
+	if (num_phases == 0)
+		die(name, "no phases");
+	phases[num_phases - 1] = cur;
+
+	for (int i = 0; i < num_phases; i++) {
+		phase_t *p = &phases[i];
+		double pct = p->calloc_pct;
+
+		if (p->size.n == 0)
+			die(name, "a phase has no sizes");
+		for (int j = 0; j < p->size.n; j++)
+			if (p->size_life[j].n == 0 && p->life.n == 0)
+				die(name, "a size has no lifetimes");
+		for (int j = 0; j < p->align.n; j++)
+			pct += p->align.r[j].weight;
+		if (pct > 100)
+			die(name, "callocs and aligned allocations pass 100%");
+	}
+}
+
+/*************
+ * Generating
+ *************/
+
+/* xorshift64*, the same sequence for a seed on every machine */
+static uint64_t next_random(void)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform in [0, 1) */
+static double random_unit(void)
+{
+	return (next_random() >> 11) * 0x1.0p-53;
+}
+
+static long random_between(long lo, long hi)
+{
+	if (lo == LIFE_INF || hi == LIFE_INF)
+		return LIFE_INF;
+	return lo + (long)(next_random() % (uint64_t)(hi - lo + 1));
+}
+
+/* picks a range by weight; returns its index */
+static int pick(const dist_t *d)
+{
+	double total = 0, u;
+	int i;
+
+	for (i = 0; i < d->n; i++)
+		total += d->r[i].weight;
+	u = random_unit() * total;
+	for (i = 0; i < d->n - 1; i++) {
+		if (u < d->r[i].weight)
+			break;
+		u -= d->r[i].weight;
+	}
+	return i;
+}
+
+static void emit(sink_t *s, char type, long id, size_t size, size_t align)
+{
+	s->ops++;
+	if (s->out == NULL)
+		return;
+	if (s->binary) {
+		if (tracebin_write_op(&s->w, type, id, size, align) < 0)
+			die("output", "write failed");
+	} else if (type == 'f') {
+		fprintf(s->out, "f %ld\n", id);
+	} else if (type == 'm') {
+		fprintf(s->out, "m %ld %zu %zu\n", id, size, align);
+	} else {
+		fprintf(s->out, "%c %ld %zu\n", type, id, size);
+	}
+}
+
+static int earlier(const block_t *a, const block_t *b)
+{
+	return a->deadline < b->deadline || (a->deadline == b->deadline && a->id < b->id);
+}
+
+static void heap_push(const block_t *b)
+{
+	size_t i;
+
+	if (heap_len == heap_cap) {
+		heap_cap = heap_cap ? 2 * heap_cap : 1024;
+		if ((heap = realloc(heap, heap_cap * sizeof(block_t))) == NULL)
+			die("malloc", "out of memory");
+	}
+	for (i = heap_len++; i > 0 && earlier(b, &heap[(i - 1) / 2]); i = (i - 1) / 2)
+		heap[i] = heap[(i - 1) / 2];
+	heap[i] = *b;
+}
+
+static block_t heap_pop(void)
+{
+	block_t top = heap[0], last = heap[--heap_len];
+	size_t i = 0, c;
+
+	while ((c = 2 * i + 1) < heap_len) {
+		if (c + 1 < heap_len && earlier(&heap[c + 1], &heap[c]))
+			c++;
+		if (!earlier(&heap[c], &last))
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = last;
+	return top;
+}
+
+/* Emits the whole trace; returns the number of ids */
+static long generate(sink_t *s, double scale, uint64_t seed)
+{
+	long t = 0, steps, id = 0;
+	size_t live = 0;
+
+	rng = seed ? seed : 1;
+	heap_len = 0;
+	for (int k = 0; k < num_phases; k++) {
+		const phase_t *p = &phases[k];
+
+		steps = (long)llround(p->allocs * scale);
+		if (steps == 0 && p->allocs > 0)
+			steps = 1;
+		for (long i = 0; i < steps; i++, t++) {
+			block_t b;
+			double u;
+			int j;
+
+			while (heap_len > 0 && heap[0].deadline <= t) {
+				b = heap_pop();
+				live -= b.size;
+				emit(s, 'f', b.id, 0, 0);
+			}
+
+			/* reallocs of random live blocks, realloc_pct per 100 steps */
+			for (u = p->realloc_pct / 100; heap_len > 0 && u > 0; u -= 1) {
+				if (u < 1 && random_unit() >= u)
+					break;
+				const dist_t *d = p->resize.n > 0 ? &p->resize : &p->size;
+				block_t *r = &heap[next_random() % heap_len];
+				j = pick(d);
+				size_t size = random_between(d->r[j].lo, d->r[j].hi);
+				live += size - r->size;
+				r->size = size;
+				emit(s, 'r', r->id, size, 0);
+			}
+
+			const dist_t *life;
+			j = pick(&p->size);
+			life = p->size_life[j].n > 0 ? &p->size_life[j] : &p->life;
+			b.id = id++;
+			b.size = random_between(p->size.r[j].lo, p->size.r[j].hi);
+			j = pick(life);
+			b.deadline = random_between(life->r[j].lo, life->r[j].hi);
+			if (b.deadline != LIFE_INF)
+				b.deadline += t + 1;
+
+			/* free the blocks due first until this one fits under the cap */
+			while (p->live > 0 && heap_len > 0 && live + b.size > p->live) {
+				block_t f = heap_pop();
+				live -= f.size;
+				emit(s, 'f', f.id, 0, 0);
+			}
+
+			u = random_unit() * 100;
+			if (u < p->calloc_pct) {
+				emit(s, 'c', b.id, b.size, 0);
+			} else {
+				u -= p->calloc_pct;
+				for (j = 0; j < p->align.n && u >= p->align.r[j].weight; j++)
+					u -= p->align.r[j].weight;
+				if (j < p->align.n)
+					emit(s, 'm', b.id, b.size, 1UL << random_between(
+							__builtin_ctzl(p->align.r[j].lo),
+							__builtin_ctzl(p->align.r[j].hi)));
+				else
+					emit(s, 'a', b.id, b.size, 0);
+			}
+			live += b.size;
+			heap_push(&b);
+		}
+	}
+	while (heap_len > 0)
+		emit(s, 'f', heap_pop().id, 0, 0);
+	return id;
+}
+
+/**********
+ * Fitting
+ **********/
+
+typedef struct {
+	char type;
+	long index;
+	size_t size, align;
+} op_t;
+
+/* count, smallest and largest value of a power of two bucket */
+typedef struct {
+	long count;
+	long lo, hi;
+} bucket_t;
+
+typedef struct {
+	long allocs, callocs;
+	bucket_t size[MAX_RANGES];
+	bucket_t life[MAX_RANGES][MAX_RANGES];	/* by size bucket */
+	long align[64];				/* by log2 */
+	long reallocs;
+	bucket_t resize[MAX_RANGES];
+} fit_t;
+
+/* 0 for 0, then one bucket for each power of two, inf last */
+static int bucket_of(long v)
+{
+	return v == LIFE_INF ? MAX_RANGES - 1 : v == 0 ? 0 : 64 - __builtin_clzl(v);
+}
+
+static void count(bucket_t *b, long v)
+{
+	if (b->count++ == 0 || v < b->lo)
+		b->lo = v;
+	if (b->count == 1 || v > b->hi)
+		b->hi = v;
+}
+
+/* Reads a .rep or binary trace; returns its requests */
+static op_t *load_trace(const char *name, long *nops, long *num_ids)
+{
+	FILE *in;
+	struct stat st;
+	void *map;
+	op_t *ops;
+	tracebin_header_t header;
+	tracebin_reader_t r;
+	char line[256], type[2];
+	size_t size = 0, align = 0;
+	long index, i = 0;
+	int n;
+
+	if ((in = fopen(name, "r")) == NULL)
+		die(name, "cannot open");
+	if (fstat(fileno(in), &st) < 0 || st.st_size == 0)
+		die(name, "empty or unreadable");
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+	if (map == MAP_FAILED)
+		die(name, "mmap failed");
+	if (tracebin_is_binary(map, st.st_size)) {
+		if (tracebin_read_header(&r, map, st.st_size, &header) < 0)
+			die(name, "not a binary trace");
+		ops = xmalloc((header.num_ops + 1) * sizeof(op_t));
+		for (i = 0; i < header.num_ops; i++)
+			if (tracebin_read_op(&r, &ops[i].type, &ops[i].index, &ops[i].size,
+						&ops[i].align) < 0)
+				die(name, "truncated or malformed request");
+	} else {
+		if (fscanf(in, "%d %ld %ld %d", &header.weight, &header.num_ids,
+					&header.num_ops, &header.ignore_ranges) != 4 || header.num_ops < 0)
+			die(name, "bad header");
+		ops = xmalloc((header.num_ops + 1) * sizeof(op_t));
+		while (i < header.num_ops && fgets(line, sizeof(line), in) != NULL) {
+			if ((n = sscanf(line, "%1s %ld %zu %zu", type, &index, &size, &align)) <= 0)
+				continue;
+			/* an alloc or realloc without a size keeps the previous one's */
+			if (n < 2 || (type[0] == 'm' && n < 4))
+				die(name, "malformed request");
+			if (strchr("arfmc", type[0]) == NULL)
+				die(name, "unknown request type");
+			ops[i].type = type[0];
+			ops[i].index = index;
+			ops[i].size = type[0] == 'f' ? 0 : size;
+			ops[i].align = type[0] == 'm' ? align : 0;
+			i++;
+		}
+		if (i < header.num_ops)
+			die(name, "fewer requests than the header says");
+	}
+	munmap(map, st.st_size);
+	fclose(in);
+	for (i = 0; i < header.num_ops; i++)
+		if (ops[i].index >= header.num_ids || (ops[i].index < 0 && ops[i].type != 'f'))
+			die(name, "request id out of range");
+	*nops = header.num_ops;
+	*num_ids = header.num_ids;
+	return ops;
+}
+
+static void print_range(FILE *out, const char *key, const bucket_t *b)
+{
+	if (b->lo == LIFE_INF)
+		fprintf(out, "%s %ld inf\n", key, b->count);
+	else if (b->lo == b->hi)
+		fprintf(out, "%s %ld %ld\n", key, b->count, b->lo);
+	else
+		fprintf(out, "%s %ld %ld %ld\n", key, b->count, b->lo, b->hi);
+}
+
+static void fit(const char *name, const char *outname, int nphases)
+{
+	op_t *ops;
+	long nops, allocs = 0, t, *born, peak = 0, live = 0;
+	long num_ids;
+	int *phase, *sbucket, k;
+	size_t *size;
+	char *is_live;
+	fit_t *f;
+	FILE *out;
+	int any_calloc = 0, any_realloc = 0, any_align = 0;
+
+	ops = load_trace(name, &nops, &num_ids);
+	born = xmalloc(num_ids * sizeof(long));
+	size = xmalloc(num_ids * sizeof(size_t));
+	phase = xmalloc(num_ids * sizeof(int));
+	sbucket = xmalloc(num_ids * sizeof(int));
+	is_live = xcalloc(num_ids, 1);
+	f = xcalloc(nphases, sizeof(fit_t));
+
+	/* a realloc of a block not live is an allocation, as realloc(NULL, n) */
+	for (long i = 0; i < nops; i++) {
+		long id = ops[i].index;
+
+		if (ops[i].type == 'f') {
+			if (id >= 0)
+				is_live[id] = 0;
+		} else if (ops[i].type != 'r' || !is_live[id]) {
+			allocs++;
+			is_live[id] = 1;
+		}
+	}
+	if (allocs == 0)
+		die(name, "no allocations");
+	memset(is_live, 0, num_ids);
+
+	for (long i = t = 0; i < nops; i++) {
+		const op_t *op = &ops[i];
+		long id = op->index;
+
+		k = t * nphases / allocs;
+		if (op->type == 'f') {
+			if (id < 0 || !is_live[id])
+				continue;
+			/* freed after the last allocation: freed at the end */
+			long L = t == allocs ? LIFE_INF : t - born[id] - 1;
+			count(&f[phase[id]].life[sbucket[id]][bucket_of(L)], L);
+			is_live[id] = 0;
+			live -= size[id];
+		} else if (op->type == 'r' && is_live[id]) {
+			fit_t *p = &f[k < nphases ? k : nphases - 1];
+			p->reallocs++;
+			count(&p->resize[bucket_of(op->size)], op->size);
+			live += op->size - size[id];
+			size[id] = op->size;
+		} else {
+			fit_t *p = &f[k];
+			p->allocs++;
+			p->callocs += op->type == 'c';
+			if (op->type == 'm')
+				p->align[__builtin_ctzl(op->align)]++;
+			sbucket[id] = bucket_of(op->size);
+			count(&p->size[sbucket[id]], op->size);
+			born[id] = t++;
+			phase[id] = k;
+			size[id] = op->size;
+			is_live[id] = 1;
+			live += op->size;
+		}
+		if (live > peak)
+			peak = live;
+	}
+	for (long id = 0; id < num_ids; id++)
+		if (is_live[id])
+			count(&f[phase[id]].life[sbucket[id]][MAX_RANGES - 1], LIFE_INF);
+
+	for (k = 0; k < nphases; k++) {
+		any_calloc |= f[k].callocs > 0;
+		any_realloc |= f[k].reallocs > 0;
+		for (int j = 0; j < 64; j++)
+			any_align |= f[k].align[j] > 0;
+	}
+
+	if (strcmp(outname, "-") == 0)
+		out = stdout;
+	else if ((out = fopen(outname, "w")) == NULL)
+		die(outname, "cannot create");
+	fprintf(out, "# fitted to %s: %ld requests, %ld allocations, "
+			"peak %ld bytes live\n", name, nops, allocs, peak);
+	fprintf(out, "live %ld\n", peak);
+	for (k = 0; k < nphases; k++) {
+		fit_t *p = &f[k];
+		int aligned = 0;
+
+		fprintf(out, "\nphase %ld\n", p->allocs);
+		for (int b = 0; b < MAX_RANGES; b++) {
+			if (p->size[b].count == 0)
+				continue;
+			print_range(out, "size", &p->size[b]);
+			for (int l = 0; l < MAX_RANGES; l++)
+				if (p->life[b][l].count > 0)
+					print_range(out, "life", &p->life[b][l]);
+		}
+		if (p->allocs == 0)
+			continue;
+		if (any_calloc)
+			fprintf(out, "calloc %.6g\n", 100.0 * p->callocs / p->allocs);
+		if (any_realloc)
+			fprintf(out, "realloc %.6g\n", 100.0 * p->reallocs / p->allocs);
+		for (int b = 0; b < MAX_RANGES; b++)
+			if (p->resize[b].count > 0)
+				print_range(out, "resize", &p->resize[b]);
+		for (int j = 0; j < 64; j++) {
+			if (p->align[j] == 0)
+				continue;
+			fprintf(out, "align %.6g %ld\n", 100.0 * p->align[j] / p->allocs, 1L << j);
+			aligned = 1;
+		}
+		if (any_align && !aligned)
+			fprintf(out, "align 0\n");
+	}
+	if (out != stdout && fclose(out) == EOF)
+		die(outname, "write failed");
+}
+
+int main(int argc, char **argv)
+{
+	int binary = 0, fit_flag = 0, nphases = 1, c;
+	long num_ids;
+	double scale = 1;
+	uint64_t seed = 15213;
+	sink_t sink = { NULL, 0, { NULL, 0 }, 0 };
+	const char *outname;
+
+	while ((c = getopt(argc, argv, "bx:s:fp:h")) != -1) {
+		switch (c) {
+		case 'b':
+			binary = 1;
+			break;
+		case 'x':
+			scale = atof(optarg);
+			if (scale <= 0)
+				usage();
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'f':
+			fit_flag = 1;
+			break;
+		case 'p':
+			nphases = atoi(optarg);
+			if (nphases < 1)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2)
+		usage();
+	outname = argv[optind + 1];
+	if (fit_flag) {
+		fit(argv[optind], outname, nphases);
+		return 0;
+	}
+
+	read_spec(argv[optind]);
+	num_ids = generate(&sink, scale, seed);
+	if ((sink.out = fopen(outname, "w")) == NULL)
+		die(outname, "cannot create");
+	sink.binary = binary;
+	if (binary) {
+		tracebin_header_t h = { 1, num_ids, sink.ops, 0 };
+		if (tracebin_write_header(&sink.w, sink.out, &h) < 0)
+			die(outname, "write failed");
+	} else {
+		fprintf(sink.out, "%d\n%ld\n%ld\n%d\n", 1, num_ids, sink.ops, 0);
+	}
+	sink.ops = 0;
+	generate(&sink, scale, seed);
+	if (fclose(sink.out) == EOF)
+		die(outname, "write failed");
+	fprintf(stderr, "%s: %ld ids, %ld requests\n", outname, num_ids, sink.ops);
+	return 0;
+}
@@ -0,0 +1,334 @@
+/*
+ * trace2rep.c - convert an event log of traces/get-trace.so to a trace
+ *     for the driver, as .rep text or, with -b, in the binary format of
+ *     tracebin.h
+ *
+ * usage: trace2rep [-b] <log> <out>
+ *
+ * The events of all threads are merged by time stamp. Each block gets a
+ * new id when it is allocated; an aligned allocation becomes a plain one
+ * unless it asks for more than 8 bytes. A realloc keeps the id of the
+ * block it resizes, which is no longer live from the event logged before
+ * the call, so another thread may get its address first. Frees of blocks
+ * the log never saw allocated, e.g. before the tracer was loaded, and
+ * failed calls are left out and counted.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tracebin.h"
+#include "traces/get-trace.h"
+
+typedef struct {
+	char type;
+	long index;
+	size_t size;
+	size_t align;		/* 'm' only */
+} op_t;
+
+/* Live blocks: open addressing from address to id, 0 marks a free slot */
+typedef struct {
+	uint64_t *ptr;
+	long *id;
+	size_t mask;
+	size_t count;
+} ptrmap_t;
+
+static const get_trace_event_t *events;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: trace2rep [-b] <log> <out>\n");
+	fprintf(stderr, "\t-b  write a binary trace instead of .rep text\n");
+	exit(1);
+}
+
+static void die(const char *file, const char *msg)
+{
+	fprintf(stderr, "trace2rep: %s: %s\n", file, msg);
+	exit(1);
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (p == NULL)
+		die("malloc", "out of memory");
+	return p;
+}
+
+static size_t hash_ptr(uint64_t p)
+{
+	return (p >> 4) * 0x9e3779b97f4a7c15ULL >> 20;
+}
+
+static void map_init(ptrmap_t *m, size_t slots)
+{
+	m->ptr = calloc(slots, sizeof(uint64_t));
+	m->id = xmalloc(slots * sizeof(long));
+	if (m->ptr == NULL)
+		die("malloc", "out of memory");
+	m->mask = slots - 1;
+	m->count = 0;
+}
+
+static size_t map_slot(const ptrmap_t *m, uint64_t p)
+{
+	size_t i = hash_ptr(p) & m->mask;
+
+	while (m->ptr[i] != 0 && m->ptr[i] != p)
+		i = (i + 1) & m->mask;
+	return i;
+}
+
+/* Returns the id of p, or -1 */
+static long map_get(const ptrmap_t *m, uint64_t p)
+{
+	size_t i = map_slot(m, p);
+
+	return m->ptr[i] == p ? m->id[i] : -1;
+}
+
+static void map_put(ptrmap_t *m, uint64_t p, long id)
+{
+	size_t i;
+
+	if (m->count * 2 >= m->mask) {
+		ptrmap_t bigger;
+		map_init(&bigger, (m->mask + 1) * 2);
+		for (i = 0; i <= m->mask; i++)
+			if (m->ptr[i] != 0)
+				map_put(&bigger, m->ptr[i], m->id[i]);
+		free(m->ptr);
+		free(m->id);
+		*m = bigger;
+	}
+	i = map_slot(m, p);
+	if (m->ptr[i] == 0)
+		m->count++;
+	m->ptr[i] = p;
+	m->id[i] = id;
+}
+
+/* Removes p, shifting back the entries that probed past its slot */
+static void map_remove(ptrmap_t *m, uint64_t p)
+{
+	size_t i = map_slot(m, p), j, home;
+
+	if (p == 0 || m->ptr[i] != p)
+		return;
+	m->count--;
+	for (j = (i + 1) & m->mask; m->ptr[j] != 0; j = (j + 1) & m->mask) {
+		home = hash_ptr(m->ptr[j]) & m->mask;
+		/* the entry at j may move to i unless its home is in (i, j] */
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			m->ptr[i] = m->ptr[j];
+			m->id[i] = m->id[j];
+			i = j;
+		}
+	}
+	m->ptr[i] = 0;
+}
+
+/* by time stamp, then in log order, which is each thread's call order */
+static int cmp_event(const void *a, const void *b)
+{
+	size_t x = *(const size_t *)a, y = *(const size_t *)b;
+
+	if (events[x].time != events[y].time)
+		return events[x].time < events[y].time ? -1 : 1;
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+	int binary = 0, c;
+	long id, num_ids = 0;
+	const char *inname, *outname;
+	FILE *in, *out;
+	struct stat st;
+	void *map;
+	const get_trace_header_t *header;
+	size_t nevents, nops = 0, i, *order;
+	size_t unknown = 0, failed = 0, lost = 0, huge = 0;
+	op_t *ops;
+	ptrmap_t live, resizing;
+	ptrmap_t *from;
+
+	while ((c = getopt(argc, argv, "bh")) != -1) {
+		switch (c) {
+		case 'b':
+			binary = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2)
+		usage();
+	inname = argv[optind];
+	outname = argv[optind + 1];
+
+	if ((in = fopen(inname, "r")) == NULL)
+		die(inname, "cannot open");
+	if (fstat(fileno(in), &st) < 0 || (size_t)st.st_size < sizeof(*header))
+		die(inname, "empty or unreadable");
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+	if (map == MAP_FAILED)
+		die(inname, "mmap failed");
+	header = map;
+	if (memcmp(header->magic, GET_TRACE_MAGIC, GET_TRACE_MAGIC_LEN) != 0 ||
+			header->event_size != sizeof(get_trace_event_t))
+		die(inname, "not a get-trace log");
+	events = (const get_trace_event_t *)(header + 1);
+	nevents = (st.st_size - sizeof(*header)) / sizeof(get_trace_event_t);
+
+	order = xmalloc(nevents * sizeof(size_t));
+	for (i = 0; i < nevents; i++)
+		order[i] = i;
+	qsort(order, nevents, sizeof(size_t), cmp_event);
+
+	ops = xmalloc((nevents + 1) * sizeof(op_t));
+	map_init(&live, 1024);
+	map_init(&resizing, 64);
+	for (i = 0; i < nevents; i++) {
+		const get_trace_event_t *e = &events[order[i]];
+		op_t *op = &ops[nops];
+
+		op->align = 0;
+
+		switch (e->type) {
+		case GET_TRACE_MALLOC:
+		case GET_TRACE_CALLOC:
+		case GET_TRACE_MEMALIGN:
+			if (e->ptr == 0) {
+				failed++;
+				break;
+			}
+			if (map_get(&live, e->ptr) >= 0) {
+				/* freed in a way the tracer did not see */
+				lost++;
+				map_remove(&live, e->ptr);
+			}
+			if (e->size > INT_MAX) {
+				huge++;
+				break;
+			}
+			map_put(&live, e->ptr, num_ids);
+			op->type = e->type == GET_TRACE_CALLOC ? 'c' :
+				e->type == GET_TRACE_MEMALIGN && e->align > 8 ? 'm' : 'a';
+			op->index = num_ids++;
+			op->size = e->size;
+			op->align = e->align;
+			nops++;
+			break;
+
+		case GET_TRACE_REALLOC_OLD:
+			if ((id = map_get(&live, e->ptr)) >= 0) {
+				map_remove(&live, e->ptr);
+				map_put(&resizing, e->ptr, id);
+			}
+			break;
+
+		case GET_TRACE_REALLOC:
+			/* logs of older tracers have no GET_TRACE_REALLOC_OLD */
+			from = map_get(&resizing, e->old) >= 0 ? &resizing : &live;
+			id = e->old == 0 ? -1 : map_get(from, e->old);
+			if (e->old != 0 && id < 0)
+				unknown++;
+			if (id >= 0)
+				map_remove(from, e->old);
+			if (e->ptr == 0) {
+				/* realloc(p, 0) frees p; otherwise it failed */
+				if (id >= 0 && e->size == 0) {
+					op->type = 'f';
+					op->index = id;
+					op->size = 0;
+					nops++;
+				} else {
+					failed++;
+					if (id >= 0)
+						map_put(&live, e->old, id);
+				}
+				break;
+			}
+			if (e->size > INT_MAX) {
+				huge++;
+				break;
+			}
+			if (id < 0) {
+				/* realloc(NULL, n), or of a block we never saw */
+				if (map_get(&live, e->ptr) >= 0) {
+					lost++;
+					map_remove(&live, e->ptr);
+				}
+				id = num_ids++;
+				op->type = 'a';
+			} else {
+				op->type = 'r';
+			}
+			map_put(&live, e->ptr, id);
+			op->index = id;
+			op->size = e->size;
+			nops++;
+			break;
+
+		case GET_TRACE_FREE:
+			id = e->ptr == 0 ? -1 : map_get(&live, e->ptr);
+			if (e->ptr != 0 && id < 0) {
+				unknown++;
+				break;
+			}
+			map_remove(&live, e->ptr);
+			op->type = 'f';
+			op->index = id;
+			op->size = 0;
+			nops++;
+			break;
+
+		default:
+			die(inname, "unknown event type");
+		}
+	}
+
+	if ((out = fopen(outname, "w")) == NULL)
+		die(outname, "cannot create");
+	if (binary) {
+		tracebin_header_t h = { 1, num_ids, (long)nops, 0 };
+		tracebin_writer_t w;
+		if (tracebin_write_header(&w, out, &h) < 0)
+			die(outname, "write failed");
+		for (i = 0; i < nops; i++)
+			if (tracebin_write_op(&w, ops[i].type, ops[i].index, ops[i].size, ops[i].align) < 0)
+				die(outname, "write failed");
+	} else {
+		fprintf(out, "%d\n%ld\n%zu\n%d\n", 1, num_ids, nops, 0);
+		for (i = 0; i < nops; i++) {
+			if (ops[i].type == 'f')
+				fprintf(out, "f %ld\n", ops[i].index);
+			else if (ops[i].type == 'm')
+				fprintf(out, "m %ld %zu %zu\n", ops[i].index, ops[i].size, ops[i].align);
+			else
+				fprintf(out, "%c %ld %zu\n", ops[i].type, ops[i].index, ops[i].size);
+		}
+	}
+	if (fclose(out) == EOF)
+		die(outname, "write failed");
+
+	fprintf(stderr, "%s: %zu events, %zu requests, %ld ids, %zu blocks live at exit\n",
+			inname, nevents, nops, num_ids, live.count);
+	if (unknown + failed + lost + huge > 0)
+		fprintf(stderr, "left out: %zu unknown blocks, %zu failed calls, "
+				"%zu blocks reused unfreed, %zu over INT_MAX bytes\n",
+				unknown, failed, lost, huge);
+	munmap(map, st.st_size);
+	fclose(in);
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * tracebin.c - encoder and decoder for binary traces, see tracebin.h
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "tracebin.h"
+
+static const char op_types[] = "arfm";
+
+static uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int get_varint(tracebin_reader_t *r, uint64_t *v)
+{
+	uint64_t value = 0;
+	int shift = 0;
+
+	while (r->p < r->end && shift < 64) {
+		unsigned char c = *r->p++;
+		value |= (uint64_t)(c & 0x7f) << shift;
+		if ((c & 0x80) == 0) {
+			*v = value;
+			return 0;
+		}
+		shift += 7;
+	}
+	return -1;
+}
+
+static int put_varint(FILE *out, uint64_t v)
+{
+	while (v >= 0x80) {
+		if (putc((v & 0x7f) | 0x80, out) == EOF)
+			return -1;
+		v >>= 7;
+	}
+	return putc(v, out) == EOF ? -1 : 0;
+}
+
+int tracebin_is_binary(const void *buf, size_t len)
+{
+	return len >= TRACEBIN_MAGIC_LEN &&
+		memcmp(buf, TRACEBIN_MAGIC, TRACEBIN_MAGIC_LEN) == 0;
+}
+
+int tracebin_read_header(tracebin_reader_t *r, const void *buf, size_t len,
+		tracebin_header_t *header)
+{
+	uint64_t fields[4];
+
+	if (!tracebin_is_binary(buf, len))
+		return -1;
+	r->p = (const unsigned char *)buf + TRACEBIN_MAGIC_LEN;
+	r->end = (const unsigned char *)buf + len;
+	r->prev_index = 0;
+	for (int i = 0; i < 4; i++)
+		if (get_varint(r, &fields[i]) < 0 || fields[i] > INT64_MAX)
+			return -1;
+	if (fields[0] > INT32_MAX || fields[3] > INT32_MAX)
+		return -1;
+	header->weight = fields[0];
+	header->num_ids = fields[1];
+	header->num_ops = fields[2];
+	header->ignore_ranges = fields[3];
+	return 0;
+}
+
+int tracebin_read_op(tracebin_reader_t *r, char *type, long *index,
+		size_t *size, size_t *align)
+{
+	uint64_t tag, v = 0, shift = 0;
+	int64_t id;
+
+	if (get_varint(r, &tag) < 0)
+		return -1;
+	id = r->prev_index + unzigzag(tag >> 2);
+	if (id < -1)
+		return -1;
+	*type = op_types[tag & 3];
+	if (*type != 'f' && get_varint(r, &v) < 0)
+		return -1;
+	if (*type == 'm' && (get_varint(r, &shift) < 0 || shift > TRACEBIN_CALLOC))
+		return -1;
+	if (*type == 'm' && shift == TRACEBIN_CALLOC)
+		*type = 'c';
+	*index = id;
+	*size = v;
+	*align = *type == 'm' ? (size_t)1 << shift : 0;
+	r->prev_index = id;
+	return 0;
+}
+
+int tracebin_write_header(tracebin_writer_t *w, FILE *out,
+		const tracebin_header_t *header)
+{
+	w->out = out;
+	w->prev_index = 0;
+	if (fwrite(TRACEBIN_MAGIC, 1, TRACEBIN_MAGIC_LEN, out) != TRACEBIN_MAGIC_LEN)
+		return -1;
+	if (put_varint(out, header->weight) < 0 ||
+			put_varint(out, header->num_ids) < 0 ||
+			put_varint(out, header->num_ops) < 0 ||
+			put_varint(out, header->ignore_ranges) < 0)
+		return -1;
+	return 0;
+}
+
+int tracebin_write_op(tracebin_writer_t *w, char type, long index, size_t size,
+		size_t align)
+{
+	const char *t = strchr(op_types, type == 'c' ? 'm' : type);
+
+	if (type == '\0' || t == NULL)
+		return -1;
+	if (type == 'm' && (align == 0 || (align & (align - 1)) != 0))
+		return -1;
+	if (put_varint(w->out, zigzag((int64_t)index - w->prev_index) << 2 | (t - op_types)) < 0)
+		return -1;
+	w->prev_index = index;
+	if (type != 'f' && put_varint(w->out, size) < 0)
+		return -1;
+	if (type == 'm' && put_varint(w->out, __builtin_ctzll(align)) < 0)
+		return -1;
+	if (type == 'c' && put_varint(w->out, TRACEBIN_CALLOC) < 0)
+		return -1;
+	return 0;
+}
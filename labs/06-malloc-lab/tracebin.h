@@ -0,0 +1,69 @@
+/*
+ * tracebin.h - binary trace format for the malloc lab driver
+ *
+ * A binary trace holds the same requests as a .rep file, in less space
+ * and without text to parse. It starts with the magic string, followed by
+ * the four .rep header fields as varints. Each request is then one varint
+ * for its type and id, and a second one for its size unless it is a free;
+ * an aligned allocation adds the log2 of its alignment, and a calloc is an
+ * m whose log2 is TRACEBIN_CALLOC:
+ *
+ *	zigzag(id - previous id) << 2 | type     (type 0 = a, 1 = r, 2 = f, 3 = m or c)
+ *	size
+ *	log2(align), or TRACEBIN_CALLOC          (m and c only)
+ *
+ * Varints are unsigned LEB128: 7 bits per byte, low bits first, the high
+ * bit set on every byte but the last. Ids mostly grow by one from request
+ * to request and sizes are small, so most requests take 2 or 3 bytes.
+ */
+#ifndef __TRACEBIN_H__
+#define __TRACEBIN_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define TRACEBIN_MAGIC "mmtrace1"
+#define TRACEBIN_MAGIC_LEN 8
+#define TRACEBIN_CALLOC 64	/* no alignment has this log2 */
+
+/* The .rep header fields, in their order in a .rep file; ids and counts
+   may pass INT_MAX in traces that are streamed (mdriver -C) */
+typedef struct {
+	int weight;
+	long num_ids;
+	long num_ops;
+	int ignore_ranges;
+} tracebin_header_t;
+
+/* Decoder over a binary trace in memory, e.g. mapped with mmap */
+typedef struct {
+	const unsigned char *p;
+	const unsigned char *end;
+	long prev_index;
+} tracebin_reader_t;
+
+/* Encoder onto a stdio stream */
+typedef struct {
+	FILE *out;
+	long prev_index;
+} tracebin_writer_t;
+
+/* Does the buffer start with the magic string? */
+int tracebin_is_binary(const void *buf, size_t len);
+
+/* Both return 0, or -1 if the trace is malformed or ends too early.
+   type is 'a', 'r', 'f', 'm' or 'c', as in a .rep file; size is 0 for a free,
+   align is the alignment of an 'm' and 0 for the others. */
+int tracebin_read_header(tracebin_reader_t *r, const void *buf, size_t len,
+		tracebin_header_t *header);
+int tracebin_read_op(tracebin_reader_t *r, char *type, long *index,
+		size_t *size, size_t *align);
+
+/* Both return 0, or -1 if the stream reports an error, type is unknown or
+   the alignment of an 'm' is not a power of two */
+int tracebin_write_header(tracebin_writer_t *w, FILE *out,
+		const tracebin_header_t *header);
+int tracebin_write_op(tracebin_writer_t *w, char type, long index, size_t size,
+		size_t align);
+
+#endif /* __TRACEBIN_H__ */
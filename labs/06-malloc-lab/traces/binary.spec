@@ -0,0 +1,11 @@
+# Like gen_binary.pl: 64-byte blocks that stay between 448-byte ones
+# that go, then 512-byte requests that fit none of the holes
+phase 2000
+size 1 64
+life 1 inf
+size 1 448
+life 1 1000 2000
+
+phase 1000
+size 1 512
+life 1 inf
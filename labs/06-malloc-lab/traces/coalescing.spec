@@ -0,0 +1,6 @@
+# Like gen_coalescing.pl: two 4095-byte blocks freed at once, then a
+# block of both their sizes in the space they leave
+phase 2400
+life 1 0 1
+size 2 4095
+size 1 8190
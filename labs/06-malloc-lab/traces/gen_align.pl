@@ -0,0 +1,70 @@
+#!/usr/bin/perl
+
+# Random malloc, memalign, realloc and free requests: a quarter of the
+# blocks ask for an alignment of 16 to 8192 bytes, and a few are large
+# enough to be mapped on their own.
+
+$out_filename = $ARGV[0];
+$out_filename = "align-bal.rep" unless $out_filename;
+$num_blocks = $ARGV[1];
+$num_blocks = 2400 unless $num_blocks;
+$max_blk_size = $ARGV[2];
+$max_blk_size = 4096 unless $max_blk_size;
+
+srand(15213);
+
+# Create trace
+# Make a series of allocations, some aligned, some reallocated later
+for ($i = 0;  $i < $num_blocks; $i += 1) {
+    $size = int(rand $max_blk_size) + 1;
+    $size *= 64 if rand() < 0.02;
+    $op = {};
+    $op->{type} = "a";
+    $op->{seq} = $i;
+    $op->{size} = $size;
+    if (rand() < 0.25) {
+        $op->{type} = "m";
+        $op->{align} = 1 << (4 + int(rand 10));
+    }
+    $total_block_size += $size;
+    push @trace, $op;
+    if (rand() < 0.1) {
+        $op = {};
+        $op->{type} = "r";
+        $op->{seq} = $i;
+        $op->{size} = int(rand $max_blk_size) + 1;
+        push @trace, $op;
+    }
+}
+$num_allocs = scalar @trace;
+# Insert free()s in proper places, after the block's last request
+for ($i = 0;  $i < $num_blocks; $i += 1) {
+    for ($last = scalar(@trace) - 1; $trace[$last]->{seq} != $i; $last -= 1) {
+    }
+    $pos = int(rand(scalar(@trace) - $last - 1) + $last + 1);
+    $op = {};
+    $op->{type} = "f";
+    $op->{seq} = $i;
+    splice @trace, $pos, 0, $op;
+}
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+$num_ops = scalar @trace;
+
+print OUTFILE "1\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "0\n";
+
+for ($i = 0;  $i < $num_ops; $i += 1) {
+    $op = $trace[$i];
+    if ($op->{type} eq "m") {
+        print OUTFILE "m $op->{seq} $op->{size} $op->{align}\n";
+    } elsif ($op->{type} eq "f") {
+        print OUTFILE "f $op->{seq}\n";
+    } else {
+        print OUTFILE "$op->{type} $op->{seq} $op->{size}\n";
+    }
+}
@@ -0,0 +1,64 @@
+#!/usr/bin/perl
+
+# A heap past 4 GB with little of it in use: blocks of 1, 1.5, 2 and
+# 2.1 GB are freed between 16-byte pins, small blocks past 6.5 GB are
+# freed and reused, and then the pins are freed, which coalesces the
+# holes into more than 4 GB. Run it with mdriver -H 8192 and a build
+# that keeps large blocks in the heap (MMFLAGS=-DMM_MMAP_THRESHOLD=0).
+
+$out_filename = $ARGV[0];
+$out_filename = "bigheap.rep" unless $out_filename;
+$num_ids = 0;
+
+sub alloc {
+    my ($size) = @_;
+    push @trace, "a $num_ids $size";
+    return $num_ids++;
+}
+
+sub release {
+    my ($id) = @_;
+    push @trace, "f $id";
+}
+
+# Separate holes: the heap passes 6.5 GB
+foreach $size (1 << 30, 1610612736, 2000000000, 2100000000) {
+    $big = alloc($size);
+    push @pins, alloc(16);
+    release($big);
+}
+# Small blocks beyond 4 GB, freed into the lists and reused
+for ($i = 0; $i < 64; $i += 1) {
+    push @small, alloc(24 + 8 * $i);
+}
+for ($i = 0; $i < 64; $i += 2) {
+    release($small[$i]);
+}
+for ($i = 0; $i < 64; $i += 2) {
+    push @again, alloc(24 + 8 * $i);
+}
+for ($i = 1; $i < 64; $i += 2) {
+    release($small[$i]);
+}
+foreach $id (@again) {
+    release($id);
+}
+# Coalescing all the holes would pass 4 GB
+foreach $id (@pins) {
+    release($id);
+}
+release(alloc(100));
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+$num_ops = scalar @trace;
+
+print OUTFILE "1\n";
+print OUTFILE "$num_ids\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "0\n";
+
+for ($i = 0;  $i < $num_ops; $i += 1) {
+    print OUTFILE "$trace[$i]\n";
+}
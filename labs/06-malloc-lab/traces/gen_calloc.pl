@@ -0,0 +1,59 @@
+#!/usr/bin/perl
+
+# Hash tables that grow by calloc: each table starts at 64 16-byte
+# buckets and, when its entries reach the bucket count, callocs a table
+# twice the size and frees the old one. Entries are malloc'd and a tenth of them freed
+# again, so the tables land on recycled as well as fresh memory. The
+# largest tables pass the 128 KB at which mm.c maps a block on its own.
+
+$out_filename = $ARGV[0];
+$out_filename = "calloc-bal.rep" unless $out_filename;
+$num_tables = $ARGV[1];
+$num_tables = 8 unless $num_tables;
+$num_entries = $ARGV[2];
+$num_entries = 12000 unless $num_entries;
+
+srand(15213);
+
+$num_ids = 0;
+for ($t = 0; $t < $num_tables; $t += 1) {
+    $buckets[$t] = 64;
+    $count[$t] = 0;
+    $table[$t] = $num_ids++;
+    push @trace, "c $table[$t] " . ($buckets[$t] * 16);
+}
+
+for ($i = 0; $i < $num_entries; $i += 1) {
+    # a few tables get most of the entries
+    $t = int($num_tables * rand() ** 2);
+    $id = $num_ids++;
+    push @trace, "a $id " . (16 + int(rand 48));
+    push @live, $id;
+    if (++$count[$t] >= $buckets[$t]) {
+        $buckets[$t] *= 2;
+        $new = $num_ids++;
+        push @trace, "c $new " . ($buckets[$t] * 16);
+        push @trace, "f $table[$t]";
+        $table[$t] = $new;
+    }
+    if (rand() < 0.1) {
+        $j = int(rand scalar @live);
+        push @trace, "f $live[$j]";
+        $live[$j] = $live[-1];
+        pop @live;
+    }
+}
+
+push @trace, "f $_" foreach @live;
+push @trace, "f $table[$_]" foreach 0 .. $num_tables - 1;
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+$num_ops = scalar @trace;
+
+print OUTFILE "1\n";
+print OUTFILE "$num_ids\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "0\n";
+print OUTFILE "$_\n" foreach @trace;
@@ -0,0 +1,70 @@
+#!/usr/bin/perl
+
+# A heap that grows to 6 MB and shrinks back: 64 KB buffers below a
+# 16-byte pin are freed, making a 3 MB hole, and later those above it,
+# making a 3 MB free end of the heap. After each, a handful of small
+# blocks is allocated and freed for long enough that an allocator which
+# waits before giving memory back gives the hole, then the end, back.
+
+$out_filename = $ARGV[0];
+$out_filename = "shrink.rep" unless $out_filename;
+$num_ids = 0;
+
+srand(15213);
+
+sub alloc {
+    my ($size) = @_;
+    push @trace, "a $num_ids $size";
+    return $num_ids++;
+}
+
+sub release {
+    my ($id) = @_;
+    push @trace, "f $id";
+}
+
+# Free a run of blocks in random order
+sub release_all {
+    my @ids = @_;
+    while (@ids) {
+        release(splice @ids, int(rand @ids), 1);
+    }
+}
+
+# About 300 frees with at most 16 small blocks live
+sub churn {
+    for (my $i = 0; $i < 600; $i += 1) {
+        if (@live < 16 && (@live < 2 || rand() < 0.5)) {
+            push @live, alloc(int(rand 500) + 16);
+        } else {
+            release(splice @live, int(rand @live), 1);
+        }
+    }
+}
+
+for ($i = 0; $i < 48; $i += 1) {
+    push @low, alloc(65000);
+}
+$pin = alloc(16);
+for ($i = 0; $i < 48; $i += 1) {
+    push @high, alloc(65000);
+}
+release_all(@low);
+churn();
+release_all(@high);
+churn();
+release_all(@live, $pin);
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+$num_ops = scalar @trace;
+
+print OUTFILE "0\n";
+print OUTFILE "$num_ids\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "0\n";
+
+for ($i = 0;  $i < $num_ops; $i += 1) {
+    print OUTFILE "$trace[$i]\n";
+}
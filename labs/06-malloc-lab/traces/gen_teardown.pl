@@ -0,0 +1,61 @@
+#!/usr/bin/perl
+
+# Connections of a proxy: each allocates a few dozen buffers over its life,
+# interleaved with the other live connections, and frees them all in a row
+# when it closes, as a server tears one down.
+
+$out_filename = $ARGV[0];
+$out_filename = "teardown-bal.rep" unless $out_filename;
+$num_conns = $ARGV[1];
+$num_conns = 600 unless $num_conns;
+$max_live = $ARGV[2];
+$max_live = 24 unless $max_live;
+
+srand(15213);
+
+sub buffer_size {
+    my $r = rand();
+    return 1 << (12 + int(rand 3)) if $r < 0.1;    # 4 to 16 KB reads
+    return int(rand 2048) + 1 if $r < 0.6;         # headers and strings
+    return int(rand 128) + 16;                     # small records
+}
+
+$num_ids = 0;
+$opened = 0;
+@live = ();
+while ($opened < $num_conns || @live) {
+    $r = rand();
+    if ($opened < $num_conns && (@live < 2 || ($r < 0.05 && @live < $max_live))) {
+        # accept a connection
+        push @live, { left => 8 + int(rand 41), bufs => [] };
+        $opened += 1;
+    } elsif ($r < 0.9 || $opened == $num_conns) {
+        $c = $live[int(rand @live)];
+        if ($c->{left} > 0) {
+            push @trace, "a $num_ids " . buffer_size();
+            push @{$c->{bufs}}, $num_ids++;
+            $c->{left} -= 1;
+            next;
+        }
+        # done: tear it down, freeing its buffers in a row
+        @bufs = @{$c->{bufs}};
+        while (@bufs) {
+            $id = splice @bufs, int(rand @bufs), 1;
+            push @trace, "f $id";
+        }
+        @live = grep { $_ != $c } @live;
+    }
+}
+
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+$num_ops = scalar @trace;
+
+print OUTFILE "1\n";
+print OUTFILE "$num_ids\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "0\n";
+
+for ($i = 0;  $i < $num_ops; $i += 1) {
+    print OUTFILE "$trace[$i]\n";
+}
@@ -1,183 +1,345 @@
 /*
- * This file is useful for generating a trace.  After making
- * a dynamic executable for this, LD_PRELOAD it and run your program.
- * It will dump the malloc/free trace into a file as directed by
- * the GENERATE_TRACE_OUTPUT envvar.
+ * This file is useful for generating a trace.  Build get-trace.so,
+ * LD_PRELOAD it and run your program:
  *
- * Each pointer is labeled with its address and its PID.
- * A null pointer is labeled just as 0.
+ *     GENERATE_TRACE_OUTPUT=/tmp/proxy LD_PRELOAD=./get-trace.so ./proxy 8080
+ *
+ * Every malloc, calloc, realloc, free and aligned allocation is logged
+ * to <GENERATE_TRACE_OUTPUT>.<pid> (default /tmp/trace.<pid>) as a binary
+ * event with a time stamp, the thread id and a hash of the call site, see
+ * get-trace.h. ../trace2rep turns the log into a trace for the driver.
+ *
+ * The calls themselves go to the libc allocator. Each thread appends its
+ * events to its own ring buffer, without locks or system calls; a writer
+ * thread drains all the rings every millisecond. A thread that fills its
+ * ring before then writes it out itself. The ring of a thread that exits
+ * is reused by the next thread that starts, and a forked child gets a log
+ * of its own. Events still in the rings are written at exit, but not if
+ * the process is killed by a signal.
  */
 
 #define _GNU_SOURCE
 #include <sys/types.h>
 
-#include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
-#include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "get-trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CLOCK GET_TRACE_CLOCK_TSC
+static inline uint64_t now(void) {
+    return __rdtsc();
+}
+#else
+#define CLOCK GET_TRACE_CLOCK_NS
+static inline uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
 
-static char file_prefix[] = ""
-"# Memory trace collected by get-trace.o\n"
-"# Use produce-simple-trace to translate to the format\n"
-"# used by the driver.\n"
-"# Format:\n"
-"# m p u     => p = malloc(u);\n"
-"# c p u1 u2 => p = calloc(u1,u2);\n"
-"# r p1 p2 u => p1 = realloc(p2, u);\n"
-"# f p       => free(p);\n"
-"\n";
+/* the allocator we trace */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t align, size_t size);
 
-static double memory[1<<26]; /* a short execution will work */
-static int myheapend = 0;
+#define RING_EVENTS 16384       /* per thread, a power of two */
+#define FLUSH_NS 1000000        /* how often the writer drains the rings */
 
-static int outfd = -1;
+typedef struct ring {
+    get_trace_event_t ev[RING_EVENTS];
+    _Atomic uint64_t head;      /* next event the thread writes */
+    _Atomic uint64_t tail;      /* next event the writer reads */
+    _Atomic int owned;          /* cleared when its thread exits */
+    uint32_t tid;
+    struct ring *next;          /* all rings, never unlinked */
+} ring_t;
 
-#define BUFFER_LEN 4000
-typedef char myline[64];
-static myline buffer[BUFFER_LEN];
-static int nbuffered = 0;
+#define TLS __thread __attribute__((tls_model("initial-exec")))
 
-static void clear_buffer(void) {
-    int i;
+static TLS ring_t *my_ring;
+static TLS int in_tracer;       /* don't trace the tracer */
 
-    if(outfd == -1) {
-        const char *outname;
-        char namebuf[4096];
-        char linkbuf[4096];
-        int trynum = 0;
-        int len;
+static _Atomic(ring_t *) rings;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
 
-        outname = getenv("GENERATE_TRACE_OUTPUT");
-        if(!outname) {
-            outname = "/tmp/trace";
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static int outfd = -1;
+static pthread_t writer;
+static atomic_int writer_running;
+static atomic_int writer_stop;
+static atomic_int finished;     /* past our destructor: flush every event */
+
+static void write_all(const void *buf, size_t len) {
+    const char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(outfd, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
         }
+        p += n;
+        len -= n;
+    }
+}
 
-        /* get the executable name (on linux <= 2.0 we get the inode number;
-           on other platforms we may just fail) */
-        sprintf(namebuf, "/proc/%u/exe", (unsigned) getpid());
-        len = readlink(namebuf, linkbuf, sizeof(linkbuf));
-        if(len >= 0) {
-            int i;
-            for(i = 0; i < len; i++) {
-                if(linkbuf[i] == '/') linkbuf[i] = '_';
-            }
-            linkbuf[len] = 0;
-            sprintf(namebuf, "%s.%s", outname, linkbuf);
-        }
+/* Called with flush_lock held */
+static void open_output(void) {
+    const char *outname;
+    char namebuf[4096];
+    get_trace_header_t header;
+    int trynum = 0;
+
+    if (outfd >= 0)
+        return;
+    outname = getenv("GENERATE_TRACE_OUTPUT");
+    if (!outname)
+        outname = "/tmp/trace";
+    snprintf(namebuf, sizeof(namebuf), "%s.%u", outname, (unsigned) getpid());
+    while ((outfd = open(namebuf, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0666)) < 0) {
+        if (errno != EEXIST || ++trynum > 10000)
+            return;
+        snprintf(namebuf, sizeof(namebuf), "%s.%u.%d", outname,
+                 (unsigned) getpid(), trynum);
+    }
 
-        outfd = open(namebuf, O_CREAT | O_EXCL | O_WRONLY, 0666);
-        if(outfd < 0) {
-            char basename[4096];
-            strcpy(basename, namebuf);
-            do {
-                assert(trynum < 10000);
-                sprintf(namebuf, "%s.%d", basename, ++trynum);
-                outfd = open(namebuf, O_CREAT | O_EXCL | O_WRONLY, 0666);
-            } while(outfd < 0);
-        }
-        fcntl(outfd, F_SETFD, 1); /* close-on-exec */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GET_TRACE_MAGIC, GET_TRACE_MAGIC_LEN);
+    header.pid = getpid();
+    header.clock = CLOCK;
+    header.event_size = sizeof(get_trace_event_t);
+    write_all(&header, sizeof(header));
+}
 
-        write(outfd, file_prefix, strlen(file_prefix));
+/* Write out a ring's pending events; called with flush_lock held */
+static void flush_ring(ring_t *r) {
+    uint64_t head, tail, n;
+
+    open_output();
+    head = atomic_load_explicit(&r->head, memory_order_acquire);
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    while (tail != head) {
+        n = RING_EVENTS - (tail & (RING_EVENTS - 1));
+        if (n > head - tail)
+            n = head - tail;
+        if (outfd >= 0)
+            write_all(&r->ev[tail & (RING_EVENTS - 1)], n * sizeof(get_trace_event_t));
+        tail += n;
     }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+static void flush_all(void) {
+    ring_t *r;
+
+    pthread_mutex_lock(&flush_lock);
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next)
+        flush_ring(r);
+    pthread_mutex_unlock(&flush_lock);
+}
+
+static void *writer_thread(void *arg) {
+    struct timespec ts = { 0, FLUSH_NS };
 
-    for(i = 0; i < nbuffered; i++) {
-        write(outfd, buffer[i], strlen(buffer[i]));
+    (void) arg;
+    in_tracer = 1;
+    while (!atomic_load(&writer_stop)) {
+        flush_all();
+        nanosleep(&ts, NULL);
     }
-    nbuffered = 0;
+    return NULL;
 }
 
-static void clear_buffer_and_close(void) {
-    clear_buffer();
-    close(outfd);
+static void start_writer(void) {
+    atomic_store(&writer_stop, 0);
+    if (pthread_create(&writer, NULL, writer_thread, NULL) == 0)
+        atomic_store(&writer_running, 1);
 }
 
+/* The thread is exiting: leave its ring to the next thread */
+static void release_ring(void *arg) {
+    ring_t *r = arg;
 
-static void mywrite(const char *fmt, ...) {
-    char buf[256];
-    va_list ap;
-    int len;
-    int i;
+    in_tracer = 1;
+    my_ring = NULL;
+    atomic_store_explicit(&r->owned, 0, memory_order_release);
+}
+
+static void make_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
 
-    va_start(ap, fmt);
-    len = vsprintf(buf, fmt, ap);
-    va_end(ap);
-    assert(len >= 0);
+static ring_t *get_ring(void) {
+    ring_t *r;
+    int unowned;
 
-    for(i = 0; i <= len; i++) {
-        buffer[nbuffered][i] = buf[i];
+    if (my_ring)
+        return my_ring;
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next) {
+        unowned = 0;
+        if (atomic_compare_exchange_strong(&r->owned, &unowned, 1))
+            break;
     }
-    nbuffered++;
-    if(nbuffered == BUFFER_LEN) {
-        clear_buffer();
+    if (!r) {
+        r = mmap(NULL, sizeof(ring_t), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r == MAP_FAILED)
+            return NULL;
+        atomic_init(&r->owned, 1);
+        r->next = atomic_load_explicit(&rings, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&rings, &r->next, r,
+                    memory_order_release, memory_order_relaxed))
+            ;
     }
+    r->tid = syscall(SYS_gettid);
+    pthread_once(&ring_key_once, make_ring_key);
+    pthread_setspecific(ring_key, r);
+    return my_ring = r;
 }
 
-static const char *print_ptr(const void *p) {
-    /* realloc needs to print two pointers */
-    static char buf1[256];
-    static char buf2[256];
-    static char *which = buf1;
-    char *mine = which;
+static void record(uint32_t type, const void *ptr, const void *old,
+                   size_t size, size_t align, const void *site) {
+    ring_t *r;
+    uint64_t head;
+    get_trace_event_t *e;
+
+    if (in_tracer)
+        return;
+    in_tracer = 1;
+    if ((r = get_ring()) == NULL) {
+        in_tracer = 0;
+        return;
+    }
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == RING_EVENTS) {
+        /* faster than the writer: write the ring out ourselves */
+        pthread_mutex_lock(&flush_lock);
+        flush_ring(r);
+        pthread_mutex_unlock(&flush_lock);
+    }
+    e = &r->ev[head & (RING_EVENTS - 1)];
+    e->time = now();
+    e->ptr = (uintptr_t) ptr;
+    e->old = (uintptr_t) old;
+    e->size = size;
+    e->tid = r->tid;
+    e->site = ((uintptr_t) site * 0x9e3779b97f4a7c15ULL) >> 32;
+    e->type = type;
+    e->align = align;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    if (atomic_load_explicit(&finished, memory_order_relaxed))
+        flush_all();
+    in_tracer = 0;
+}
 
-    if(p==0) {
-        sprintf(mine, "0");
-    } else {
-        sprintf(mine, "%p/%u", p, (unsigned) getpid());
+/* A forked child has only the forking thread and logs to a file of its
+   own; what the parent had not flushed yet is the parent's to write */
+static void atfork_child(void) {
+    ring_t *r;
+
+    pthread_mutex_init(&flush_lock, NULL);
+    outfd = -1;
+    for (r = atomic_load(&rings); r; r = r->next) {
+        atomic_store(&r->tail, atomic_load(&r->head));
+        if (r != my_ring)
+            atomic_store(&r->owned, 0);
     }
-    which = (which == buf1) ? buf2 : buf1;
-    return mine;
+    if (my_ring)
+        my_ring->tid = syscall(SYS_gettid);
+    atomic_store(&writer_running, 0);
+    if (!atomic_load(&finished))
+        start_writer();
 }
 
+__attribute__((constructor))
 static void init(void) {
-    atexit(clear_buffer_and_close);
+    in_tracer = 1;
+    pthread_atfork(NULL, NULL, atfork_child);
+    start_writer();
+    in_tracer = 0;
 }
 
-void *malloc(size_t sz) {
-    if(myheapend==0) init();
+__attribute__((destructor))
+static void fini(void) {
+    in_tracer = 1;
+    if (atomic_load(&writer_running)) {
+        atomic_store(&writer_stop, 1);
+        pthread_join(writer, NULL);
+        atomic_store(&writer_running, 0);
+    }
+    atomic_store(&finished, 1);
+    flush_all();
+    in_tracer = 0;
+}
 
-    void *p = &memory[myheapend];
-    myheapend += ((sz-1) / sizeof(*memory)) + 1;
+#define SITE __builtin_return_address(0)
 
-    mywrite("m %s %u\n", print_ptr(p), sz);
+void *malloc(size_t sz) {
+    void *p = __libc_malloc(sz);
+    record(GET_TRACE_MALLOC, p, NULL, sz, 0, SITE);
     return p;
 }
 
 void *calloc(size_t sz1, size_t sz2) {
-    if(myheapend==0) init();
-
-    size_t sz = sz1 * sz2;
-    char *p = (void*)&memory[myheapend];
-    int i;
-    myheapend += ((sz-1) / sizeof(*memory)) + 1;
-    for(i = 0; i < sz; i++) p[i] = 0;
-
-    mywrite("c %s %u %u\n", print_ptr(p), sz1, sz2);
+    void *p = __libc_calloc(sz1, sz2);
+    record(GET_TRACE_CALLOC, p, NULL, sz1 * sz2, 0, SITE);
     return p;
 }
 
 void *realloc(void *oldp, size_t sz) {
-    if(myheapend==0) init();
+    void *p;
 
+    /* the old block may be freed and reused before the call returns */
+    if (oldp)
+        record(GET_TRACE_REALLOC_OLD, oldp, NULL, sz, 0, SITE);
+    p = __libc_realloc(oldp, sz);
+    record(GET_TRACE_REALLOC, p, oldp, sz, 0, SITE);
+    return p;
+}
 
-    char *p;
-    if(sz == 0) {
-        p = 0;
-    } else {
-        p = (void*)&memory[myheapend];
-        myheapend += ((sz-1) / sizeof(*memory)) + 1;
-    }
+void free(void *p) {
+    record(GET_TRACE_FREE, p, NULL, 0, 0, SITE);
+    __libc_free(p);
+}
 
-    if(sz && oldp) {
-        int i;
-        memcpy(p, oldp, sz); /* clobbers after p; not a problem */
-        for(i = 0; i < sz; i++) p[i] = ((char*)oldp)[i];
-    }
+void *memalign(size_t align, size_t sz) {
+    void *p = __libc_memalign(align, sz);
+    record(GET_TRACE_MEMALIGN, p, NULL, sz, align, SITE);
+    return p;
+}
 
-    mywrite("r %s %s %u\n", print_ptr(p), print_ptr(oldp), sz);
+void *aligned_alloc(size_t align, size_t sz) {
+    void *p = __libc_memalign(align, sz);
+    record(GET_TRACE_MEMALIGN, p, NULL, sz, align, SITE);
     return p;
 }
 
-void free(void *p) {
-    if(myheapend==0) init();
-    mywrite("f %s\n", print_ptr(p));
+int posix_memalign(void **pp, size_t align, size_t sz) {
+    void *p;
+
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+        return EINVAL;
+    if ((p = __libc_memalign(align, sz)) == NULL)
+        return ENOMEM;
+    record(GET_TRACE_MEMALIGN, p, NULL, sz, align, SITE);
+    *pp = p;
+    return 0;
 }
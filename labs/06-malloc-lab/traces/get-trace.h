@@ -0,0 +1,58 @@
+/*
+ * get-trace.h - the binary event log written by get-trace.so
+ *
+ * The file starts with a get_trace_header_t and is followed by fixed-size
+ * events. Each thread's events appear in the order it made its calls, but
+ * the writer flushes the threads one after another, so events of different
+ * threads interleave in chunks; sort by time to get the process's order.
+ * Allocations are stamped when the call returns and frees before it is
+ * made, so a block is always allocated before another thread frees it.
+ * A realloc may free the old block inside the call, and another thread
+ * may get it back before the call returns, so a realloc of a block logs
+ * it twice: GET_TRACE_REALLOC_OLD before the call gives the old block up,
+ * and GET_TRACE_REALLOC after it names the new one.
+ */
+#ifndef __GET_TRACE_H__
+#define __GET_TRACE_H__
+
+#include <stdint.h>
+
+#define GET_TRACE_MAGIC "mmraw1\0\0"
+#define GET_TRACE_MAGIC_LEN 8
+
+/* Event types */
+enum {
+	GET_TRACE_MALLOC,
+	GET_TRACE_CALLOC,	/* size is the product of the two arguments */
+	GET_TRACE_REALLOC,
+	GET_TRACE_FREE,
+	GET_TRACE_MEMALIGN,	/* memalign, posix_memalign and aligned_alloc */
+	GET_TRACE_REALLOC_OLD,	/* realloc: ptr is the block resized */
+};
+
+/* Clocks of the time stamps */
+enum {
+	GET_TRACE_CLOCK_NS,	/* clock_gettime(CLOCK_MONOTONIC) in ns */
+	GET_TRACE_CLOCK_TSC,	/* x86 time stamp counter */
+};
+
+typedef struct {
+	char magic[GET_TRACE_MAGIC_LEN];
+	uint32_t pid;
+	uint32_t clock;
+	uint32_t event_size;	/* sizeof(get_trace_event_t) */
+	uint32_t pad;
+} get_trace_header_t;
+
+typedef struct {
+	uint64_t time;
+	uint64_t ptr;		/* the block returned, or freed */
+	uint64_t old;		/* realloc: the block resized */
+	uint64_t size;		/* bytes asked for */
+	uint32_t tid;
+	uint32_t site;		/* hash of the caller's return address */
+	uint32_t type;
+	uint32_t align;		/* memalign: the alignment */
+} get_trace_event_t;
+
+#endif /* __GET_TRACE_H__ */
@@ -0,0 +1,5 @@
+# Like gen_random.pl: sizes up to 32 KB, each block freed at a random
+# point in the rest of the trace
+phase 2400
+size 1 1 32767
+life 1 0 2400
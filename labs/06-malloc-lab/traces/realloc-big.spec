@@ -0,0 +1,13 @@
+# Several large blocks, all mapped on their own, grown by realloc in
+# turn while short-lived small blocks come and go: a mapping grows in
+# place, is moved, then grows in place again, so it spans more than one
+# kernel mapping the next time it has to move
+phase 8
+size 1 131072 262144
+life 1 inf
+
+phase 400
+size 1 64 256
+life 1 0 2
+realloc 100
+resize 1 131072 2097152
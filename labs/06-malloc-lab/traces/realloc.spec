@@ -0,0 +1,11 @@
+# Like gen_realloc.pl: one block grown by realloc while short-lived
+# 128-byte blocks come and go around it
+phase 1
+size 1 512
+life 1 inf
+
+phase 4800
+size 1 128
+life 1 1
+realloc 50
+resize 1 640 615040
@@ -0,0 +1,193 @@
+#include <stddef.h>
+#include "cache.h"
+
+/* FNV-1a */
+static unsigned hash_key(const char *key) {
+    unsigned h = 2166136261u;
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void reclaim_obj(epoch_entry_t *e) {
+    Free((char *)e - offsetof(cache_obj_t, retire));
+}
+
+/*
+ * Helper routines for the LRU list
+ * Assume mutually exclusive access
+ */
+static void lru_unlink(cache_t *c, cache_obj_t *o) {
+    if (o->lru_prev)
+        o->lru_prev->lru_next = o->lru_next;
+    else
+        c->lru_head = o->lru_next;
+    if (o->lru_next)
+        o->lru_next->lru_prev = o->lru_prev;
+    else
+        c->lru_tail = o->lru_prev;
+}
+
+static void lru_push_front(cache_t *c, cache_obj_t *o) {
+    o->lru_prev = NULL;
+    o->lru_next = c->lru_head;
+    if (c->lru_head)
+        c->lru_head->lru_prev = o;
+    else
+        c->lru_tail = o;
+    c->lru_head = o;
+}
+
+/*
+ * Helper routine to find the chain link pointing at o
+ * Assume mutually exclusive access
+ */
+static cache_obj_t *_Atomic *find_link(cache_t *c, cache_obj_t *o) {
+    cache_obj_t *_Atomic *pp = &c->buckets[o->hash % CACHE_NBUCKETS];
+    while (atomic_load_explicit(pp, memory_order_relaxed) != o)
+        pp = &atomic_load_explicit(pp, memory_order_relaxed)->next;
+    return pp;
+}
+
+/*
+ * Apply the hits buffered by every thread to the LRU list. Hits on objects
+ * that have since been replaced or evicted no longer match any id.
+ * Assume mutually exclusive access
+ */
+static void drain_hits(cache_t *c) {
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        cache_ring_t *r = &c->rings[i];
+        unsigned t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        unsigned h = atomic_load_explicit(&r->head, memory_order_acquire);
+        for (; t != h; t++) {
+            cache_hit_t *hit = &r->hits[t % CACHE_RING];
+            cache_obj_t *o = atomic_load_explicit(&c->buckets[hit->hash % CACHE_NBUCKETS],
+                                                  memory_order_relaxed);
+            while (o && o->id != hit->id)
+                o = atomic_load_explicit(&o->next, memory_order_relaxed);
+            if (o && o != c->lru_head) {
+                lru_unlink(c, o);
+                lru_push_front(c, o);
+            }
+        }
+        atomic_store_explicit(&r->tail, t, memory_order_release);
+    }
+}
+
+/*
+ * Helper routine to record a hit in the calling thread's ring. Only the
+ * ring's head is written, and no other thread produces into this ring.
+ */
+static void record_hit(cache_t *c, const cache_obj_t *o) {
+    cache_ring_t *r = &c->rings[epoch_thread_id()];
+    unsigned h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned used = h - atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if (used < CACHE_RING) {
+        r->hits[h % CACHE_RING].hash = o->hash;
+        r->hits[h % CACHE_RING].id = o->id;
+        atomic_store_explicit(&r->head, h + 1, memory_order_release);
+    }
+    /* Ring filling up and no writer around: apply the hits ourselves */
+    if (used >= CACHE_RING / 2 && sem_trywait(&c->mutex) == 0) {
+        drain_hits(c);
+        V(&c->mutex);
+    }
+}
+
+/*
+ * Helper routine to unlink the least recently used object
+ * Assume mutually exclusive access
+ */
+static void evict(cache_t *c) {
+    cache_obj_t *o = c->lru_tail;
+    cache_obj_t *_Atomic *pp = find_link(c, o);
+
+    atomic_store_explicit(pp, atomic_load_explicit(&o->next, memory_order_relaxed),
+                          memory_order_release);
+    lru_unlink(c, o);
+    c->total_size -= o->size;
+    epoch_retire(&o->retire, reclaim_obj);
+}
+
+void cache_init(cache_t *c, size_t max_size) {
+    for (int i = 0; i < CACHE_NBUCKETS; i++)
+        atomic_init(&c->buckets[i], NULL);
+    Sem_init(&c->mutex, 0, 1);
+    c->lru_head = NULL;
+    c->lru_tail = NULL;
+    c->max_size = max_size;
+    c->total_size = 0;
+    c->next_id = 1;
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        atomic_init(&c->rings[i].head, 0);
+        atomic_init(&c->rings[i].tail, 0);
+    }
+}
+
+const cache_obj_t *cache_lookup(cache_t *c, const char *key) {
+    unsigned h = hash_key(key);
+    cache_obj_t *o = atomic_load_explicit(&c->buckets[h % CACHE_NBUCKETS],
+                                          memory_order_acquire);
+
+    for (; o != NULL; o = atomic_load_explicit(&o->next, memory_order_acquire)) {
+        if (o->hash == h && !strcmp(o->key, key)) {
+            record_hit(c, o);
+            return o;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * cache_insert - add a copy of data under key, replacing any previous
+ *     object with that key and evicting until the cache fits
+ */
+bool cache_insert(cache_t *c, const char *key, const char *data, size_t size) {
+    size_t keylen = strlen(key) + 1;
+    cache_obj_t *o, *old;
+    cache_obj_t *_Atomic *pp;
+
+    if (size > c->max_size)
+        return false;
+
+    o = Malloc(sizeof(cache_obj_t) + size + keylen);
+    o->hash = hash_key(key);
+    o->size = size;
+    o->key = o->data + size;
+    memcpy(o->data, data, size);
+    memcpy(o->key, key, keylen);
+
+    P(&c->mutex);
+    drain_hits(c);
+    o->id = c->next_id++;
+
+    /* Look for an older version to replace */
+    pp = &c->buckets[o->hash % CACHE_NBUCKETS];
+    while ((old = atomic_load_explicit(pp, memory_order_relaxed)) != NULL) {
+        if (old->hash == o->hash && !strcmp(old->key, key))
+            break;
+        pp = &old->next;
+    }
+    if (old) {
+        atomic_init(&o->next, atomic_load_explicit(&old->next, memory_order_relaxed));
+        atomic_store_explicit(pp, o, memory_order_release);
+        lru_unlink(c, old);
+        c->total_size -= old->size;
+        epoch_retire(&old->retire, reclaim_obj);
+    } else {
+        pp = &c->buckets[o->hash % CACHE_NBUCKETS];
+        atomic_init(&o->next, atomic_load_explicit(pp, memory_order_relaxed));
+        atomic_store_explicit(pp, o, memory_order_release);
+    }
+    lru_push_front(c, o);
+    c->total_size += size;
+
+    while (c->total_size > c->max_size)
+        evict(c);
+    epoch_reclaim();
+    V(&c->mutex);
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+ * Web object cache for the proxy.
+ *
+ * Lookups walk a hash index with plain loads only, relying on epoch-based
+ * reclamation (epoch.h) to keep objects alive until the reader's next
+ * quiescent state. Writers are serialized by a mutex, publish new objects
+ * with release stores and retire the ones they replace or evict.
+ *
+ * LRU order is maintained only by writers. A hit is recorded in the reading
+ * thread's own ring buffer and applied to the LRU list later, by the next
+ * writer or by the reader itself when its ring fills up.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "csapp.h"
+#include "epoch.h"
+
+#define CACHE_NBUCKETS 1024  // Hash index size
+#define CACHE_RING 64        // Hits buffered per thread before dropping
+
+typedef struct CACHEOBJ {
+    struct CACHEOBJ *_Atomic next;  // Hash chain, read without locks
+    struct CACHEOBJ *lru_prev;      // LRU list, writers only
+    struct CACHEOBJ *lru_next;
+    epoch_entry_t retire;           // Deferred free
+    unsigned long id;               // Unique, identifies buffered hits
+    unsigned hash;
+    size_t size;                    // Bytes in data
+    char *key;                      // Points behind data
+    char data[];
+} cache_obj_t;
+
+/* A buffered hit; the id is checked before the object is touched */
+typedef struct {
+    unsigned hash;
+    unsigned long id;
+} cache_hit_t;
+
+/* Single producer (owning thread), single consumer (mutex holder) ring */
+typedef struct {
+    _Alignas(EPOCH_LINE) atomic_uint head;
+    atomic_uint tail;
+    cache_hit_t hits[CACHE_RING];
+} cache_ring_t;
+
+typedef struct {
+    cache_obj_t *_Atomic buckets[CACHE_NBUCKETS];
+    sem_t mutex;               // Serializes writers
+    cache_obj_t *lru_head;     // Most recently used
+    cache_obj_t *lru_tail;     // Next to be evicted
+    size_t max_size;
+    size_t total_size;
+    unsigned long next_id;
+    cache_ring_t rings[EPOCH_MAX_THREADS];
+} cache_t;
+
+void cache_init(cache_t *c, size_t max_size);
+/* Result stays valid until the calling thread's next quiescent state */
+const cache_obj_t *cache_lookup(cache_t *c, const char *key);
+bool cache_insert(cache_t *c, const char *key, const char *data, size_t size);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,226 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "deflate.h"
+
+#define WSIZE 32768      // LZ77 window
+#define HASH_BITS 15
+#define MAX_CHAIN 32     // Candidates examined per position
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+
+static const unsigned short len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/* LSB-first bit writer into a bounded buffer */
+typedef struct {
+    unsigned char *out;
+    size_t pos;
+    size_t cap;
+    unsigned long bits;
+    int nbits;
+    int overflow;
+} bitwriter_t;
+
+static void put_byte(bitwriter_t *bw, unsigned char c) {
+    if (bw->pos < bw->cap)
+        bw->out[bw->pos++] = c;
+    else
+        bw->overflow = 1;
+}
+
+static void put_bits(bitwriter_t *bw, unsigned value, int n) {
+    bw->bits |= (unsigned long)value << bw->nbits;
+    bw->nbits += n;
+    while (bw->nbits >= 8) {
+        put_byte(bw, bw->bits & 0xff);
+        bw->bits >>= 8;
+        bw->nbits -= 8;
+    }
+}
+
+static void flush_bits(bitwriter_t *bw) {
+    if (bw->nbits > 0)
+        put_byte(bw, bw->bits & 0xff);
+    bw->bits = 0;
+    bw->nbits = 0;
+}
+
+/* Huffman codes are defined MSB-first but packed LSB-first */
+static void put_code(bitwriter_t *bw, unsigned code, int n) {
+    unsigned rev = 0;
+    for (int i = 0; i < n; i++)
+        rev |= ((code >> i) & 1) << (n - 1 - i);
+    put_bits(bw, rev, n);
+}
+
+/* Emit a literal/length symbol with the fixed code (RFC 1951 3.2.6) */
+static void put_litlen(bitwriter_t *bw, int sym) {
+    if (sym < 144)
+        put_code(bw, 0x30 + sym, 8);
+    else if (sym < 256)
+        put_code(bw, 0x190 + sym - 144, 9);
+    else if (sym < 280)
+        put_code(bw, sym - 256, 7);
+    else
+        put_code(bw, 0xc0 + sym - 280, 8);
+}
+
+static void put_match(bitwriter_t *bw, int len, int dist) {
+    int i = 28;
+    while (len_base[i] > len)
+        i--;
+    put_litlen(bw, 257 + i);
+    put_bits(bw, len - len_base[i], len_extra[i]);
+
+    i = 29;
+    while (dist_base[i] > dist)
+        i--;
+    put_code(bw, i, 5);
+    put_bits(bw, dist - dist_base[i], dist_extra[i]);
+}
+
+static unsigned hash3(const unsigned char *p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << HASH_BITS) - 1);
+}
+
+/*
+ * deflate_block - greedy LZ77 with hash chains, emitted as one final
+ *     fixed-Huffman block. Returns 0 on success, -1 on allocation failure.
+ */
+static int deflate_block(bitwriter_t *bw, const unsigned char *src, size_t len) {
+    int *head = malloc(sizeof(int) << HASH_BITS);
+    int *prev = malloc(sizeof(int) * WSIZE);
+    size_t i = 0;
+
+    if (!head || !prev) {
+        free(head);
+        free(prev);
+        return -1;
+    }
+    memset(head, 0xff, sizeof(int) << HASH_BITS);
+
+    put_bits(bw, 1, 1);     /* BFINAL */
+    put_bits(bw, 1, 2);     /* BTYPE = fixed Huffman */
+    while (i < len && !bw->overflow) {
+        int best_len = 0, best_dist = 0;
+        size_t step;
+
+        if (i + MIN_MATCH <= len) {
+            int max_len = (len - i < MAX_MATCH) ? len - i : MAX_MATCH;
+            int cand = head[hash3(src + i)];
+            int chain = MAX_CHAIN;
+            while (cand >= 0 && i - cand <= WSIZE && chain-- > 0) {
+                int l = 0;
+                while (l < max_len && src[cand + l] == src[i + l])
+                    l++;
+                if (l > best_len) {
+                    best_len = l;
+                    best_dist = i - cand;
+                    if (l == max_len)
+                        break;
+                }
+                int next = prev[cand % WSIZE];
+                if (next >= cand)
+                    break;
+                cand = next;
+            }
+        }
+
+        if (best_len >= MIN_MATCH) {
+            put_match(bw, best_len, best_dist);
+            step = best_len;
+        } else {
+            put_litlen(bw, src[i]);
+            step = 1;
+        }
+        /* Insert every covered position into the hash chains */
+        for (; step > 0; step--, i++) {
+            if (i + MIN_MATCH <= len) {
+                unsigned h = hash3(src + i);
+                prev[i % WSIZE] = head[h];
+                head[h] = i;
+            }
+        }
+    }
+    put_litlen(bw, 256);    /* End of block */
+    flush_bits(bw);
+
+    free(head);
+    free(prev);
+    return 0;
+}
+
+static unsigned long crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void init_crc_table(void) {
+    for (unsigned long n = 0; n < 256; n++) {
+        unsigned long c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static unsigned long crc32(const unsigned char *p, size_t len) {
+    unsigned long c = 0xffffffffUL;
+    pthread_once(&crc_once, init_crc_table);
+    while (len--)
+        c = crc_table[(c ^ *p++) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffUL;
+}
+
+static unsigned long adler32(const unsigned char *p, size_t len) {
+    unsigned long a = 1, b = 0;
+    while (len--) {
+        a = (a + *p++) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+size_t deflate_bound(size_t len) {
+    /* 9 bits per literal at worst, plus block and framing overhead */
+    return len + (len >> 3) + 64;
+}
+
+size_t gzip_compress(const void *src, size_t len, void *dst, size_t cap) {
+    static const unsigned char header[10] = {
+        0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};   /* deflate, no mtime, Unix */
+    bitwriter_t bw = {dst, 0, cap, 0, 0, 0};
+    unsigned long crc = crc32(src, len);
+
+    for (int i = 0; i < 10; i++)
+        put_byte(&bw, header[i]);
+    if (deflate_block(&bw, src, len) < 0)
+        return 0;
+    for (int i = 0; i < 4; i++)
+        put_byte(&bw, (crc >> (8 * i)) & 0xff);
+    for (int i = 0; i < 4; i++)
+        put_byte(&bw, (len >> (8 * i)) & 0xff);
+    return bw.overflow ? 0 : bw.pos;
+}
+
+size_t zlib_compress(const void *src, size_t len, void *dst, size_t cap) {
+    bitwriter_t bw = {dst, 0, cap, 0, 0, 0};
+    unsigned long adler = adler32(src, len);
+
+    put_byte(&bw, 0x78);    /* deflate, 32 KB window */
+    put_byte(&bw, 0x01);    /* no dictionary, check bits */
+    if (deflate_block(&bw, src, len) < 0)
+        return 0;
+    for (int i = 3; i >= 0; i--)
+        put_byte(&bw, (adler >> (8 * i)) & 0xff);
+    return bw.overflow ? 0 : bw.pos;
+}
@@ -0,0 +1,20 @@
+/*
+ * Self-contained DEFLATE (RFC 1951) compressor with gzip (RFC 1952) and
+ * zlib (RFC 1950) framing, for Content-Encoding: gzip / deflate.
+ *
+ * Greedy LZ77 over a 32 KB window with hash chains, emitted as a single
+ * block with the fixed Huffman code. Compression only; clients decode.
+ */
+#ifndef __DEFLATE_H__
+#define __DEFLATE_H__
+
+#include <stddef.h>
+
+/* Upper bound on the compressed size of len bytes, framing included */
+size_t deflate_bound(size_t len);
+
+/* Both return the compressed size, or 0 if it would exceed cap */
+size_t gzip_compress(const void *src, size_t len, void *dst, size_t cap);
+size_t zlib_compress(const void *src, size_t len, void *dst, size_t cap);
+
+#endif /* __DEFLATE_H__ */
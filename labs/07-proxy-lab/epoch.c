@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <limits.h>
+#include <stddef.h>
+#include "epoch.h"
+
+static atomic_ulong global_epoch = 1;
+static epoch_record_t records[EPOCH_MAX_THREADS];
+static __thread epoch_record_t *my_record = NULL;
+
+/* Retired entries in increasing epoch order; protected by the writers' lock */
+static epoch_entry_t *retired_head = NULL;
+static epoch_entry_t *retired_tail = NULL;
+
+/* Claim a record for the calling thread and go online */
+void epoch_register(void) {
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        int unused = 0;
+        if (atomic_compare_exchange_strong(&records[i].used, &unused, 1)) {
+            my_record = &records[i];
+            epoch_online();
+            return;
+        }
+    }
+    assert(!"too many threads registered");
+}
+
+void epoch_unregister(void) {
+    epoch_offline();
+    atomic_store(&my_record->used, 0);
+    my_record = NULL;
+}
+
+int epoch_thread_id(void) {
+    return my_record - records;
+}
+
+/*
+ * Announce that no reference obtained so far is still in use. The release
+ * store orders all earlier reads before it. A store does not keep later
+ * loads from passing it, so the fence makes the announcement visible
+ * before this thread reads any shared pointer again; epoch_reclaim fences
+ * before it reads the announcements, so either it sees ours or our reads
+ * see the unlinks it is about to reclaim.
+ */
+void epoch_quiescent(void) {
+    atomic_store_explicit(&my_record->seen,
+                          atomic_load_explicit(&global_epoch, memory_order_acquire),
+                          memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+/* Going offline (e.g. before blocking) lets reclamation proceed without us */
+void epoch_offline(void) {
+    atomic_store_explicit(&my_record->seen, 0, memory_order_release);
+}
+
+void epoch_online(void) {
+    epoch_quiescent();
+}
+
+/*
+ * Queue an unlinked entry for reclamation. Entries are tagged with a fresh
+ * epoch, so any thread whose announced epoch reaches it has passed a
+ * quiescent state after the unlink.
+ */
+void epoch_retire(epoch_entry_t *e, void (*reclaim)(epoch_entry_t *e)) {
+    e->reclaim = reclaim;
+    e->next = NULL;
+    e->epoch = atomic_fetch_add(&global_epoch, 1) + 1;
+    if (retired_tail == NULL)
+        retired_head = e;
+    else
+        retired_tail->next = e;
+    retired_tail = e;
+}
+
+/*
+ * Reclaim every retired entry that no online thread can still reference.
+ * Returns the number of entries reclaimed.
+ */
+int epoch_reclaim(void) {
+    unsigned long safe;
+    int n = 0;
+
+    /* pairs with the fence in epoch_quiescent: the unlinks come first */
+    atomic_thread_fence(memory_order_seq_cst);
+    safe = atomic_load(&global_epoch);
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        unsigned long seen;
+        if (!atomic_load(&records[i].used))
+            continue;
+        seen = atomic_load_explicit(&records[i].seen, memory_order_seq_cst);
+        if (seen != 0 && seen < safe)
+            safe = seen;
+    }
+    while (retired_head != NULL && retired_head->epoch <= safe) {
+        epoch_entry_t *e = retired_head;
+        retired_head = e->next;
+        if (retired_head == NULL)
+            retired_tail = NULL;
+        e->reclaim(e);
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,45 @@
+/*
+ * Epoch-based reclamation for read-mostly shared data.
+ *
+ * Readers traverse shared structures without locks or atomic writes. Each
+ * registered thread instead announces a quiescent state (a point where it
+ * holds no references into shared data) between requests, and goes offline
+ * while blocked. Writers unlink an object, retire it, and it is reclaimed
+ * once every online thread has passed a quiescent state since then.
+ */
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <stdatomic.h>
+
+#define EPOCH_MAX_THREADS 64  // Number of threads that may register
+#define EPOCH_LINE 64         // Cache line size in bytes
+
+/* Per-thread record, one cache line each */
+typedef struct {
+    _Alignas(EPOCH_LINE) atomic_ulong seen; // Epoch at last quiescent state, 0 if offline
+    atomic_int used;                        // Claimed by a thread
+} epoch_record_t;
+
+/* Embed in objects that are retired; reclaim is called to free them */
+typedef struct EPOCHENTRY {
+    unsigned long epoch;
+    void (*reclaim)(struct EPOCHENTRY *e);
+    struct EPOCHENTRY *next;
+} epoch_entry_t;
+
+void epoch_register(void);
+void epoch_unregister(void);
+/* Index of the calling thread's record, for per-thread side tables */
+int epoch_thread_id(void);
+
+/* Reader side: no shared references are held across these calls */
+void epoch_quiescent(void);
+void epoch_offline(void);
+void epoch_online(void);
+
+/* Writer side: callers must serialize retire and reclaim among themselves */
+void epoch_retire(epoch_entry_t *e, void (*reclaim)(epoch_entry_t *e));
+int epoch_reclaim(void);
+
+#endif /* __EPOCH_H__ */
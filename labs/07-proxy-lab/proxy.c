@@ -2,6 +2,10 @@
 #include <stdbool.h>
 #include "csapp.h"
 #include "sbuf.h"
+#include "cache.h"
+#include "epoch.h"
+#include "deflate.h"
+#include "ratelimit.h"
 
 /* Recommended max cache and object sizes */
 #define DEFAULT_PORT "80"
@@ -10,12 +14,23 @@
 #define MAX_OBJECT_SIZE 102400
 #define NTHREADS 4
 #define SBUFSIZE 16
+#define MAX_INFLIGHT (NTHREADS + SBUFSIZE)  /* Beyond this new clients get 503 */
+#define MIN_COMPRESS_SIZE 256
+
+/* Content codings the proxy can produce, in order of preference */
+typedef enum { ENC_IDENTITY, ENC_GZIP, ENC_DEFLATE } encoding_t;
+static const char *encoding_names[] = { "identity", "gzip", "deflate" };
 
 // --- globals
 /* You won't lose style points for including this long line in your code */
 static const char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n";
 
 sbuf_t sbuf;
+cache_t cache;
+ratelimit_t ratelimit;
+
+/* Response bytes written to the current client, charged to its byte bucket */
+static __thread unsigned long client_bytes;
 
 // --- basics
 
@@ -28,11 +43,19 @@ void safe_printf(const char *format, ...) {
     funlockfile(stdout);  // Unlock stdout
 }
 
+/* Rio_writen to the client, counting the bytes for rate limiting */
+void client_writen(int fd, void *usrbuf, size_t n) {
+    Rio_writen(fd, usrbuf, n);
+    client_bytes += n;
+}
+
 bool parse_client_request(int  connfd, 
                           char *host, 
                           char *port, 
                           char *content,
-                          char *other_headers)
+                          char *other_headers,
+                          char *accept_encoding,
+                          char *range)
 {
     size_t n; 
     char buf[MAXLINE]; 
@@ -118,25 +141,37 @@ bool parse_client_request(int  connfd,
         }
         
         int cx = 0;
-        while (true) {
-            n = Rio_readlineb(&rio, buf, MAXLINE);
-            if (strcmp(buf, "\r\n")) {
+        other_headers[0] = '\0';
+        accept_encoding[0] = '\0';
+        range[0] = '\0';
+        while ((n = Rio_readlineb(&rio, buf, MAXLINE)) > 0) {
+            if (!strcmp(buf, "\r\n")) {
                 break;
             }
-            if (strstr("Host", buf) != NULL) {
+            if (!strncasecmp(buf, "Host:", 5)) {
                 continue;
             }
-            if (strstr("User-Agent", buf) != NULL) {
+            if (!strncasecmp(buf, "User-Agent:", 11)) {
                 continue;
             }
-            if (strstr("Connection", buf) != NULL) {
+            if (!strncasecmp(buf, "Connection:", 11)) {
                 continue;
             }
-            if (strstr("Proxy-Connection", buf) != NULL) {
+            if (!strncasecmp(buf, "Proxy-Connection:", 17)) {
                 continue;
             }
-            if (n > 0) {
-                cx += snprintf(other_headers + cx, MAXLINE - cx, buf);
+            // Content coding is negotiated by the proxy, the server always sends identity
+            if (!strncasecmp(buf, "Accept-Encoding:", 16)) {
+                strcpy(accept_encoding, buf + 16);
+                continue;
+            }
+            // Served from the cache when possible, otherwise forwarded as is
+            if (!strncasecmp(buf, "Range:", 6)) {
+                strcpy(range, buf + 6);
+                continue;
+            }
+            if (cx < MAXLINE) {
+                cx += snprintf(other_headers + cx, MAXLINE - cx, "%s", buf);
             }
         }
         return true;
@@ -144,6 +179,363 @@ bool parse_client_request(int  connfd,
     return false;
 }
 
+/*
+ * choose_encoding - pick the preferred coding the client accepts,
+ *     honouring q=0 exclusions
+ */
+encoding_t choose_encoding(const char *accept_encoding)
+{
+    bool gzip = false, deflate = false;
+    const char *p = accept_encoding;
+
+    while (*p) {
+        char name[32];
+        size_t len;
+        const char *end = p + strcspn(p, ",");
+        const char *q;
+
+        p += strspn(p, " \t");
+        len = strcspn(p, ";, \t\r\n");
+        if (len < sizeof(name) && p < end) {
+            strncpy(name, p, len);
+            name[len] = '\0';
+            // "q=0", "q=0.0", ... mean "not acceptable"
+            q = strstr(p, "q=");
+            bool refused = q && q < end && strtod(q + 2, NULL) == 0.0;
+            if (!refused && (!strcasecmp(name, "gzip") || !strcasecmp(name, "x-gzip") ||
+                             !strcmp(name, "*"))) {
+                gzip = true;
+            } else if (!refused && !strcasecmp(name, "deflate")) {
+                deflate = true;
+            }
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return gzip ? ENC_GZIP : (deflate ? ENC_DEFLATE : ENC_IDENTITY);
+}
+
+/*
+ * response_header_len - length of the status line and headers of a
+ *     buffered response, including the blank line; 0 if incomplete
+ */
+size_t response_header_len(const char *resp, size_t size)
+{
+    for (size_t i = 0; i + 4 <= size; i++) {
+        if (!memcmp(resp + i, "\r\n\r\n", 4)) {
+            return i + 4;
+        }
+    }
+    return 0;
+}
+
+/*
+ * get_response_header - copy the trimmed value of header name into value;
+ *     returns false if the response has no such header
+ */
+bool get_response_header(const char *resp, size_t hdr_len, const char *name,
+                         char *value, size_t value_size)
+{
+    size_t name_len = strlen(name);
+    const char *end = resp + hdr_len;
+    const char *line = memchr(resp, '\n', hdr_len);
+
+    while (line != NULL && ++line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) {
+            break;
+        }
+        if ((size_t)(eol - line) > name_len && !strncasecmp(line, name, name_len) &&
+            line[name_len] == ':') {
+            const char *v = line + name_len + 1;
+            size_t len;
+            while (*v == ' ' || *v == '\t') {
+                v++;
+            }
+            len = eol - v;
+            while (len > 0 && (v[len - 1] == '\r' || v[len - 1] == ' ')) {
+                len--;
+            }
+            if (len >= value_size) {
+                len = value_size - 1;
+            }
+            memcpy(value, v, len);
+            value[len] = '\0';
+            return true;
+        }
+        line = eol;
+    }
+    return false;
+}
+
+/*
+ * vary_ok - the response varies on nothing but Accept-Encoding, which
+ *     the cache keys on, so it can be cached and served to anyone
+ */
+bool vary_ok(const char *resp, size_t hdr_len)
+{
+    char vary[MAXLINE];
+    char *tok, *saveptr;
+
+    if (!get_response_header(resp, hdr_len, "Vary", vary, sizeof(vary))) {
+        return true;
+    }
+    for (tok = strtok_r(vary, ", \t", &saveptr); tok; tok = strtok_r(NULL, ", \t", &saveptr)) {
+        if (strcasecmp(tok, "Accept-Encoding")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * is_encodable - a 200 response carrying text-like content that is not
+ *     already encoded, which the proxy encodes for clients that ask
+ */
+bool is_encodable(const char *resp, size_t hdr_len)
+{
+    static const char *types[] = {
+        "text/", "application/json", "application/javascript", "application/x-javascript",
+        "application/xml", "image/svg+xml", NULL
+    };
+    char value[MAXLINE];
+    int status;
+
+    if (hdr_len == 0) {
+        return false;
+    }
+    if (sscanf(resp, "HTTP/%*s %d", &status) != 1 || status != 200) {
+        return false;
+    }
+    if (get_response_header(resp, hdr_len, "Content-Encoding", value, sizeof(value)) &&
+        strcasecmp(value, "identity")) {
+        return false;
+    }
+    if (!get_response_header(resp, hdr_len, "Content-Type", value, sizeof(value))) {
+        return false;
+    }
+    for (int i = 0; types[i]; i++) {
+        if (!strncasecmp(value, types[i], strlen(types[i]))) {
+            return true;
+        }
+    }
+    return strstr(value, "+xml") != NULL;
+}
+
+/*
+ * is_compressible - a complete encodable response worth compressing
+ */
+bool is_compressible(const char *resp, size_t size, size_t hdr_len)
+{
+    return hdr_len > 0 && size - hdr_len >= MIN_COMPRESS_SIZE && is_encodable(resp, hdr_len);
+}
+
+/*
+ * send_identity - send a response as it is, telling caches with
+ *     Vary: Accept-Encoding that other clients may get it encoded
+ */
+void send_identity(int client_proxy_fd, const char *resp, size_t size, size_t hdr_len)
+{
+    static char vary_hdr[] = "Vary: Accept-Encoding\r\n\r\n";
+    char vary[MAXLINE];
+    char *tok, *saveptr;
+
+    if (is_encodable(resp, hdr_len)) {
+        if (get_response_header(resp, hdr_len, "Vary", vary, sizeof(vary))) {
+            for (tok = strtok_r(vary, ", \t", &saveptr); tok; tok = strtok_r(NULL, ", \t", &saveptr)) {
+                if (!strcasecmp(tok, "Accept-Encoding")) {
+                    break;
+                }
+            }
+        } else {
+            tok = NULL;
+        }
+        if (tok == NULL) {
+            // -- the headers up to the blank line, then ours
+            client_writen(client_proxy_fd, (void *)resp, hdr_len - 2);
+            client_writen(client_proxy_fd, vary_hdr, sizeof(vary_hdr) - 1);
+            client_writen(client_proxy_fd, (void *)(resp + hdr_len), size - hdr_len);
+            return;
+        }
+    }
+    client_writen(client_proxy_fd, (void *)resp, size);
+}
+
+/*
+ * compress_response - rewrite a buffered identity response with its body
+ *     encoded; returns the new size, or 0 if that did not make it smaller
+ */
+size_t compress_response(const char *resp, size_t size, size_t hdr_len,
+                         encoding_t encoding, char *out, size_t out_size)
+{
+    const char *body = resp + hdr_len;
+    size_t body_len = size - hdr_len;
+    const char *line = resp, *end = resp + hdr_len - 2;
+    size_t cx = 0, n;
+    char *zbuf;
+
+    zbuf = Malloc(deflate_bound(body_len));
+    n = (encoding == ENC_GZIP) ? gzip_compress(body, body_len, zbuf, deflate_bound(body_len))
+                               : zlib_compress(body, body_len, zbuf, deflate_bound(body_len));
+    if (n == 0 || n >= body_len) {
+        Free(zbuf);
+        return 0;
+    }
+
+    // -- status line and headers, minus the ones describing the body
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        size_t len = (eol ? eol + 1 : end) - line;
+        if (strncasecmp(line, "Content-Length:", 15) &&
+            strncasecmp(line, "Content-Encoding:", 17) &&
+            strncasecmp(line, "Vary:", 5) && cx + len < out_size) {
+            memcpy(out + cx, line, len);
+            cx += len;
+        }
+        line += len;
+    }
+    cx += snprintf(out + cx, out_size - cx,
+                   "Content-Encoding: %s\r\nContent-Length: %zu\r\nVary: Accept-Encoding\r\n\r\n",
+                   encoding_names[encoding], n);
+    if (cx + n > out_size) {
+        Free(zbuf);
+        return 0;
+    }
+    memcpy(out + cx, zbuf, n);
+    Free(zbuf);
+    return cx + n;
+}
+
+/*
+ * send_object - send a complete identity response to the client, encoded
+ *     if it asked for that and the content allows it. The encoded form is
+ *     cached under variant_key so it is only produced once; when encoding
+ *     does not make it smaller, an empty object there says to send identity.
+ */
+void send_object(int         client_proxy_fd,
+                 const char *data,
+                 size_t      size,
+                 const char *variant_key,
+                 encoding_t  encoding)
+{
+    size_t hdr_len = response_header_len(data, size);
+
+    if (encoding != ENC_IDENTITY && is_compressible(data, size, hdr_len)) {
+        size_t out_size = deflate_bound(size) + MAXLINE;
+        char *out = Malloc(out_size);
+        size_t n = compress_response(data, size, hdr_len, encoding, out, out_size);
+        if (n > 0) {
+            client_writen(client_proxy_fd, out, n);
+            safe_printf("[INFO]: sent %s response, %d -> %d bytes\n",
+                        encoding_names[encoding], (int)size, (int)n);
+            cache_insert(&cache, variant_key, out, n);
+            Free(out);
+            return;
+        }
+        Free(out);
+        cache_insert(&cache, variant_key, "", 0);
+    }
+    send_identity(client_proxy_fd, data, size, hdr_len);
+}
+
+/*
+ * parse_range - resolve a single "bytes=first-last", "bytes=first-" or
+ *     "bytes=-suffix" range against a body of len bytes.
+ *     Returns 1 with [*first, *last] set, 0 if the header should be ignored
+ *     (malformed, other units or several ranges) and -1 if unsatisfiable.
+ */
+int parse_range(const char *range, size_t len, size_t *first, size_t *last)
+{
+    const char *p = range + strspn(range, " \t");
+    char *end;
+    unsigned long a, b;
+
+    if (strncasecmp(p, "bytes=", 6) || strchr(p, ',')) {
+        return 0;
+    }
+    p += 6;
+    if (*p == '-') {
+        // -- suffix range: the last b bytes
+        b = strtoul(p + 1, &end, 10);
+        if (end == p + 1) {
+            return 0;
+        }
+        if (b == 0 || len == 0) {
+            return -1;
+        }
+        *first = (b < len) ? len - b : 0;
+        *last = len - 1;
+        return 1;
+    }
+    a = strtoul(p, &end, 10);
+    if (end == p || *end != '-') {
+        return 0;
+    }
+    p = end + 1;
+    b = strtoul(p, &end, 10);
+    if (end == p) {
+        b = len - 1;
+    } else if (b < a) {
+        return 0;
+    }
+    if (a >= len) {
+        return -1;
+    }
+    *first = a;
+    *last = (b < len) ? b : len - 1;
+    return 1;
+}
+
+/*
+ * send_range - answer a Range request from a complete cached response by
+ *     slicing its body; returns false if the range does not apply and the
+ *     whole object should be sent instead
+ */
+bool send_range(int client_proxy_fd, const char *data, size_t size, const char *range)
+{
+    size_t hdr_len = response_header_len(data, size);
+    size_t first, last, body_len = size - hdr_len;
+    const char *line, *end;
+    char buf[MAXBUF];
+    int status, cx = 0;
+
+    if (hdr_len == 0 || sscanf(data, "HTTP/%*s %d", &status) != 1 || status != 200) {
+        return false;
+    }
+    switch (parse_range(range, body_len, &first, &last)) {
+    case 0:
+        return false;
+    case -1:
+        cx = snprintf(buf, MAXBUF, "HTTP/1.0 416 Range Not Satisfiable\r\n"
+                                   "Content-Range: bytes */%zu\r\n"
+                                   "Content-Length: 0\r\n\r\n", body_len);
+        client_writen(client_proxy_fd, buf, cx);
+        safe_printf("[INFO]: range not satisfiable for %zu bytes\n", body_len);
+        return true;
+    }
+
+    // -- origin headers minus the status line and body length
+    cx = snprintf(buf, MAXBUF, "HTTP/1.0 206 Partial Content\r\n");
+    line = memchr(data, '\n', hdr_len) + 1;
+    end = data + hdr_len - 2;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        int len = (eol ? eol + 1 : end) - line;
+        if (strncasecmp(line, "Content-Length:", 15) &&
+            strncasecmp(line, "Content-Range:", 14) && cx + len < MAXBUF) {
+            memcpy(buf + cx, line, len);
+            cx += len;
+        }
+        line += len;
+    }
+    cx += snprintf(buf + cx, MAXBUF - cx, "Content-Range: bytes %zu-%zu/%zu\r\n"
+                                          "Content-Length: %zu\r\n\r\n",
+                   first, last, body_len, last - first + 1);
+    client_writen(client_proxy_fd, buf, cx);
+    client_writen(client_proxy_fd, (void *)(data + hdr_len + first), last - first + 1);
+    safe_printf("[INFO]: sent range %zu-%zu/%zu from cache\n", first, last, body_len);
+    return true;
+}
+
 void send_proxy_request(rio_t      *rp_proxy_server,
                         int         proxy_server_fd,
                         const char *proxy_request)
@@ -153,21 +545,65 @@ void send_proxy_request(rio_t      *rp_proxy_server,
     safe_printf("[INFO]: proxy request sent\n%s\n", proxy_request);
 }
 
-void process_server_response(rio_t *rp_proxy_server,
-                             int    client_proxy_fd) 
+void process_server_response(rio_t      *rp_proxy_server,
+                             int         client_proxy_fd,
+                             const char *cache_key,
+                             const char *variant_key,
+                             encoding_t  encoding) 
 {
-    int n_bytes;
-    char server_response[MAX_OBJECT_SIZE];
+    int n_bytes, total = 0;
+    // -- partial responses (forwarded Range requests) are never cached
+    bool cacheable = (cache_key != NULL);
+    // -- an encoded reply needs the whole body, so hold it back while it fits
+    bool hold = (encoding != ENC_IDENTITY);
+    // -- otherwise only the headers are held, until send_identity has them all
+    size_t sent_hdr_len = 0;
+    char buf[MAXBUF];
+    char *server_response = Malloc(MAX_OBJECT_SIZE);
     
-    n_bytes = Rio_readnb(rp_proxy_server, server_response, MAX_OBJECT_SIZE);
-    safe_printf("[INFO]: proxy received %d bytes from server\n", (int)n_bytes);
-    Rio_writen(client_proxy_fd, server_response, n_bytes);
-    safe_printf("[INFO]: proxy sent %d bytes back to client\n", (int)n_bytes);
+    // -- forward as it arrives, keeping a copy while it still fits in an object
+    while ((n_bytes = Rio_readnb(rp_proxy_server, buf, MAXBUF)) > 0) {
+        if (cacheable && total + n_bytes <= MAX_OBJECT_SIZE) {
+            memcpy(server_response + total, buf, n_bytes);
+            if (!hold && sent_hdr_len > 0) {
+                client_writen(client_proxy_fd, buf, n_bytes);
+            } else if (!hold &&
+                       (sent_hdr_len = response_header_len(server_response, total + n_bytes)) > 0) {
+                send_identity(client_proxy_fd, server_response, total + n_bytes, sent_hdr_len);
+            }
+        } else {
+            if (cacheable && (hold || sent_hdr_len == 0)) {
+                client_writen(client_proxy_fd, server_response, total);
+            }
+            cacheable = false;
+            client_writen(client_proxy_fd, buf, n_bytes);
+        }
+        total += n_bytes;
+    }
+    if (cacheable && !hold && sent_hdr_len == 0) {
+        // -- the response ended inside its headers
+        client_writen(client_proxy_fd, server_response, total);
+    }
+    safe_printf("[INFO]: proxy relayed %d bytes from server to client\n", total);
+
+    if (cacheable && total > 0) {
+        size_t hdr_len = response_header_len(server_response, total);
+        bool storable = hdr_len > 0 && vary_ok(server_response, hdr_len);
+        if (storable) {
+            cache_insert(&cache, cache_key, server_response, total);
+        }
+        if (hold) {
+            send_object(client_proxy_fd, server_response, total, variant_key,
+                        storable ? encoding : ENC_IDENTITY);
+        }
+    }
+    Free(server_response);
 }
 
 void generate_proxy_request(char       *proxy_request, 
                             const char *server_content, 
-                            const char *server_hostname) 
+                            const char *server_hostname,
+                            const char *range) 
 {
     int cx;
     cx  = snprintf(proxy_request,      MAXLINE,      "GET %s HTTP/1.0\r\n", server_content);
@@ -175,6 +611,9 @@ void generate_proxy_request(char       *proxy_request,
     cx += snprintf(proxy_request + cx, MAXLINE - cx, user_agent_hdr);
     cx += snprintf(proxy_request + cx, MAXLINE - cx, "Connection: close\r\n");
     cx += snprintf(proxy_request + cx, MAXLINE - cx, "Proxy-Connection: close\r\n");
+    if (range[0] != '\0') {
+        cx += snprintf(proxy_request + cx, MAXLINE - cx, "Range:%s", range);
+    }
     cx += snprintf(proxy_request + cx, MAXLINE - cx, "\r\n");
 }
 
@@ -183,7 +622,11 @@ void proxy_main(int client_proxy_fd)
     int proxy_server_fd;
     char request_content[MAXLINE], proxy_request[MAXLINE];
     char server_hostname[MAXLINE], server_port[MAXLINE];
-    char other_headers[MAXLINE];
+    char other_headers[MAXLINE], accept_encoding[MAXLINE];
+    char cache_key[MAXLINE], variant_key[MAXLINE], range[MAXLINE];
+    encoding_t encoding;
+    bool keyed;
+    const cache_obj_t *cached;
     rio_t rio_proxy_server;
 
     // -- parse the requests from client
@@ -191,12 +634,65 @@ void proxy_main(int client_proxy_fd)
                             server_hostname, 
                             server_port, 
                             request_content, 
-                            other_headers)) {
+                            other_headers,
+                            accept_encoding,
+                            range)) {
+
+        encoding = choose_encoding(accept_encoding);
+        // -- a request too long to key is relayed as it is and never cached
+        keyed = snprintf(cache_key, sizeof(cache_key), "%s:%s%s",
+                         server_hostname, server_port, request_content) < (int)sizeof(cache_key) &&
+                snprintf(variant_key, sizeof(variant_key), "%s %s",
+                         cache_key, encoding_names[encoding]) < (int)sizeof(variant_key);
+        if (!keyed) {
+            generate_proxy_request(proxy_request, request_content, server_hostname, range);
+            proxy_server_fd = Open_clientfd(server_hostname, server_port);
+            send_proxy_request(&rio_proxy_server, proxy_server_fd, proxy_request);
+            process_server_response(&rio_proxy_server, client_proxy_fd, NULL, NULL, ENC_IDENTITY);
+            Close(proxy_server_fd);
+            Close(client_proxy_fd);
+            return;
+        }
+
+        // -- serve from cache; objects stay valid until our next quiescent state
+        if (range[0] != '\0') {
+            // -- partial content is sliced from the identity object, never encoded
+            if ((cached = cache_lookup(&cache, cache_key)) != NULL &&
+                send_range(client_proxy_fd, cached->data, cached->size, range)) {
+                Close(client_proxy_fd);
+                return;
+            }
+            if (cached == NULL) {
+                generate_proxy_request(proxy_request, request_content, server_hostname, range);
+                proxy_server_fd = Open_clientfd(server_hostname, server_port);
+                send_proxy_request(&rio_proxy_server, proxy_server_fd, proxy_request);
+                process_server_response(&rio_proxy_server, client_proxy_fd, NULL, NULL, ENC_IDENTITY);
+                Close(proxy_server_fd);
+                Close(client_proxy_fd);
+                return;
+            }
+        }
+        if (encoding != ENC_IDENTITY && (cached = cache_lookup(&cache, variant_key)) != NULL) {
+            if (cached->size > 0) {
+                client_writen(client_proxy_fd, (void *)cached->data, cached->size);
+                safe_printf("[INFO]: cache hit, sent %d bytes for %s\n", (int)cached->size, variant_key);
+                Close(client_proxy_fd);
+                return;
+            }
+            // -- encoding does not shrink it, the identity object is the answer
+            encoding = ENC_IDENTITY;
+        }
+        if ((cached = cache_lookup(&cache, cache_key)) != NULL) {
+            send_object(client_proxy_fd, cached->data, cached->size, variant_key, encoding);
+            safe_printf("[INFO]: cache hit, sent %d bytes for %s\n", (int)cached->size, cache_key);
+            Close(client_proxy_fd);
+            return;
+        }
         
-        generate_proxy_request(proxy_request, request_content, server_hostname);
+        generate_proxy_request(proxy_request, request_content, server_hostname, "");
         proxy_server_fd = Open_clientfd(server_hostname, server_port);
         send_proxy_request(&rio_proxy_server, proxy_server_fd, proxy_request);
-        process_server_response(&rio_proxy_server, client_proxy_fd);
+        process_server_response(&rio_proxy_server, client_proxy_fd, cache_key, variant_key, encoding);
 
         Close(proxy_server_fd);
     } else {
@@ -210,13 +706,66 @@ void proxy_main(int client_proxy_fd)
 
 void *proxy_thread(void *vargp) 
 {
+    struct sockaddr_storage peer;
+    socklen_t peerlen;
+
     Pthread_detach(pthread_self());
+    epoch_register();
     while (true) {
+        epoch_offline();                            /* Don't hold up reclamation while idle */
         int client_proxy_fd = sbuf_remove(&sbuf);   /* Remove connfd from buffer */
+        epoch_online();
+        peerlen = sizeof(peer);
+        if (getpeername(client_proxy_fd, (SA *)&peer, &peerlen) < 0) {
+            peer.ss_family = AF_UNSPEC;
+        }
+        client_bytes = 0;
         proxy_main(client_proxy_fd);                /* Serve client */
+        epoch_quiescent();                          /* No cached object is referenced now */
+        ratelimit_charge(&ratelimit, ratelimit_key((SA *)&peer), client_bytes, ratelimit_now());
+        ratelimit_done(&ratelimit);
     }    
 }
 
+/*
+ * reject_client - refuse a connection without reading its request; the
+ *     write is best effort, a client that has gone away is ignored
+ */
+void reject_client(int client_proxy_fd, rl_verdict_t verdict)
+{
+    char buf[MAXLINE];
+    int n;
+
+    if (verdict == RL_REJECT_BUSY) {
+        n = snprintf(buf, MAXLINE, "HTTP/1.0 503 Service Unavailable\r\n");
+    } else {
+        n = snprintf(buf, MAXLINE, "HTTP/1.0 429 Too Many Requests\r\n");
+    }
+    n += snprintf(buf + n, MAXLINE - n, "Retry-After: 1\r\n"
+                                        "Connection: close\r\n"
+                                        "Content-Length: 0\r\n\r\n");
+    rio_writen(client_proxy_fd, buf, n);
+    Close(client_proxy_fd);
+}
+
+/* SIGUSR1 handler - report admission counters */
+void sigusr1_handler(int sig)
+{
+    int olderrno = errno;
+    Sio_puts("[STATS]: admitted ");
+    Sio_putl(atomic_load(&ratelimit.admitted));
+    Sio_puts(", rate limited ");
+    Sio_putl(atomic_load(&ratelimit.rejected[RL_REJECT_RATE]));
+    Sio_puts(", byte limited ");
+    Sio_putl(atomic_load(&ratelimit.rejected[RL_REJECT_BYTES]));
+    Sio_puts(", shed ");
+    Sio_putl(atomic_load(&ratelimit.rejected[RL_REJECT_BUSY]));
+    Sio_puts(", untracked ");
+    Sio_putl(atomic_load(&ratelimit.untracked));
+    Sio_puts("\n");
+    errno = olderrno;
+}
+
 // --- main
 
 int main(int argc, char **argv)
@@ -232,12 +781,24 @@ int main(int argc, char **argv)
     char client_hostname[MAXLINE], client_port[MAXLINE];
 
     pthread_t tid;
+    rl_verdict_t verdict;
+    sigset_t mask, prev_mask;
     
     proxy_listenfd = Open_listenfd(argv[1]);
 
     sbuf_init(&sbuf, SBUFSIZE);
+    cache_init(&cache, MAX_CACHE_SIZE);
+    ratelimit_init(&ratelimit, MAX_INFLIGHT);
+    Signal(SIGPIPE, SIG_IGN);
+    Signal(SIGUSR1, sigusr1_handler);
+
+    /* Workers block SIGUSR1 so it never interrupts their semaphore waits */
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, &prev_mask);
     for (i = 0; i < NTHREADS; i++) /* Create worker threads */
         Pthread_create(&tid, NULL, proxy_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &prev_mask, NULL);
 
     while (true) {
         // -- connect with client
@@ -248,7 +809,18 @@ int main(int argc, char **argv)
                     client_hostname, MAXLINE, 
                     client_port, MAXLINE, 0);
         safe_printf("[INFO]: Connected to (%s, %s)\n", client_hostname, client_port);
-        sbuf_insert(&sbuf, client_proxy_fd); /* Insert connfd in buffer */
+
+        // -- admission control; never block accept() on a full buffer
+        verdict = ratelimit_admit(&ratelimit, ratelimit_key((SA *)&clientaddr), ratelimit_now());
+        if (verdict != RL_ADMIT) {
+            safe_printf("[INFO]: rejected (%s, %s)\n", client_hostname, client_port);
+            reject_client(client_proxy_fd, verdict);
+            continue;
+        }
+        if (sbuf_tryinsert(&sbuf, client_proxy_fd) < 0) { /* Insert connfd in buffer */
+            ratelimit_shed(&ratelimit);
+            reject_client(client_proxy_fd, RL_REJECT_BUSY);
+        }
     }
     Close(proxy_listenfd);
     exit(0);
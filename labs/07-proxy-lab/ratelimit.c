@@ -0,0 +1,177 @@
+#include <limits.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "ratelimit.h"
+
+/*
+ * Bucket state: refill time in ms in the high 32 bits (compared modulo
+ * 2^32), signed token count in the low 32 bits. The all-zero state of a
+ * fresh slot stands for a full bucket. Request tokens are kept in
+ * thousandths so that slow rates still refill every millisecond.
+ */
+#define REQ_UNIT 1000
+
+/*
+ * Clock readings of concurrent callers differ by far less than this; a
+ * refill time further ahead of now is one from 2^32 ms ago that wrapped.
+ */
+#define CLOCK_SKEW_MS 60000
+
+static uint64_t pack(uint32_t time, int32_t tokens) {
+    return ((uint64_t)time << 32) | (uint32_t)tokens;
+}
+
+static uint32_t state_time(uint64_t s) {
+    return s >> 32;
+}
+
+static int32_t state_tokens(uint64_t s) {
+    return (int32_t)(uint32_t)s;
+}
+
+/*
+ * Refill the bucket up to now, then take cost tokens. Without debt the take
+ * only happens if enough tokens are left; with debt it always happens and
+ * the balance may go negative. Returns whether the tokens were taken.
+ */
+static bool bucket_take(_Atomic uint64_t *bucket, long rate, long burst, long cost,
+                        bool debt, uint32_t now) {
+    uint64_t old = atomic_load_explicit(bucket, memory_order_relaxed);
+    uint64_t new;
+    long tokens;
+
+    do {
+        uint32_t elapsed = now - state_time(old);
+        bool idle = false;
+        /* Another thread refilled with a later clock reading */
+        if (state_time(old) - now <= CLOCK_SKEW_MS)
+            elapsed = 0;
+        /* Idle for over 2^31 ms, long enough to be full again */
+        else if (elapsed > UINT32_MAX / 2)
+            idle = true;
+        if (old == 0 || idle)
+            tokens = burst;
+        else
+            tokens = state_tokens(old) + (long)elapsed * rate / 1000;
+        if (tokens > burst)
+            tokens = burst;
+        if (!debt && tokens < cost)
+            return false;
+        tokens -= cost;
+        if (tokens < INT32_MIN / 2)
+            tokens = INT32_MIN / 2;
+        new = pack(elapsed || idle ? now : state_time(old), tokens);
+    } while (!atomic_compare_exchange_weak_explicit(bucket, &old, new,
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+    return true;
+}
+
+static uint32_t hash_client(uint32_t client) {
+    client ^= client >> 16;
+    client *= 0x7feb352d;
+    client ^= client >> 15;
+    return client;
+}
+
+/*
+ * Find the slot owned by client, claiming a free one if it has none.
+ * Returns NULL if the probe sequence is exhausted.
+ */
+static rl_slot_t *find_slot(ratelimit_t *rl, uint32_t client) {
+    uint32_t h = hash_client(client);
+
+    for (int i = 0; i < RL_MAX_PROBE; i++) {
+        rl_slot_t *s = &rl->slots[(h + i) & (RL_TABLE_SIZE - 1)];
+        uint32_t key = atomic_load_explicit(&s->client, memory_order_acquire);
+        if (key == 0) {
+            uint32_t expected = 0;
+            if (atomic_compare_exchange_strong_explicit(&s->client, &expected, client,
+                                                        memory_order_acq_rel,
+                                                        memory_order_acquire))
+                return s;
+            key = expected;
+        }
+        if (key == client)
+            return s;
+    }
+    return NULL;
+}
+
+void ratelimit_init(ratelimit_t *rl, int max_inflight) {
+    for (int i = 0; i < RL_TABLE_SIZE; i++) {
+        atomic_init(&rl->slots[i].client, 0);
+        atomic_init(&rl->slots[i].req, 0);
+        atomic_init(&rl->slots[i].bytes, 0);
+    }
+    rl->max_inflight = max_inflight;
+    atomic_init(&rl->inflight, 0);
+    atomic_init(&rl->admitted, 0);
+    for (int i = 0; i <= RL_REJECT_BUSY; i++)
+        atomic_init(&rl->rejected[i], 0);
+    atomic_init(&rl->untracked, 0);
+}
+
+unsigned long ratelimit_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+uint32_t ratelimit_key(const struct sockaddr *addr) {
+    uint32_t key = 0;
+
+    if (addr->sa_family == AF_INET) {
+        key = ((const struct sockaddr_in *)addr)->sin_addr.s_addr;
+    } else if (addr->sa_family == AF_INET6) {
+        const unsigned char *a = ((const struct sockaddr_in6 *)addr)->sin6_addr.s6_addr;
+        key = 2166136261u;
+        for (int i = 0; i < 16; i++)
+            key = (key ^ a[i]) * 16777619u;
+    }
+    return key ? key : 1;   /* 0 marks a free slot */
+}
+
+rl_verdict_t ratelimit_admit(ratelimit_t *rl, uint32_t client, unsigned long now) {
+    rl_slot_t *s;
+    rl_verdict_t v = RL_ADMIT;
+
+    if (atomic_fetch_add(&rl->inflight, 1) >= rl->max_inflight) {
+        v = RL_REJECT_BUSY;
+    } else if ((s = find_slot(rl, client)) == NULL) {
+        atomic_fetch_add_explicit(&rl->untracked, 1, memory_order_relaxed);
+    } else if (!bucket_take(&s->bytes, RL_BYTE_RATE, RL_BYTE_BURST, 0, false, now)) {
+        v = RL_REJECT_BYTES;
+    } else if (!bucket_take(&s->req, RL_REQ_RATE * REQ_UNIT, RL_REQ_BURST * REQ_UNIT,
+                            REQ_UNIT, false, now)) {
+        v = RL_REJECT_RATE;
+    }
+
+    if (v == RL_ADMIT) {
+        atomic_fetch_add_explicit(&rl->admitted, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_sub(&rl->inflight, 1);
+        atomic_fetch_add_explicit(&rl->rejected[v], 1, memory_order_relaxed);
+    }
+    return v;
+}
+
+void ratelimit_charge(ratelimit_t *rl, uint32_t client, unsigned long bytes,
+                      unsigned long now) {
+    rl_slot_t *s = find_slot(rl, client);
+
+    if (s != NULL && bytes > 0)
+        bucket_take(&s->bytes, RL_BYTE_RATE, RL_BYTE_BURST,
+                    bytes < INT32_MAX ? (long)bytes : INT32_MAX, true, now);
+}
+
+void ratelimit_done(ratelimit_t *rl) {
+    atomic_fetch_sub(&rl->inflight, 1);
+}
+
+void ratelimit_shed(ratelimit_t *rl) {
+    atomic_fetch_sub_explicit(&rl->admitted, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&rl->rejected[RL_REJECT_BUSY], 1, memory_order_relaxed);
+    atomic_fetch_sub(&rl->inflight, 1);
+}
@@ -0,0 +1,70 @@
+/*
+ * Per-client rate limiting and load shedding for the proxy.
+ *
+ * Every client address owns two token buckets, one for requests and one for
+ * response bytes. A bucket's token count and last refill time are packed
+ * into one 64-bit word and updated with a compare-and-swap loop, so
+ * concurrent requests from one client never take a lock. Clients are found
+ * in an open-addressing table whose slots are claimed by CAS and never
+ * released; clients that find no slot are admitted untracked.
+ *
+ * Requests spend one token up front. Bytes are only known once a response
+ * has been sent, so they are charged afterwards and may drive the bucket
+ * into debt; a client in debt is refused until it has been repaid.
+ *
+ * A global in-flight counter bounds the number of admitted connections so
+ * the acceptor can shed load instead of blocking on a full queue.
+ */
+#ifndef __RATELIMIT_H__
+#define __RATELIMIT_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define RL_TABLE_SIZE 1024           // Client slots, a power of two
+#define RL_MAX_PROBE 16              // Slots examined before giving up
+
+#define RL_REQ_RATE 20               // Requests per second per client
+#define RL_REQ_BURST 40
+#define RL_BYTE_RATE (1 << 20)       // Response bytes per second per client
+#define RL_BYTE_BURST (4 << 20)
+
+typedef enum {
+    RL_ADMIT,
+    RL_REJECT_RATE,                  // Too many requests (429)
+    RL_REJECT_BYTES,                 // Byte budget overdrawn (429)
+    RL_REJECT_BUSY                   // Too many connections in flight (503)
+} rl_verdict_t;
+
+typedef struct {
+    _Atomic uint32_t client;         // Key, 0 while the slot is free
+    _Atomic uint64_t req;            // Bucket state, see ratelimit.c
+    _Atomic uint64_t bytes;
+} rl_slot_t;
+
+typedef struct {
+    rl_slot_t slots[RL_TABLE_SIZE];
+    int max_inflight;
+    atomic_int inflight;
+    atomic_ulong admitted;
+    atomic_ulong rejected[RL_REJECT_BUSY + 1];  // Indexed by verdict
+    atomic_ulong untracked;          // Admitted without a slot, table full
+} ratelimit_t;
+
+void ratelimit_init(ratelimit_t *rl, int max_inflight);
+/* Milliseconds on a monotonic clock, the time base for the calls below */
+unsigned long ratelimit_now(void);
+/* Key for a peer address; IPv6 addresses are hashed */
+uint32_t ratelimit_key(const struct sockaddr *addr);
+
+/* On RL_ADMIT the caller must call ratelimit_done once the client is served */
+rl_verdict_t ratelimit_admit(ratelimit_t *rl, uint32_t client, unsigned long now);
+void ratelimit_charge(ratelimit_t *rl, uint32_t client, unsigned long bytes,
+                      unsigned long now);
+void ratelimit_done(ratelimit_t *rl);
+/* Undo an admission that could not be served, counting it as shed */
+void ratelimit_shed(ratelimit_t *rl);
+
+#endif /* __RATELIMIT_H__ */
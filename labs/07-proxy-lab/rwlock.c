@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "rwlock.h"
+
+/* Round-robin stripe assignment, fixed for the lifetime of a thread */
+static atomic_uint next_stripe;
+static __thread int my_stripe = -1;
+
+static int get_stripe(void) {
+    if (my_stripe < 0)
+        my_stripe = atomic_fetch_add(&next_stripe, 1) % RWLOCK_STRIPES;
+    return my_stripe;
+}
+
+static void futex_wait(atomic_uint *addr, unsigned val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *addr, int n) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/*
+ * Helper routines for the internal mutex
+ * 0 = unlocked, 1 = locked, 2 = locked with (possible) sleepers
+ */
+static void mutex_lock(atomic_uint *m) {
+    unsigned c = 0;
+    if (atomic_compare_exchange_strong(m, &c, 1))
+        return;
+    if (c != 2)
+        c = atomic_exchange(m, 2);
+    while (c != 0) {
+        futex_wait(m, 2);
+        c = atomic_exchange(m, 2);
+    }
+}
+
+static void mutex_unlock(atomic_uint *m) {
+    if (atomic_fetch_sub(m, 1) != 1) {
+        atomic_store(m, 0);
+        futex_wake(m, 1);
+    }
+}
+
+/*
+ * Helper routine to insert element in queue
+ * Assume mutually exclusive access
+ */
+static void enqueue(rwlock_t *l, rw_waiter_t *w) {
+    w->next = NULL;
+    if (l->tail == NULL) {
+        l->tail = l->head = w;
+    } else {
+        l->tail->next = w;
+        l->tail = w;
+    }
+}
+
+/*
+ * Helper routine to remove first element from queue
+ */
+static void dequeue(rwlock_t *l) {
+    rw_waiter_t *w = l->head;
+    if (w == NULL)
+        return;
+    l->head = w->next;
+    if (l->head == NULL)
+        l->tail = NULL;
+}
+
+/*
+ * Helper routine to wake a queued thread. The waiter may return as soon
+ * as enable is set, so w must already be off the queue.
+ */
+static void grant(rw_waiter_t *w) {
+    atomic_store(&w->enable, 1);
+    futex_wake(&w->enable, 1);
+}
+
+static void wait_for_grant(rw_waiter_t *w) {
+    while (atomic_load(&w->enable) == 0)
+        futex_wait(&w->enable, 0);
+}
+
+/*
+ * Hand the lock to the head of the queue: every leading reader, then the
+ * first writer behind them. Called with the mutex held and no writer.
+ */
+static void dispatch(rwlock_t *l) {
+    rw_waiter_t *w;
+    while ((w = l->head) != NULL && w->is_reader) {
+        atomic_fetch_add(&l->readers[w->stripe].count, 1);
+        dequeue(l);
+        grant(w);
+    }
+    if (w != NULL) {
+        l->writer = true;
+        dequeue(l);
+        grant(w);
+    }
+    if (!l->writer)
+        atomic_store(&l->gate, 0);
+}
+
+static long count_readers(rwlock_t *l) {
+    long n = 0;
+    for (int i = 0; i < RWLOCK_STRIPES; i++)
+        n += atomic_load(&l->readers[i].count);
+    return n;
+}
+
+/*
+ * Helper routine for a granted writer: wait until the readers that got in
+ * ahead of it have left. The gate is closed, so no new reader can enter.
+ */
+static void drain_readers(rwlock_t *l) {
+    for (;;) {
+        unsigned seq = atomic_load(&l->drain);
+        if (count_readers(l) == 0)
+            return;
+        futex_wait(&l->drain, seq);
+    }
+}
+
+/*
+ * Helper routine to leave as a reader. Once a writer has closed the gate
+ * it may be sleeping in drain_readers, so tell it the count changed.
+ */
+static void leave_reader(rwlock_t *l, int stripe) {
+    atomic_fetch_sub(&l->readers[stripe].count, 1);
+    if (atomic_load(&l->gate)) {
+        atomic_fetch_add(&l->drain, 1);
+        futex_wake(&l->drain, 1);
+    }
+}
+
+void rwlock_init(rwlock_t *l) {
+    for (int i = 0; i < RWLOCK_STRIPES; i++)
+        atomic_init(&l->readers[i].count, 0);
+    atomic_init(&l->gate, 0);
+    atomic_init(&l->mutex, 0);
+    atomic_init(&l->drain, 0);
+    l->writer = false;
+    l->head = NULL;
+    l->tail = NULL;
+}
+
+void rwlock_read_lock(rwlock_t *l) {
+    rw_waiter_t w;
+    int stripe = get_stripe();
+
+    if (atomic_load(&l->gate) == 0) {
+        /* Fast path: no writer around, only touch our own stripe */
+        atomic_fetch_add(&l->readers[stripe].count, 1);
+        if (atomic_load(&l->gate) == 0)
+            return;
+        /* A writer closed the gate meanwhile; it arrived first */
+        leave_reader(l, stripe);
+    }
+
+    mutex_lock(&l->mutex);
+    if (l->head == NULL && !l->writer) {
+        /* Can bypass queue */
+        atomic_fetch_add(&l->readers[stripe].count, 1);
+        mutex_unlock(&l->mutex);
+        return;
+    }
+    /* Must add to queue */
+    w.is_reader = true;
+    w.stripe = stripe;
+    atomic_init(&w.enable, 0);
+    enqueue(l, &w);
+    mutex_unlock(&l->mutex);
+    wait_for_grant(&w);
+}
+
+void rwlock_read_unlock(rwlock_t *l) {
+    leave_reader(l, get_stripe());
+}
+
+void rwlock_write_lock(rwlock_t *l) {
+    rw_waiter_t w;
+
+    w.is_reader = false;
+    atomic_init(&w.enable, 0);
+    mutex_lock(&l->mutex);
+    /* Turn new readers away from the fast path */
+    atomic_store(&l->gate, 1);
+    enqueue(l, &w);
+    if (!l->writer)
+        /* No writer means the queue was empty, so we are at its head */
+        dispatch(l);
+    mutex_unlock(&l->mutex);
+    wait_for_grant(&w);
+    drain_readers(l);
+}
+
+void rwlock_write_unlock(rwlock_t *l) {
+    mutex_lock(&l->mutex);
+#ifdef DEBUG
+    printf("Start of release: ");
+    rwlock_status(l);
+#endif
+    l->writer = false;
+    dispatch(l);
+#ifdef DEBUG
+    printf("End of release: ");
+    rwlock_status(l);
+#endif
+    mutex_unlock(&l->mutex);
+}
+
+void rwlock_status(rwlock_t *l) {
+    rw_waiter_t *w;
+    printf("Readers = %ld, Writer = %d, Gate = %d, Queue=[", count_readers(l),
+           l->writer, atomic_load(&l->gate));
+    for (w = l->head; w; w = w->next)
+        putchar(w->is_reader ? 'r' : 'w');
+    printf("]\n");
+}
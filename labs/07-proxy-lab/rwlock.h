@@ -0,0 +1,55 @@
+/*
+ * Fair readers/writers lock with striped reader counts and futex blocking.
+ *
+ * Same FIFO guarantee as rw_queue_t (requests are granted in arrival order,
+ * consecutive readers are granted together), but a reader that finds no
+ * writer holding or waiting for the lock only increments its own stripe
+ * counter and never writes a cache line shared with other readers.
+ */
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define RWLOCK_STRIPES 16   // Number of reader counters
+#define RWLOCK_LINE 64      // Cache line size in bytes
+
+/* Reader counter padded to its own cache line */
+typedef struct {
+    atomic_long count;
+    char pad[RWLOCK_LINE - sizeof(atomic_long)];
+} rw_stripe_t;
+
+/* Represents a blocked thread's position in queue; lives on its stack */
+typedef struct RWWAITER {
+    bool is_reader;
+    int stripe;             // Stripe a granted reader is counted on
+    atomic_uint enable;     // Futex word, set to 1 when access is granted
+    struct RWWAITER *next;  // Allows chaining as linked list
+} rw_waiter_t;
+
+typedef struct {
+    // Active readers; individual stripes may go negative, only the sum matters
+    rw_stripe_t readers[RWLOCK_STRIPES];
+    // Nonzero while a writer holds or waits for the lock. Only written by
+    // writers, so readers keep it shared in their caches.
+    _Alignas(RWLOCK_LINE) atomic_int gate;
+    // Slow path state, touched by writers and by readers that must queue
+    _Alignas(RWLOCK_LINE) atomic_uint mutex; // Futex lock protecting the rest
+    atomic_uint drain;      // Bumped by readers leaving while the gate is closed
+    bool writer;            // A writer has been granted the lock
+    // FIFO queue implemented as linked list with tail pointer
+    rw_waiter_t *head;
+    rw_waiter_t *tail;
+} rwlock_t;
+
+void rwlock_init(rwlock_t *l);
+void rwlock_read_lock(rwlock_t *l);
+void rwlock_read_unlock(rwlock_t *l);
+void rwlock_write_lock(rwlock_t *l);
+void rwlock_write_unlock(rwlock_t *l);
+/* Print information about lock */
+void rwlock_status(rwlock_t *l);
+
+#endif /* __RWLOCK_H__ */
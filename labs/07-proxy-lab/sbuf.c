@@ -35,6 +35,18 @@ void sbuf_insert(sbuf_t *sp, int item)
 }
 /* $end sbuf_insert */
 
+/* Insert item unless sp is full; returns 0 on success, -1 if full */
+int sbuf_tryinsert(sbuf_t *sp, int item)
+{
+    if (sem_trywait(&sp->slots) < 0)        /* Don't wait for a slot */
+        return -1;
+    P(&sp->mutex);
+    sp->buf[(++sp->rear)%(sp->n)] = item;
+    V(&sp->mutex);
+    V(&sp->items);
+    return 0;
+}
+
 /* Remove and return the first item from buffer sp */
 /* $begin sbuf_remove */
 int sbuf_remove(sbuf_t *sp)
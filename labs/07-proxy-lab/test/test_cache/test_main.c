@@ -0,0 +1,95 @@
+#include <assert.h>
+#include "../../cache.h"
+#include "../../epoch.h"
+
+#define NREADERS 4
+#define NITERS 20000
+
+static cache_t cache;
+static atomic_int stop;
+
+void test_cache_insert_lookup() {
+    const cache_obj_t *o;
+
+    cache_init(&cache, 100);
+    assert(cache_lookup(&cache, "a") == NULL);
+    assert(cache_insert(&cache, "a", "0123456789", 10));
+    o = cache_lookup(&cache, "a");
+    assert(o && o->size == 10 && !memcmp(o->data, "0123456789", 10));
+
+    /* Replacing keeps a single object per key */
+    assert(cache_insert(&cache, "a", "abc", 3));
+    o = cache_lookup(&cache, "a");
+    assert(o && o->size == 3 && !memcmp(o->data, "abc", 3));
+    assert(cache.total_size == 3);
+
+    /* Too big to ever fit */
+    assert(!cache_insert(&cache, "b", "x", 101));
+    epoch_quiescent();
+}
+
+void test_cache_lru() {
+    char data[40] = {0};
+
+    cache_init(&cache, 100);
+    assert(cache_insert(&cache, "a", data, 40));
+    assert(cache_insert(&cache, "b", data, 40));
+    /* Touch a, so b is least recently used once the hit is applied */
+    assert(cache_lookup(&cache, "a"));
+    assert(cache_insert(&cache, "c", data, 40));
+    assert(cache_lookup(&cache, "a") && cache_lookup(&cache, "c"));
+    assert(cache_lookup(&cache, "b") == NULL);
+    assert(cache.total_size == 80);
+    epoch_quiescent();
+}
+
+static void *reader_thread(void *vargp) {
+    char key[16];
+    epoch_register();
+    while (!atomic_load(&stop)) {
+        for (int i = 0; i < 8; i++) {
+            const cache_obj_t *o;
+            sprintf(key, "k%d", i);
+            if ((o = cache_lookup(&cache, key)) != NULL) {
+                /* Every byte of an object is its key's digit */
+                for (size_t j = 0; j < o->size; j++)
+                    assert(o->data[j] == '0' + i);
+            }
+        }
+        epoch_quiescent();
+    }
+    epoch_unregister();
+    return NULL;
+}
+
+void test_cache_concurrent() {
+    pthread_t tid[NREADERS];
+    char key[16], data[64];
+
+    cache_init(&cache, 4 * sizeof(data));
+    atomic_store(&stop, 0);
+    for (int i = 0; i < NREADERS; i++)
+        pthread_create(&tid[i], NULL, reader_thread, NULL);
+    for (int n = 0; n < NITERS; n++) {
+        int i = n % 8;
+        sprintf(key, "k%d", i);
+        memset(data, '0' + i, sizeof(data));
+        assert(cache_insert(&cache, key, data, 1 + n % sizeof(data)));
+        epoch_quiescent();
+    }
+    atomic_store(&stop, 1);
+    for (int i = 0; i < NREADERS; i++)
+        pthread_join(tid[i], NULL);
+    assert(cache.total_size <= cache.max_size);
+}
+
+int main() {
+
+    epoch_register();
+    test_cache_insert_lookup();
+    test_cache_lru();
+    test_cache_concurrent();
+    printf("tests on cache all passed!\n");
+
+    return 0;
+}
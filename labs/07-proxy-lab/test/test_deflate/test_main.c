@@ -0,0 +1,86 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "../../deflate.h"
+
+#define BIG_LEN (100 * 1024)   /* Well past the 32 KB window */
+
+/* Compress src both ways and check that zlib gives it back */
+static void round_trip(const unsigned char *src, size_t len) {
+    size_t cap = deflate_bound(len), n;
+    unsigned char *z = malloc(cap), *out = malloc(len + 1);
+    uLongf out_len;
+    z_stream s;
+
+    /* zlib framing */
+    n = zlib_compress(src, len, z, cap);
+    assert(n > 0 && n <= cap);
+    out_len = len + 1;
+    assert(uncompress(out, &out_len, z, n) == Z_OK);
+    assert(out_len == len && !memcmp(out, src, len));
+
+    /* gzip framing */
+    n = gzip_compress(src, len, z, cap);
+    assert(n > 0 && n <= cap);
+    memset(&s, 0, sizeof(s));
+    assert(inflateInit2(&s, 16 + MAX_WBITS) == Z_OK);
+    s.next_in = z;
+    s.avail_in = n;
+    s.next_out = out;
+    s.avail_out = len + 1;
+    assert(inflate(&s, Z_FINISH) == Z_STREAM_END);
+    assert(s.total_out == len && s.avail_in == 0 && !memcmp(out, src, len));
+    inflateEnd(&s);
+
+    /* A buffer one byte short is refused, not overrun */
+    assert(gzip_compress(src, len, z, n - 1) == 0);
+
+    free(z);
+    free(out);
+}
+
+void test_deflate_empty() {
+    round_trip((const unsigned char *)"", 0);
+}
+
+void test_deflate_incompressible() {
+    unsigned char *buf = malloc(BIG_LEN);
+
+    srandom(15213);
+    for (size_t i = 0; i < BIG_LEN; i++)
+        buf[i] = random();
+    round_trip(buf, 1);
+    round_trip(buf, 300);
+    round_trip(buf, BIG_LEN);
+    free(buf);
+}
+
+void test_deflate_big() {
+    unsigned char *buf = malloc(BIG_LEN);
+    size_t n = 0;
+
+    /* Text with repeats both near and further back than the window */
+    while (n < BIG_LEN) {
+        int k = snprintf((char *)buf + n, BIG_LEN - n,
+                         "<li>item %zu of the list</li>\n", (n * 7919) % 5000);
+        n += (size_t)k < BIG_LEN - n ? (size_t)k : BIG_LEN - n;
+    }
+    round_trip(buf, BIG_LEN);
+
+    /* Long runs: matches of the maximum length, at distance 1 */
+    memset(buf, 'a', BIG_LEN);
+    round_trip(buf, BIG_LEN);
+    free(buf);
+}
+
+int main() {
+
+    test_deflate_empty();
+    test_deflate_incompressible();
+    test_deflate_big();
+    printf("tests on deflate all passed!\n");
+
+    return 0;
+}
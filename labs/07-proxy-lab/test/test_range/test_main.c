@@ -0,0 +1,123 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* From proxy.c */
+int parse_range(const char *range, size_t len, size_t *first, size_t *last);
+bool send_range(int client_proxy_fd, const char *data, size_t size, const char *range);
+
+/* From tiny/tiny.c */
+int tiny_parse_range(char *range, off_t filesize, off_t *first, off_t *last);
+
+/* Both parsers on one header against a body of len bytes: the verdict,
+   and the range it resolves to when it is 1 */
+static int both(const char *range, size_t len, long *first, long *last) {
+    char buf[64];
+    size_t pf, pl;
+    off_t tf, tl;
+    int p, t;
+
+    strcpy(buf, range);
+    p = parse_range(range, len, &pf, &pl);
+    t = tiny_parse_range(buf, len, &tf, &tl);
+    assert(p == t);
+    if (p == 1) {
+        assert((off_t)pf == tf && (off_t)pl == tl);
+        *first = pf;
+        *last = pl;
+    }
+    return p;
+}
+
+void test_parse_range() {
+    long first, last;
+
+    /* Suffix ranges: the last N bytes, all of them if N is larger */
+    assert(both("bytes=-4", 10, &first, &last) == 1 && first == 6 && last == 9);
+    assert(both(" bytes=-10", 10, &first, &last) == 1 && first == 0 && last == 9);
+    assert(both("bytes=-50", 10, &first, &last) == 1 && first == 0 && last == 9);
+    assert(both("bytes=-0", 10, &first, &last) == -1);
+    assert(both("bytes=-3", 0, &first, &last) == -1);
+
+    /* Open ranges run to the end */
+    assert(both("bytes=3-", 10, &first, &last) == 1 && first == 3 && last == 9);
+    assert(both("bytes=9-", 10, &first, &last) == 1 && first == 9 && last == 9);
+
+    /* Closed ranges, with an end past EOF cut to the last byte */
+    assert(both("bytes=0-0", 10, &first, &last) == 1 && first == 0 && last == 0);
+    assert(both("bytes=2-5", 10, &first, &last) == 1 && first == 2 && last == 5);
+    assert(both("bytes=2-100", 10, &first, &last) == 1 && first == 2 && last == 9);
+
+    /* A start at or past the end cannot be satisfied */
+    assert(both("bytes=10-", 10, &first, &last) == -1);
+    assert(both("bytes=10-20", 10, &first, &last) == -1);
+    assert(both("bytes=0-", 0, &first, &last) == -1);
+
+    /* Several ranges, other units and malformed headers are ignored */
+    assert(both("bytes=0-1,3-4", 10, &first, &last) == 0);
+    assert(both("bytes=-1, -2", 10, &first, &last) == 0);
+    assert(both("items=0-1", 10, &first, &last) == 0);
+    assert(both("bytes=5-2", 10, &first, &last) == 0);
+    assert(both("bytes=x-2", 10, &first, &last) == 0);
+    assert(both("bytes=-", 10, &first, &last) == 0);
+    assert(both("bytes=3", 10, &first, &last) == 0);
+}
+
+#define OBJECT "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n" \
+               "Content-Length: 10\r\n\r\n0123456789"
+
+/* send_range on the cached OBJECT; returns its verdict and what it wrote */
+static bool send(const char *data, const char *range, char *out, size_t out_size) {
+    int fds[2];
+    ssize_t n;
+    bool sent;
+
+    assert(pipe(fds) == 0);
+    sent = send_range(fds[1], data, strlen(data), range);
+    close(fds[1]);
+    n = read(fds[0], out, out_size - 1);
+    assert(n >= 0);
+    out[n] = '\0';
+    close(fds[0]);
+    return sent;
+}
+
+void test_send_range() {
+    char out[1024];
+
+    assert(send(OBJECT, "bytes=-3", out, sizeof(out)));
+    assert(!strncmp(out, "HTTP/1.0 206 Partial Content\r\n", 30));
+    assert(strstr(out, "Content-Type: text/plain\r\n"));
+    assert(strstr(out, "Content-Range: bytes 7-9/10\r\n"));
+    assert(strstr(out, "Content-Length: 3\r\n\r\n789") && !strstr(out, "Content-Length: 10"));
+
+    assert(send(OBJECT, "bytes=4-", out, sizeof(out)));
+    assert(strstr(out, "Content-Range: bytes 4-9/10\r\n"));
+    assert(!strcmp(strstr(out, "\r\n\r\n") + 4, "456789"));
+
+    assert(send(OBJECT, "bytes=8-1000", out, sizeof(out)));
+    assert(strstr(out, "Content-Range: bytes 8-9/10\r\n"));
+    assert(!strcmp(strstr(out, "\r\n\r\n") + 4, "89"));
+
+    /* 416 names the full length */
+    assert(send(OBJECT, "bytes=10-", out, sizeof(out)));
+    assert(!strncmp(out, "HTTP/1.0 416 Range Not Satisfiable\r\n", 36));
+    assert(strstr(out, "Content-Range: bytes */10\r\n"));
+
+    /* Ignored headers and non-200 objects leave the whole object to the caller */
+    assert(!send(OBJECT, "bytes=0-1,4-5", out, sizeof(out)) && out[0] == '\0');
+    assert(!send(OBJECT, "lines=1-2", out, sizeof(out)) && out[0] == '\0');
+    assert(!send("HTTP/1.0 404 Not Found\r\n\r\nnope", "bytes=0-1", out, sizeof(out)));
+}
+
+int main() {
+
+    test_parse_range();
+    test_send_range();
+    printf("tests on range all passed!\n");
+
+    return 0;
+}
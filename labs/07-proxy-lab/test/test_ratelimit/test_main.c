@@ -0,0 +1,134 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <netinet/in.h>
+#include "../../ratelimit.h"
+
+#define NTHREADS 4
+#define NITERS 1000
+
+static ratelimit_t rl;
+static atomic_int admitted;
+
+/* Admit and immediately finish, as a request that sends nothing */
+static rl_verdict_t request(uint32_t client, unsigned long now) {
+    rl_verdict_t v = ratelimit_admit(&rl, client, now);
+    if (v == RL_ADMIT)
+        ratelimit_done(&rl);
+    return v;
+}
+
+void test_ratelimit_requests() {
+    unsigned long now = 5000;
+
+    ratelimit_init(&rl, 100);
+    for (int i = 0; i < RL_REQ_BURST; i++)
+        assert(request(1, now) == RL_ADMIT);
+    assert(request(1, now) == RL_REJECT_RATE);
+    /* Other clients have buckets of their own */
+    assert(request(2, now) == RL_ADMIT);
+
+    /* One request's worth of tokens comes back every 1000 / RL_REQ_RATE ms */
+    assert(request(1, now + 1000 / RL_REQ_RATE - 1) == RL_REJECT_RATE);
+    assert(request(1, now + 1000 / RL_REQ_RATE) == RL_ADMIT);
+    assert(request(1, now + 1000 / RL_REQ_RATE) == RL_REJECT_RATE);
+
+    /* Refill never exceeds the burst */
+    now += 100000;
+    for (int i = 0; i < RL_REQ_BURST; i++)
+        assert(request(1, now) == RL_ADMIT);
+    assert(request(1, now) == RL_REJECT_RATE);
+    assert(atomic_load(&rl.rejected[RL_REJECT_RATE]) == 4);
+    assert(atomic_load(&rl.inflight) == 0);
+}
+
+void test_ratelimit_bytes() {
+    unsigned long now = 5000;
+
+    ratelimit_init(&rl, 100);
+    assert(request(1, now) == RL_ADMIT);
+    /* Overdraw by one second's worth */
+    ratelimit_charge(&rl, 1, RL_BYTE_BURST + RL_BYTE_RATE, now);
+    assert(request(1, now) == RL_REJECT_BYTES);
+    assert(request(1, now + 500) == RL_REJECT_BYTES);
+    assert(request(1, now + 1000) == RL_ADMIT);
+    assert(atomic_load(&rl.rejected[RL_REJECT_BYTES]) == 2);
+}
+
+void test_ratelimit_idle() {
+    unsigned long now = 5000;
+
+    ratelimit_init(&rl, 100);
+    for (int i = 0; i < RL_REQ_BURST; i++)
+        assert(request(1, now) == RL_ADMIT);
+    /* A caller whose clock reading lags another's gets no refill */
+    assert(request(1, now - 5) == RL_REJECT_RATE);
+
+    /* Idle for more than 2^31 ms: the bucket is full again */
+    now += (1UL << 31) + 1000;
+    for (int i = 0; i < RL_REQ_BURST; i++)
+        assert(request(1, now) == RL_ADMIT);
+    assert(request(1, now) == RL_REJECT_RATE);
+    assert(request(1, now + 1000 / RL_REQ_RATE) == RL_ADMIT);
+}
+
+void test_ratelimit_inflight() {
+    ratelimit_init(&rl, 2);
+    assert(ratelimit_admit(&rl, 1, 0) == RL_ADMIT);
+    assert(ratelimit_admit(&rl, 2, 0) == RL_ADMIT);
+    assert(ratelimit_admit(&rl, 3, 0) == RL_REJECT_BUSY);
+    ratelimit_done(&rl);
+    assert(ratelimit_admit(&rl, 3, 0) == RL_ADMIT);
+    ratelimit_shed(&rl);
+    assert(atomic_load(&rl.admitted) == 2);
+    assert(atomic_load(&rl.rejected[RL_REJECT_BUSY]) == 2);
+    assert(atomic_load(&rl.inflight) == 1);
+}
+
+void test_ratelimit_key() {
+    struct sockaddr_in a = { .sin_family = AF_INET };
+    struct sockaddr_in6 b = { .sin6_family = AF_INET6 };
+
+    a.sin_addr.s_addr = htonl(0x7f000001);
+    assert(ratelimit_key((struct sockaddr *)&a) == htonl(0x7f000001));
+    a.sin_addr.s_addr = 0;
+    assert(ratelimit_key((struct sockaddr *)&a) != 0);
+    b.sin6_addr.s6_addr[15] = 1;
+    assert(ratelimit_key((struct sockaddr *)&b) != 0);
+}
+
+static void *client_thread(void *vargp) {
+    for (int i = 0; i < NITERS; i++) {
+        /* Half the threads share one client, the rest spread over many */
+        uint32_t client = ((long)vargp % 2) ? 1 : 100 + i;
+        if (request(client, 5000) == RL_ADMIT && client == 1)
+            atomic_fetch_add(&admitted, 1);
+    }
+    return NULL;
+}
+
+void test_ratelimit_concurrent() {
+    pthread_t tid[NTHREADS];
+
+    ratelimit_init(&rl, 1000);
+    for (long i = 0; i < NTHREADS; i++)
+        pthread_create(&tid[i], NULL, client_thread, (void *)i);
+    for (int i = 0; i < NTHREADS; i++)
+        pthread_join(tid[i], NULL);
+    /* No token is spent twice and none is lost */
+    assert(atomic_load(&admitted) == RL_REQ_BURST);
+    assert(atomic_load(&rl.inflight) == 0);
+}
+
+int main() {
+
+    test_ratelimit_requests();
+    test_ratelimit_bytes();
+    test_ratelimit_idle();
+    test_ratelimit_inflight();
+    test_ratelimit_key();
+    test_ratelimit_concurrent();
+    printf("tests on ratelimit all passed!\n");
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * bench_main.c - contention benchmark for readers/writers locks
+ *
+ * Every thread performs a fixed number of operations, one write for every
+ * 99 reads, against rw_queue_t, pthread_rwlock_t and rwlock_t.
+ *
+ * usage: bench_main [max threads] [ops per thread]
+ */
+#include <stdlib.h>
+#include "../../csapp.h"
+#include "../../rwqueue.h"
+#include "../../rwlock.h"
+
+#define READS_PER_WRITE 99
+
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void (*read_lock)(void *tok);
+    void (*write_lock)(void *tok);
+    void (*read_unlock)(void);
+    void (*write_unlock)(void);
+} lock_ops_t;
+
+static rw_queue_t queue;
+static pthread_rwlock_t prw;
+static rwlock_t lock;
+
+static long ops_per_thread = 1000000;
+static volatile long shared_data[4];
+static volatile long sink;
+
+static void queue_init(void) { rw_queue_init(&queue); }
+static void queue_read_lock(void *tok) { rw_queue_request_read(&queue, tok); }
+static void queue_write_lock(void *tok) { rw_queue_request_write(&queue, tok); }
+static void queue_unlock(void) { rw_queue_release(&queue); }
+
+static void prw_init(void) { pthread_rwlock_init(&prw, NULL); }
+static void prw_read_lock(void *tok) { pthread_rwlock_rdlock(&prw); }
+static void prw_write_lock(void *tok) { pthread_rwlock_wrlock(&prw); }
+static void prw_unlock(void) { pthread_rwlock_unlock(&prw); }
+
+static void lock_init(void) { rwlock_init(&lock); }
+static void lock_read_lock(void *tok) { rwlock_read_lock(&lock); }
+static void lock_write_lock(void *tok) { rwlock_write_lock(&lock); }
+static void lock_read_unlock(void) { rwlock_read_unlock(&lock); }
+static void lock_write_unlock(void) { rwlock_write_unlock(&lock); }
+
+static const lock_ops_t locks[] = {
+    {"rw_queue_t", queue_init, queue_read_lock, queue_write_lock,
+     queue_unlock, queue_unlock},
+    {"pthread_rwlock_t", prw_init, prw_read_lock, prw_write_lock,
+     prw_unlock, prw_unlock},
+    {"rwlock_t", lock_init, lock_read_lock, lock_write_lock,
+     lock_read_unlock, lock_write_unlock},
+};
+
+static void *bench_thread(void *vargp) {
+    const lock_ops_t *ops = vargp;
+    rw_token_t tok;
+    long sum = 0;
+
+    for (long i = 0; i < ops_per_thread; i++) {
+        if (i % (READS_PER_WRITE + 1) == READS_PER_WRITE) {
+            ops->write_lock(&tok);
+            for (int j = 0; j < 4; j++)
+                shared_data[j]++;
+            ops->write_unlock();
+        } else {
+            ops->read_lock(&tok);
+            for (int j = 0; j < 4; j++)
+                sum += shared_data[j];
+            ops->read_unlock();
+        }
+    }
+    sink = sum;
+    return NULL;
+}
+
+static double run(const lock_ops_t *ops, int nthreads) {
+    pthread_t *tid = Calloc(nthreads, sizeof(pthread_t));
+    struct timespec start, end;
+
+    ops->init();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < nthreads; i++)
+        Pthread_create(&tid[i], NULL, bench_thread, (void *)ops);
+    for (int i = 0; i < nthreads; i++)
+        Pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    Free(tid);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int max_threads = 16;
+
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (argc > 2)
+        ops_per_thread = atol(argv[2]);
+
+    printf("%d:1 read/write, %ld ops per thread, Mops/sec\n",
+           READS_PER_WRITE, ops_per_thread);
+    printf("%8s", "threads");
+    for (int k = 0; k < sizeof(locks) / sizeof(locks[0]); k++)
+        printf("%18s", locks[k].name);
+    printf("\n");
+    for (int n = 1; n <= max_threads; n *= 2) {
+        printf("%8d", n);
+        for (int k = 0; k < sizeof(locks) / sizeof(locks[0]); k++) {
+            double secs = run(&locks[k], n);
+            printf("%18.2f", n * ops_per_thread / secs / 1e6);
+        }
+        printf("\n");
+    }
+    return 0;
+}
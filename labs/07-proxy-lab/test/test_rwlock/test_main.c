@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "../../rwlock.h"
+
+#define NREADERS 6
+#define NWRITERS 2
+#define NITERS 20000
+
+static rwlock_t lock;
+static long shared_a, shared_b;   // writers keep a == b
+
+static char order[8];
+static atomic_int norder;
+
+static void *reader_thread(void *vargp) {
+    for (int i = 0; i < NITERS; i++) {
+        rwlock_read_lock(&lock);
+        assert(shared_a == shared_b);
+        rwlock_read_unlock(&lock);
+    }
+    return NULL;
+}
+
+static void *writer_thread(void *vargp) {
+    for (int i = 0; i < NITERS / 10; i++) {
+        rwlock_write_lock(&lock);
+        shared_a++;
+        sched_yield();
+        shared_b++;
+        rwlock_write_unlock(&lock);
+    }
+    return NULL;
+}
+
+void test_rwlock_exclusion() {
+    pthread_t tid[NREADERS + NWRITERS];
+    int i;
+
+    rwlock_init(&lock);
+    shared_a = shared_b = 0;
+    for (i = 0; i < NREADERS; i++)
+        pthread_create(&tid[i], NULL, reader_thread, NULL);
+    for (; i < NREADERS + NWRITERS; i++)
+        pthread_create(&tid[i], NULL, writer_thread, NULL);
+    for (i = 0; i < NREADERS + NWRITERS; i++)
+        pthread_join(tid[i], NULL);
+    assert(shared_a == NWRITERS * (NITERS / 10));
+    assert(shared_b == shared_a);
+}
+
+static void *fifo_writer(void *vargp) {
+    rwlock_write_lock(&lock);
+    order[atomic_fetch_add(&norder, 1)] = 'w';
+    rwlock_write_unlock(&lock);
+    return NULL;
+}
+
+static void *fifo_reader(void *vargp) {
+    rwlock_read_lock(&lock);
+    order[atomic_fetch_add(&norder, 1)] = 'r';
+    rwlock_read_unlock(&lock);
+    return NULL;
+}
+
+/* A reader arriving behind a waiting writer must not overtake it */
+void test_rwlock_fifo() {
+    pthread_t w, r;
+
+    rwlock_init(&lock);
+    atomic_store(&norder, 0);
+    rwlock_read_lock(&lock);
+    pthread_create(&w, NULL, fifo_writer, NULL);
+    while (atomic_load(&lock.gate) == 0)
+        usleep(1000);
+    pthread_create(&r, NULL, fifo_reader, NULL);
+    usleep(50000);
+    assert(atomic_load(&norder) == 0);
+    rwlock_read_unlock(&lock);
+    pthread_join(w, NULL);
+    pthread_join(r, NULL);
+    assert(norder == 2 && order[0] == 'w' && order[1] == 'r');
+    assert(lock.head == NULL && !lock.writer && lock.gate == 0);
+}
+
+int main() {
+
+    test_rwlock_fifo();
+    test_rwlock_exclusion();
+    printf("tests on readers/writers lock all passed!\n");
+
+    return 0;
+}
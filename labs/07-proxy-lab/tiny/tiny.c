@@ -3,12 +3,14 @@
  * tiny.c - A simple, iterative HTTP/1.0 Web server that uses the 
  *     GET method to serve static and dynamic content.
  */
+#include <sys/sendfile.h>
 #include "csapp.h"
 
 void doit(int fd);
-void read_requesthdrs(rio_t *rp);
+void read_requesthdrs(rio_t *rp, char *range);
 int parse_uri(char *uri, char *filename, char *cgiargs);
-void serve_static(int fd, char *filename, int filesize);
+int parse_range(char *range, off_t filesize, off_t *first, off_t *last);
+void serve_static(int fd, char *filename, int filesize, char *range);
 void get_filetype(char *filename, char *filetype);
 void serve_dynamic(int fd, char *filename, char *cgiargs);
 void clienterror(int fd, char *cause, char *errnum, 
@@ -49,7 +51,7 @@ void doit(int fd)
     int is_static;
     struct stat sbuf;
     char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-    char filename[MAXLINE], cgiargs[MAXLINE];
+    char filename[MAXLINE], cgiargs[MAXLINE], range[MAXLINE];
     rio_t rio;
 
     /* Read request line and headers */
@@ -63,7 +65,7 @@ void doit(int fd)
                     "Tiny does not implement this method");
         return;
     }                                                    //line:netp:doit:endrequesterr
-    read_requesthdrs(&rio);                              //line:netp:doit:readrequesthdrs
+    read_requesthdrs(&rio, range);                       //line:netp:doit:readrequesthdrs
 
     /* Parse URI from GET request */
     is_static = parse_uri(uri, filename, cgiargs);       //line:netp:doit:staticcheck
@@ -79,7 +81,7 @@ void doit(int fd)
 				"Tiny couldn't read the file");
 			return;
 		}
-		serve_static(fd, filename, sbuf.st_size);        //line:netp:doit:servestatic
+		serve_static(fd, filename, sbuf.st_size, range); //line:netp:doit:servestatic
     }
     else { /* Serve dynamic content */
 		if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) { //line:netp:doit:executable
@@ -93,16 +95,20 @@ void doit(int fd)
 /* $end doit */
 
 /*
- * read_requesthdrs - read HTTP request headers
+ * read_requesthdrs - read HTTP request headers, keeping the value
+ *     of a Range header ("" if there is none)
  */
 /* $begin read_requesthdrs */
-void read_requesthdrs(rio_t *rp) 
+void read_requesthdrs(rio_t *rp, char *range) 
 {
     char buf[MAXLINE];
 
+    range[0] = '\0';
     Rio_readlineb(rp, buf, MAXLINE);
     printf("%s", buf);
     while(strcmp(buf, "\r\n")) {          //line:netp:readhdrs:checkterm
+		if (!strncasecmp(buf, "Range:", 6))
+			strcpy(range, buf + 6);
         Rio_readlineb(rp, buf, MAXLINE);
         printf("%s", buf);
     }
@@ -143,31 +149,97 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
 /* $end parse_uri */
 
 /*
- * serve_static - copy a file back to the client 
+ * parse_range - resolve a single byte range against the file size
+ *     return 1 if [first, last] is to be served, 0 to ignore the header
+ *     (malformed or several ranges) and -1 if it is unsatisfiable
+ */
+int parse_range(char *range, off_t filesize, off_t *first, off_t *last)
+{
+    char *p = range + strspn(range, " \t"), *end;
+    long long a, b;
+
+    if (strncasecmp(p, "bytes=", 6) || strchr(p, ','))
+		return 0;
+    p += 6;
+    if (*p == '-') {  /* Suffix range: the last b bytes */
+		b = strtoll(p+1, &end, 10);
+		if (end == p+1)
+			return 0;
+		if (b <= 0 || filesize == 0)
+			return -1;
+		*first = (b < filesize) ? filesize - b : 0;
+		*last = filesize - 1;
+		return 1;
+    }
+    a = strtoll(p, &end, 10);
+    if (end == p || *end != '-' || a < 0)
+		return 0;
+    p = end + 1;
+    b = strtoll(p, &end, 10);
+    if (end == p)
+		b = filesize - 1;
+    else if (b < a)
+		return 0;
+    if (a >= filesize)
+		return -1;
+    *first = a;
+    *last = (b < filesize) ? b : filesize - 1;
+    return 1;
+}
+
+/*
+ * serve_static - copy a file, or the requested byte range of it,
+ *     back to the client
  */
 /* $begin serve_static */
-void serve_static(int fd, char *filename, int filesize) 
+void serve_static(int fd, char *filename, int filesize, char *range) 
 {
-    int srcfd;
-    char *srcp, filetype[MAXLINE], buf[MAXBUF];
+    int srcfd, partial = 0;
+    off_t first = 0, last = filesize - 1;
+    ssize_t n;
+    char filetype[MAXLINE], buf[MAXBUF];
+
+    if (range[0]) {
+		partial = parse_range(range, filesize, &first, &last);
+		if (partial < 0) {
+			sprintf(buf, "HTTP/1.0 416 Range Not Satisfiable\r\n");
+			sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
+			sprintf(buf, "%sContent-Range: bytes */%d\r\n", buf, filesize);
+			sprintf(buf, "%sContent-length: 0\r\n\r\n", buf);
+			Rio_writen(fd, buf, strlen(buf));
+			return;
+		}
+    }
  
     /* Send response headers to client */
     get_filetype(filename, filetype);       //line:netp:servestatic:getfiletype
-    sprintf(buf, "HTTP/1.0 200 OK\r\n");    //line:netp:servestatic:beginserve
+    if (partial)
+		sprintf(buf, "HTTP/1.0 206 Partial Content\r\n");
+    else
+		sprintf(buf, "HTTP/1.0 200 OK\r\n");    //line:netp:servestatic:beginserve
     sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
     sprintf(buf, "%sConnection: close\r\n", buf);
-    sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);
+    sprintf(buf, "%sAccept-Ranges: bytes\r\n", buf);
+    if (partial)
+		sprintf(buf, "%sContent-Range: bytes %lld-%lld/%d\r\n", buf,
+				(long long)first, (long long)last, filesize);
+    sprintf(buf, "%sContent-length: %lld\r\n", buf, (long long)(last - first + 1));
     sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype);
     Rio_writen(fd, buf, strlen(buf));       //line:netp:servestatic:endserve
     printf("Response headers:\n");
     printf("%s", buf);
 
-    /* Send response body to client */
+    /* Send response body to client; the kernel copies straight from the
+       page cache, starting at the requested offset */
     srcfd = Open(filename, O_RDONLY, 0);    //line:netp:servestatic:open
-    srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0);//line:netp:servestatic:mmap
+    while (first <= last) {
+		n = sendfile(fd, srcfd, &first, last - first + 1); /* Advances first */
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)  /* Client went away */
+			break;
+    }
     Close(srcfd);                           //line:netp:servestatic:close
-    Rio_writen(fd, srcp, filesize);         //line:netp:servestatic:write
-    Munmap(srcp, filesize);                 //line:netp:servestatic:munmap
 }
 
 /*